@@ -0,0 +1,168 @@
+/* aot.c — runtime for ROMs translated by chip8-aot, see aot.h */
+#include <stdlib.h>
+#include <string.h>
+
+#include "aot.h"
+
+struct aot {
+    const aot_image_t *img;
+    const aot_block_t *table[MEM_SIZE];     /* by instruction address, NULL: interpreter */
+    uint8_t            left[MEM_SIZE];      /* instructions from there to the block's end */
+    uint8_t            code[MEM_SIZE / 8];  /* bytes some live block was made from */
+
+    bool      verify;
+    chip8_t   shadow;
+    uint64_t  mismatches;
+    uint64_t  translated, interpreted, dropped;
+};
+
+
+aot_t* aot_init(const aot_image_t *img, bool verify)
+{
+    aot_t *a = calloc(1, sizeof *a);
+    if (!a) return NULL;
+
+    a->img    = img;
+    a->verify = verify;
+    for (uint32_t i = 0; i < img->count; ++i) {
+        const aot_block_t *b = &img->blocks[i];
+        uint32_t           p = b->start;
+
+        /* straight-line code: the instructions follow by their lengths */
+        for (int k = b->len; k > 0; --k) {
+            const uint8_t *op = img->rom + (p - 0x200);
+            a->table[p] = b;
+            a->left[p]  = k;
+            p += op[0] == 0xF0 && op[1] == 0x00 ? 4 : 2;
+        }
+        for (p = b->start; p < b->end; ++p)
+            a->code[p >> 3] |= 1 << (p & 7);
+    }
+    return a;
+}
+
+void aot_destroy(aot_t *a)
+{
+    if (!a) return;
+    if (a->verify)
+        fprintf(stderr, "aot: %llu block mismatches\n",
+                (unsigned long long)a->mismatches);
+    free(a);
+}
+
+bool aot_matches(const aot_image_t *img, const chip8_t *c)
+{
+    return img->size <= MEM_SIZE - 0x200 &&
+           memcmp(c->memory.memory + 0x200, img->rom, img->size) == 0;
+}
+
+/* Blocks span at most AOT_MAXOPS four-byte instructions and a skipped one */
+void aot_invalidate(aot_t *a, uint16_t addr, uint32_t len)
+{
+    uint32_t back = 4 * AOT_MAXOPS + 2;
+    uint32_t lo   = addr > back ? addr - back : 0;
+    uint32_t hi = (uint32_t)addr + (len < MEM_SIZE ? len : MEM_SIZE);
+
+    if (hi > MEM_SIZE) aot_invalidate(a, 0, hi - MEM_SIZE);    /* wrapped */
+
+    for (uint32_t s = lo; s < hi && s < MEM_SIZE; ++s) {
+        const aot_block_t *b = a->table[s];
+        if (b && b->end > addr) {
+            a->table[s] = NULL;
+            a->dropped += s == b->start;
+        }
+    }
+}
+
+/* A write that lands on translated code retires the blocks made from it */
+static void wrote(aot_t *a, uint16_t addr, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; ++i) {
+        uint16_t p = addr + i;
+        if (a->code[p >> 3] & (1 << (p & 7))) {
+            aot_invalidate(a, addr, len);
+            return;
+        }
+    }
+}
+
+static void stored(aot_t *a, const chip8_t *c, uint16_t op)
+{
+    if ((op & 0xF0FF) == 0xF033) wrote(a, c->I, 3);
+    if ((op & 0xF0FF) == 0xF055) wrote(a, c->I, ((op >> 8) & 0xF) + 1);
+    if ((op & 0xF00F) == 0x5002) {
+        int x = (op >> 8) & 0xF, y = (op >> 4) & 0xF;
+        wrote(a, c->I, (x > y ? x - y : y - x) + 1);
+    }
+}
+
+/* Run the block and the interpreter on a copy, keep the interpreter's state */
+static void exec_verified(aot_t *a, const aot_block_t *b, chip8_t *c, int n)
+{
+    uint16_t pc = c->PC;
+
+    a->shadow = *c;
+    b->fn(c, n);
+    for (int i = 0; i < n; ++i)
+        chip8_cycle(&a->shadow);
+
+    if (memcmp(c, &a->shadow, sizeof *c) != 0) {
+        if (a->mismatches++ < 16)
+            fprintf(stderr, "aot: block %03X (%d ops from %03X) diverges from interpreter\n",
+                    b->start, n, pc);
+        *c = a->shadow;
+    }
+}
+
+static void interp(aot_t *a, chip8_t *c)
+{
+    uint16_t op = (AOT_MEM(c, c->PC) << 8) | AOT_MEM(c, c->PC + 1);
+
+    chip8_cycle(c);
+    stored(a, c, op);
+    a->interpreted++;
+}
+
+void aot_run(aot_t *a, chip8_t *c, uint64_t cycles)
+{
+    /* translated under the default profile, as engine_run does */
+    if (c->profile) {
+        chip8_run(c, cycles);
+        a->interpreted += cycles;
+        return;
+    }
+    while (cycles > 0) {
+        const aot_block_t *b = a->table[c->PC];
+
+        if (b) {
+            /* a block cut short stops before its store */
+            int left = a->left[c->PC];
+            int n    = (uint64_t)left <= cycles ? left : (int)cycles;
+            if (a->verify) exec_verified(a, b, c, n);
+            else           b->fn(c, n);
+            if (b->store && n == left) stored(a, c, b->store);
+            a->translated += n;
+            cycles -= n;
+            continue;
+        }
+        interp(a, c);
+        --cycles;
+    }
+}
+
+double aot_translated(const aot_t *a)
+{
+    uint64_t total = a->translated + a->interpreted;
+    return total ? (double)a->translated / total : 0.0;
+}
+
+void aot_print(FILE *f, const aot_t *a)
+{
+    uint64_t total = a->translated + a->interpreted;
+
+    fprintf(f, "aot: %s, %u blocks, %.1f%% of %llu instructions translated, "
+               "%llu blocks dropped after writes\n",
+            a->img->name, (unsigned)a->img->count,
+            total ? 100.0 * a->translated / total : 0.0,
+            (unsigned long long)total, (unsigned long long)a->dropped);
+}
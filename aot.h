@@ -0,0 +1,57 @@
+#ifndef AOT_H
+#define AOT_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "chip8.h"
+
+/*
+ * Ahead-of-time translation: chip8-aot turns a ROM into a C file with
+ * one function per basic block it could reach from 0x200; that file is
+ * compiled with full optimization and linked with this runtime and the
+ * core.  Blocks operate on chip8_t in place and leave PC at their
+ * successor, or where the caller's cycle budget ran out; since any of
+ * their instructions is an entry, a budget cut leaves no stretch to
+ * the interpreter.  Addresses without a block (unresolved Bnnn targets, code
+ * outside the ROM) and blocks whose bytes were overwritten run through
+ * chip8_cycle.
+ */
+#define AOT_MAXOPS  32              /* CHIP-8 instructions per block */
+
+/* Memory access with the interpreter's wrap-around */
+#define AOT_MEM(c, a)  ((c)->memory.memory[(uint16_t)(a)])
+
+/* Runs n instructions of the block from c->PC, one of its own */
+typedef void (*aot_fn)(chip8_t *c, int n);
+
+typedef struct {
+    uint16_t start;
+    uint16_t end;                   /* first address after the bytes it was made from */
+    uint8_t  len;                   /* instructions from start to its end */
+    uint16_t store;                 /* its last instruction if that writes memory, else 0 */
+    aot_fn   fn;
+} aot_block_t;
+
+typedef struct {
+    const char        *name;        /* ROM file it was made from */
+    const uint8_t     *rom;
+    uint32_t           size;
+    const aot_block_t *blocks;
+    uint32_t           count;
+} aot_image_t;
+
+typedef struct aot aot_t;
+
+aot_t* aot_init(const aot_image_t *img, bool verify);
+void aot_destroy(aot_t *a);
+/* The image was made from the ROM loaded in c */
+bool aot_matches(const aot_image_t *img, const chip8_t *c);
+/* Under any other profile than the default, chip8_run */
+void aot_run(aot_t *a, chip8_t *c, uint64_t cycles);
+/* Drops the blocks made from [addr, addr+len), for writes from outside */
+void aot_invalidate(aot_t *a, uint16_t addr, uint32_t len);
+void aot_print(FILE *f, const aot_t *a);
+/* Share of the instructions run so far that ran translated, 0..1 */
+double aot_translated(const aot_t *a);
+
+#endif /* AOT_H */
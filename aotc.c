@@ -0,0 +1,347 @@
+/* aotc.c — chip8-aot: translates a ROM into C for the aot.h runtime */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aot.h"
+#include "chip8.h"
+#include "dbg.h"
+
+#define BNNN_TABLE  128             /* entries a Bnnn jump table may have (V0 < 256) */
+
+typedef struct {
+    chip8_t  *c;                    /* the ROM loaded as the runtime would see it */
+    uint32_t  lo, hi;               /* ROM bytes, the only ones translated */
+    uint8_t   seen[MEM_SIZE];       /* instruction start visited by the walk */
+    uint8_t   leader[MEM_SIZE];     /* a block starts here */
+    uint16_t *work;
+    size_t    nwork;
+    int       unresolved;           /* Bnnn whose targets are unknown */
+} aotc_t;
+
+
+static uint16_t op_at(const aotc_t *t, uint32_t pc)
+{
+    return AOT_MEM(t->c, pc) << 8 | AOT_MEM(t->c, pc + 1);
+}
+
+/* Translatable: inside the ROM and decoded by opcode() */
+static bool valid(const aotc_t *t, uint32_t pc)
+{
+    char buf[32];
+    return pc >= t->lo && pc + chip8_oplen(t->c, pc) <= t->hi &&
+           strcmp(opcode(buf, sizeof buf, op_at(t, pc)), "???") != 0;
+}
+
+static void reach(aotc_t *t, uint32_t pc, bool lead)
+{
+    if (pc >= MEM_SIZE) return;
+    if (lead) t->leader[pc] = 1;
+    if (t->seen[pc] || !valid(t, pc)) return;
+    t->seen[pc] = 1;
+    t->work[t->nwork++] = pc;
+}
+
+/*
+ * Bnnn: V0 set by the instruction right before it gives one target;
+ * otherwise a run of 1nnn at nnn is taken as a jump table, each entry
+ * a block of its own.  Anything else is left to the interpreter.
+ */
+static void jump_table(aotc_t *t, uint32_t pc, uint16_t op)
+{
+    uint16_t nnn  = op & 0xFFF;
+    uint16_t prev = pc >= t->lo + 2 ? op_at(t, pc - 2) : 0;
+
+    if ((prev & 0xFF00) == 0x6000) {
+        reach(t, nnn + (prev & 0xFF), true);
+        return;
+    }
+    int n = 0;
+    while (n < BNNN_TABLE && valid(t, nnn + 2 * n) && (op_at(t, nnn + 2 * n) & 0xF000) == 0x1000)
+        reach(t, nnn + 2 * n++, true);
+    if (!n) t->unresolved++;
+}
+
+/* Control flow from 0x200: every target and every instruction after a block end leads */
+static void walk(aotc_t *t)
+{
+    reach(t, 0x200, true);
+    while (t->nwork) {
+        uint32_t pc   = t->work[--t->nwork];
+        uint16_t op   = op_at(t, pc);
+        uint32_t next = pc + chip8_oplen(t->c, pc);
+
+        switch (chip8_opclass(op)) {
+            case OPC_JP:   reach(t, op & 0xFFF, true); break;
+            case OPC_CALL: reach(t, op & 0xFFF, true); reach(t, next, true); break;
+            case OPC_JPV0: jump_table(t, pc, op); break;
+            case OPC_RET:  case OPC_EXIT: break;
+
+            case OPC_SE:  case OPC_SNE: case OPC_SER: case OPC_SNER:
+            case OPC_SKP: case OPC_SKNP:
+                reach(t, next, true);
+                reach(t, next + chip8_oplen(t->c, next), true);
+                break;
+
+            case OPC_KEY: case OPC_BCD: case OPC_STORE: case OPC_SAVE:
+                reach(t, next, true);
+                break;
+
+            default:
+                reach(t, next, false);
+                break;
+        }
+    }
+}
+
+
+/* Statements for one instruction; true if it ends the block (PC set) */
+static bool emit_op(const aotc_t *t, FILE *f, uint32_t pc, uint16_t op)
+{
+    int      x = (op >> 8) & 0xF, y = (op >> 4) & 0xF, n = op & 0xF;
+    unsigned kk = op & 0xFF, nnn = op & 0xFFF;
+    uint32_t next = (pc + chip8_oplen(t->c, pc)) & 0xFFFF;
+    uint32_t skip = (next + chip8_oplen(t->c, next)) & 0xFFFF;
+    char     buf[32];
+
+    fprintf(f, "    case 0x%03X:    /* %s */\n", pc, opcode(buf, sizeof buf, op));
+
+#define S(...)  fprintf(f, "        " __VA_ARGS__)
+    switch (chip8_opclass(op)) {
+        case OPC_NOP: return false;
+
+        case OPC_JP:   S("c->PC = 0x%03X;\n", nnn); return true;
+        case OPC_JPV0: S("c->PC = 0x%03X + c->regs[0];\n", nnn); return true;
+        case OPC_EXIT: S("c->PC = 0x%03X;\n", pc); return true;
+        case OPC_CALL:
+            S("if (c->SP < 16) { c->memory.stack[c->SP++] = 0x%03X; c->PC = 0x%03X; }\n", next, nnn);
+            S("else c->PC = 0x%03X;\n", next);
+            return true;
+        case OPC_RET:
+            S("c->PC = c->SP > 0 ? c->memory.stack[--c->SP] : 0x%03X;\n", next);
+            return true;
+
+        case OPC_SE:   S("c->PC = c->regs[%d] == 0x%02X ? 0x%03X : 0x%03X;\n", x, kk, skip, next); return true;
+        case OPC_SNE:  S("c->PC = c->regs[%d] != 0x%02X ? 0x%03X : 0x%03X;\n", x, kk, skip, next); return true;
+        case OPC_SER:  S("c->PC = c->regs[%d] == c->regs[%d] ? 0x%03X : 0x%03X;\n", x, y, skip, next); return true;
+        case OPC_SNER: S("c->PC = c->regs[%d] != c->regs[%d] ? 0x%03X : 0x%03X;\n", x, y, skip, next); return true;
+        case OPC_SKP: case OPC_SKNP:
+            S("c->PC = %sc->keypad[c->regs[%d] & 0xF] ? 0x%03X : 0x%03X;\n",
+              chip8_opclass(op) == OPC_SKNP ? "!" : "", x, skip, next);
+            return true;
+
+        case OPC_LD:   S("c->regs[%d] = 0x%02X;\n", x, kk);  return false;
+        case OPC_ADD:  S("c->regs[%d] += 0x%02X;\n", x, kk); return false;
+        case OPC_MOV:  S("c->regs[%d] = c->regs[%d];\n", x, y);  return false;
+        case OPC_OR:   S("c->regs[%d] |= c->regs[%d];\n", x, y); return false;
+        case OPC_AND:  S("c->regs[%d] &= c->regs[%d];\n", x, y); return false;
+        case OPC_XOR:  S("c->regs[%d] ^= c->regs[%d];\n", x, y); return false;
+
+        /* VF first, then Vx from the registers as they are now: chip8_cycle's order */
+        case OPC_ADDR:
+            S("{ unsigned s = c->regs[%d] + c->regs[%d]; c->regs[15] = s > 0xFF; c->regs[%d] = s; }\n", x, y, x);
+            return false;
+        case OPC_SUB:
+            S("c->regs[15] = c->regs[%d] >= c->regs[%d];\n", x, y);
+            S("c->regs[%d] -= c->regs[%d];\n", x, y);
+            return false;
+        case OPC_SHR:
+            S("c->regs[15] = c->regs[%d] & 1;\n", x);
+            S("c->regs[%d] >>= 1;\n", x);
+            return false;
+        case OPC_SUBN:
+            S("c->regs[15] = c->regs[%d] >= c->regs[%d];\n", y, x);
+            S("c->regs[%d] = c->regs[%d] - c->regs[%d];\n", x, y, x);
+            return false;
+        case OPC_SHL:
+            S("c->regs[15] = c->regs[%d] >> 7 & 1;\n", x);
+            S("c->regs[%d] <<= 1;\n", x);
+            return false;
+
+        case OPC_LDI:  S("c->I = 0x%03X;\n", nnn); return false;
+        case OPC_LDIL: S("c->I = 0x%04X;\n", op_at(t, pc + 2)); return false;
+        case OPC_RND:  S("c->regs[%d] = chip8_rand(c) & 0x%02X;\n", x, kk); return false;
+        case OPC_DRW:  S("chip8_draw(c, c->regs[%d], c->regs[%d], %d);\n", x, y, n); return false;
+        case OPC_GDT:  S("c->regs[%d] = c->DT;\n", x);  return false;
+        case OPC_SDT:  S("c->DT = c->regs[%d];\n", x);  return false;
+        case OPC_SST:  S("c->ST = c->regs[%d];\n", x);  return false;
+        case OPC_ADDI: S("c->I += c->regs[%d];\n", x); return false;
+        case OPC_FONT: S("c->I = c->regs[%d] * 5;\n", x); return false;
+        case OPC_BFONT: S("c->I = FONT_BIG + (c->regs[%d] & 0xF) * 10;\n", x); return false;
+
+        case OPC_LOAD:
+            for (int i = 0; i <= x; ++i)
+                S("c->regs[%d] = AOT_MEM(c, c->I + %d);\n", i, i);
+            return false;
+        case OPC_RESTORE:
+            for (int i = 0, r = x, d = x <= y ? 1 : -1; ; ++i, r += d) {
+                S("c->regs[%d] = AOT_MEM(c, c->I + %d);\n", r, i);
+                if (r == y) break;
+            }
+            return false;
+
+        /* writes end the block, so the runtime can check them against the code */
+        case OPC_BCD:
+            S("{ uint8_t v = c->regs[%d];\n", x);
+            S("  AOT_MEM(c, c->I) = v / 100; AOT_MEM(c, c->I + 1) = v / 10 %% 10; AOT_MEM(c, c->I + 2) = v %% 10; }\n");
+            S("c->PC = 0x%03X;\n", next);
+            return true;
+        case OPC_STORE:
+            for (int i = 0; i <= x; ++i)
+                S("AOT_MEM(c, c->I + %d) = c->regs[%d];\n", i, i);
+            S("c->PC = 0x%03X;\n", next);
+            return true;
+        case OPC_SAVE:
+            for (int i = 0, r = x, d = x <= y ? 1 : -1; ; ++i, r += d) {
+                S("AOT_MEM(c, c->I + %d) = c->regs[%d];\n", i, r);
+                if (r == y) break;
+            }
+            S("c->PC = 0x%03X;\n", next);
+            return true;
+
+        /* waits on the keypad: PC stays or moves on */
+        case OPC_KEY:
+            S("c->PC = 0x%03X; chip8_cycle(c);\n", pc);
+            return true;
+
+        /* display modes, scrolling, planes and audio: the interpreter's code */
+        default:
+            S("c->PC = 0x%03X; chip8_cycle(c);\n", pc);
+            return false;
+    }
+#undef S
+}
+
+/*
+ * From a leader up to control flow, a write, the next leader or
+ * AOT_MAXOPS.  The function enters at c->PC, any of its instructions,
+ * and runs n of them.  A block cut at AOT_MAXOPS makes the next
+ * instruction a leader, so a long straight run becomes a chain of
+ * blocks; translate() meets it later, addresses only go up.
+ */
+static void emit_block(aotc_t *t, FILE *f, uint32_t start, uint32_t *end, int *len, uint16_t *store)
+{
+    uint32_t pc = start, read = start;
+    int      n  = 0;
+
+    *store = 0;
+    fprintf(f, "static void b%04X(chip8_t *c, int n)\n{\n    (void)n;\n    switch (c->PC) {\n", start);
+    for (;;) {
+        uint16_t op   = op_at(t, pc);
+        uint32_t next = pc + chip8_oplen(t->c, pc);
+        int      k    = chip8_opclass(op);
+
+        read = next;
+        ++n;
+        if (emit_op(t, f, pc, op)) {
+            /* a skip decided its target from the next op's length */
+            if (k == OPC_SE || k == OPC_SNE || k == OPC_SER || k == OPC_SNER ||
+                k == OPC_SKP || k == OPC_SKNP)
+                read = next + 2;
+            if (k == OPC_BCD || k == OPC_STORE || k == OPC_SAVE) *store = op;
+            break;
+        }
+        if (n == AOT_MAXOPS || next >= MEM_SIZE || t->leader[next] || !valid(t, next)) {
+            if (n == AOT_MAXOPS && next < MEM_SIZE && valid(t, next)) t->leader[next] = 1;
+            fprintf(f, "        c->PC = 0x%03X;\n", next & 0xFFFF);
+            break;
+        }
+        /* the caller's budget may end inside the block */
+        fprintf(f, "        if (--n == 0) { c->PC = 0x%03X; return; }\n"
+                   "        /* fall through */\n", next);
+        pc = next;
+    }
+    fprintf(f, "    }\n}\n\n");
+    *end = read > MEM_SIZE ? MEM_SIZE : read;
+    *len = n;
+}
+
+static bool translate(aotc_t *t, const char *rom, const char *name, FILE *f)
+{
+    fprintf(f, "/* %s: generated by chip8-aot from %s, do not edit */\n"
+               "#include \"aot.h\"\n\n", name, rom);
+
+    fprintf(f, "static const uint8_t rom[%u] = {", t->hi - t->lo);
+    for (uint32_t a = t->lo; a < t->hi; ++a)
+        fprintf(f, "%s0x%02X,", (a - t->lo) % 16 ? " " : "\n    ", t->c->memory.memory[a]);
+    fprintf(f, "\n};\n\n");
+
+    uint32_t *ends   = calloc(MEM_SIZE, sizeof *ends);
+    int      *lens   = calloc(MEM_SIZE, sizeof *lens);
+    uint16_t *stores = calloc(MEM_SIZE, sizeof *stores);
+    uint32_t  count  = 0, ops = 0;
+    if (!ends || !lens || !stores) { free(ends); free(lens); free(stores); return false; }
+
+    for (uint32_t pc = t->lo; pc < t->hi; ++pc) {
+        if (!t->leader[pc] || !t->seen[pc]) continue;
+        emit_block(t, f, pc, &ends[pc], &lens[pc], &stores[pc]);
+        count++;
+        ops += lens[pc];
+    }
+
+    fprintf(f, "static const aot_block_t blocks[%u] = {\n", count ? count : 1);
+    for (uint32_t pc = t->lo; pc < t->hi; ++pc)
+        if (lens[pc])
+            fprintf(f, "    { 0x%03X, 0x%03X, %2d, 0x%04X, b%04X },\n",
+                    pc, ends[pc], lens[pc], stores[pc], pc);
+    if (!count) fprintf(f, "    { 0 },\n");     /* nothing reachable in the ROM */
+    fprintf(f, "};\n\n"
+               "const aot_image_t %s = { \"%s\", rom, sizeof rom, blocks, %u };\n",
+            name, rom, count);
+
+    fprintf(stderr, "%s: %u blocks, %u instructions, %d unresolved Bnnn\n",
+            rom, count, ops, t->unresolved);
+    free(ends);
+    free(lens);
+    free(stores);
+    return !ferror(f);
+}
+
+
+int main(int argc, char *argv[])
+{
+    const char *out = NULL, *rom = NULL, *name = "aot_image";
+    bool        ok  = true;
+
+    for (int i = 1; ok && i < argc; ++i) {
+        if      (strcmp(argv[i], "-o") == 0 && i + 1 < argc) out  = argv[++i];
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) name = argv[++i];
+        else if (argv[i][0] != '-' && !rom) rom = argv[i];
+        else ok = false;
+    }
+    if (!ok || !rom || !out) {
+        fprintf(stderr,
+                "Usage: %s [-n symbol] -o <out.c> <rom.ch8>\n"
+                "  -n <name>    name of the aot_image_t (default aot_image)\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    static aotc_t t;
+    t.c    = chip8_init();
+    t.work = malloc(MEM_SIZE * sizeof *t.work);
+    if (!t.c || !t.work) return EXIT_FAILURE;
+
+    FILE *in = fopen(rom, "rb");
+    if (!in) { perror(rom); return EXIT_FAILURE; }
+    size_t size = fread(t.c->memory.memory + 0x200, 1, MEM_SIZE - 0x200, in);
+    fclose(in);
+    if (size == 0) {
+        fprintf(stderr, "%s: empty ROM\n", rom);
+        return EXIT_FAILURE;
+    }
+    t.lo = 0x200;
+    t.hi = 0x200 + size;
+
+    walk(&t);
+
+    FILE *f = fopen(out, "w");
+    if (!f) { perror(out); return EXIT_FAILURE; }
+    ok = translate(&t, rom, name, f);
+    if (fclose(f) != 0 || !ok) {
+        perror(out);
+        return EXIT_FAILURE;
+    }
+    chip8_destroy(t.c);
+    free(t.work);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,207 @@
+/* aotrun.c — runs a translated ROM next to the interpreter, see aot.h */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "aot.h"
+#include "chip8.h"
+#include "movie.h"
+#include "pack.h"
+
+extern const aot_image_t aot_image;
+
+typedef struct {
+    const char *movie;
+    uint64_t    cycles;
+    int         hz;
+    uint32_t    seed;
+    double      min;            /* fail below this % translated */
+    bool        verify;
+} args_t;
+
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -movie <m>   replay an input movie, comparing with the interpreter at every event\n"
+            "  -cycles <n>  without a movie: instructions to run and time (default 50000000)\n"
+            "  -hz <n>      without a movie: CPU frequency (default 500)\n"
+            "  -seed <n>    without a movie: RNG seed (default 1)\n"
+            "  -verify      also check every block against chip8_cycle\n"
+            "  -min <pct>   fail if less than pct%% of instructions ran translated\n"
+            , prog);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static chip8_t *load(chip8_profile_t prof, uint32_t seed)
+{
+    chip8_t *c = chip8_init();
+    if (!c) return NULL;
+    memcpy(c->memory.memory + 0x200, aot_image.rom, aot_image.size);
+    chip8_set_profile(c, prof);
+    chip8_seed(c, seed);
+    return c;
+}
+
+/* The first field the two machines disagree on, for the report */
+static const char *differs(const chip8_t *a, const chip8_t *b)
+{
+    if (a->PC != b->PC)                              return "PC";
+    if (a->I != b->I)                                return "I";
+    if (memcmp(a->regs, b->regs, sizeof a->regs))    return "V";
+    if (a->SP != b->SP || memcmp(a->memory.stack, b->memory.stack, sizeof a->memory.stack))
+        return "stack";
+    if (a->DT != b->DT || a->ST != b->ST)            return "timers";
+    if (memcmp(a->FB, b->FB, sizeof a->FB) || a->hires != b->hires) return "display";
+    if (memcmp(a->memory.memory, b->memory.memory, MEM_SIZE)) return "memory";
+    if (memcmp(a, b, sizeof *a))                     return "other state";
+    return NULL;
+}
+
+/*
+ * movie_play's schedule, run on both machines: keys change at the
+ * recorded cycles, timers tick between frames.  The states are compared
+ * after every stretch between two events or frame ends.
+ */
+static bool replay(aot_t *a, const movie_t *m)
+{
+    chip8_profile_t prof;
+    if (!chip8_profile_find(m->quirks, &prof)) {
+        fprintf(stderr, "%s: no profile has quirks 0x%x\n", aot_image.name, m->quirks);
+        return false;
+    }
+
+    chip8_t *c = load(prof, m->seed), *ref = load(prof, m->seed);
+    uint64_t done  = 0;
+    int      carry = 0;
+    size_t   i     = 0;
+    bool     ok    = true;
+
+    if (!c || !ref) { chip8_destroy(c); chip8_destroy(ref); return false; }
+    if (pack_hash(aot_image.rom, aot_image.size) != m->rom_hash)
+        fprintf(stderr, "%s: not the ROM the movie was recorded on\n", aot_image.name);
+
+    while (ok && done < m->end) {
+        uint64_t n    = chip8_frame_cycles(m->hz, &carry);
+        bool     full = n <= m->end - done;
+        uint64_t stop = full ? done + n : m->end;
+
+        while (ok && done < stop) {
+            for (; i < m->count && m->ev[i].cycle <= done; ++i)
+                c->keypad[m->ev[i].key] = ref->keypad[m->ev[i].key] = m->ev[i].down;
+
+            uint64_t run = stop - done;
+            if (i < m->count && m->ev[i].cycle < stop) run = m->ev[i].cycle - done;
+            aot_run(a, c, run);
+            chip8_run(ref, run);
+            done += run;
+
+            const char *what = differs(c, ref);
+            if (what) {
+                fprintf(stderr, "%s: %s differs from the interpreter by cycle %llu\n",
+                        aot_image.name, what, (unsigned long long)done);
+                ok = false;
+            }
+        }
+        if (full) {
+            chip8_update(c);
+            chip8_update(ref);
+        }
+    }
+
+    if (ok) {
+        bool same = chip8_fb_hash(c) == m->fb_hash;
+        printf("%s: %llu cycles, %zu events, matches the interpreter, final frame %s\n",
+               aot_image.name, (unsigned long long)m->end, m->count,
+               same ? "as recorded" : "differs from the recording");
+        ok = same;
+    }
+    chip8_destroy(c);
+    chip8_destroy(ref);
+    return ok;
+}
+
+/* No input: the same cycles on both, timed */
+static bool race(aot_t *a, const args_t *args)
+{
+    chip8_t *c = load(PROFILE_DEFAULT, args->seed), *ref = load(PROFILE_DEFAULT, args->seed);
+    double   t[2];
+    int      carry;
+
+    if (!c || !ref) return false;
+    for (int k = 0; k < 2; ++k) {
+        double   t0 = now();
+        uint64_t done = 0;
+        carry = 0;
+        while (done < args->cycles) {
+            uint64_t n = chip8_frame_cycles(args->hz, &carry);
+            if (n > args->cycles - done) n = args->cycles - done;
+            if (k) aot_run(a, c, n);
+            else   chip8_run(ref, n);
+            k ? chip8_update(c) : chip8_update(ref);
+            done += n;
+        }
+        t[k] = now() - t0;
+    }
+
+    const char *what = differs(c, ref);
+    printf("%s: %llu cycles, interpreter %.1f Minstr/s, translated %.1f Minstr/s, %s\n",
+           aot_image.name, (unsigned long long)args->cycles,
+           args->cycles / t[0] / 1e6, args->cycles / t[1] / 1e6,
+           what ? "state differs" : "same state");
+    if (what) fprintf(stderr, "%s: %s differs from the interpreter\n", aot_image.name, what);
+    chip8_destroy(c);
+    chip8_destroy(ref);
+    return !what;
+}
+
+
+int main(int argc, char *argv[])
+{
+    args_t args = { .cycles = 50000000, .hz = 500, .seed = 1 };
+
+    for (int i = 1; i < argc; ++i) {
+        if      (strcmp(argv[i], "-movie") == 0 && i + 1 < argc)  args.movie  = argv[++i];
+        else if (strcmp(argv[i], "-cycles") == 0 && i + 1 < argc) args.cycles = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-hz") == 0 && i + 1 < argc)     args.hz     = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc)   args.seed   = strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "-verify") == 0)                 args.verify = true;
+        else if (strcmp(argv[i], "-min") == 0 && i + 1 < argc)    args.min    = atof(argv[++i]);
+        else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (args.hz < 1) args.hz = 500;
+
+    aot_t *a = aot_init(&aot_image, args.verify);
+    if (!a) return EXIT_FAILURE;
+
+    bool ok;
+    if (args.movie) {
+        movie_t *m = movie_load(args.movie);
+        if (!m) { aot_destroy(a); return EXIT_FAILURE; }
+        ok = replay(a, m);
+        movie_destroy(m);
+    } else {
+        ok = race(a, &args);
+    }
+
+    aot_print(stdout, a);
+    if (100 * aot_translated(a) < args.min) {
+        fprintf(stderr, "%s: under %.1f%% translated\n", aot_image.name, args.min);
+        ok = false;
+    }
+    aot_destroy(a);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
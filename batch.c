@@ -0,0 +1,480 @@
+/* batch.c — headless multi-instance runner, no SDL */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "chip8.h"
+#include "engine.h"
+#include "movie.h"
+#include "pack.h"
+#include "pool.h"
+#include "prof.h"
+#include "stats.h"
+
+typedef enum {
+    EXIT_CYCLES,     /* cycle limit reached             */
+    EXIT_HALT,       /* 1nnn jumping to itself          */
+    EXIT_KEYWAIT,    /* Fx0A with no input to ever come */
+    EXIT_LOAD,       /* ROM could not be loaded         */
+    EXIT_REPLAY,     /* movie replayed, same end frame  */
+    EXIT_DESYNC      /* movie replayed, frame differs   */
+} exit_t;
+
+static const char *exit_names[] = {
+    "cycles", "halt", "keywait", "load", "replay", "desync"
+};
+
+typedef struct {
+    const char    *path;
+    const uint8_t *data;
+    size_t         size;
+    int            hz;      /* from a pack, 0 – not set */
+    bool           mapped;  /* data points into a pack */
+    uint32_t       quirks;  /* from a pack */
+    chip8_profile_t profile;
+} rom_t;
+
+typedef struct {
+    int         rom;
+    uint64_t    hash;
+    uint64_t    cycles;
+    uint64_t    skipped;    /* of cycles, spent in skipped idle loops */
+    exit_t      exit;
+} result_t;
+
+typedef struct {
+    const char *path;
+    pack_t     *pack;
+} packs_t;
+
+typedef struct {
+    rom_t      *roms;
+    int         nroms;
+    packs_t    *packs;      /* every pack opened, each once */
+    int         npacks;
+    int         per_rom;
+    int         threads;
+    int         hz;         /* 0 – the pack's, else 500 */
+    int         profile;    /* -1 – the pack's, else default */
+    uint64_t    max_cycles;
+    engine_kind_t engine;
+    unsigned    flags;
+    uint32_t    seed;
+    movie_t    *movie;      /* -replay: input, seed, hz and quirks come from here */
+    bool        quiet;
+    bool        want_stats;
+    result_t   *results;
+    stats_t    *stats;      /* one per worker when -stats is given */
+    const char *prof_prefix;
+    prof_t    **profs;      /* one per worker when -prof is given */
+    uint64_t    prof_every; /* sample every N cycles instead of counting each */
+} batch_t;
+
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options] <rom.ch8 | pack.c8p[:name | #hash]...>\n"
+            "  -l <file>    read ROM paths from file, one per line\n"
+            "  -n <count>   instances per ROM (default 1)\n"
+            "  -j <n>       worker threads (default: all cores)\n"
+            "  -hz <n>      CPU frequency for timer ticks\n"
+            "               (default: the pack's, else 500)\n"
+            "  -cycles <n>  cycle limit per instance (default 10000000)\n"
+            "  -quirks <p>  default | vip | chip48 | schip | xochip\n"
+            "               (default: the pack's, else default)\n"
+            "  -engine <e>  switch | cache | jit (default switch)\n"
+            "  -verify      check JIT blocks against the interpreter\n"
+            "  -noidle      execute idle loops instead of skipping them\n"
+            "  -seed <n>    PRNG seed of every instance (default 1)\n"
+            "  -replay <m>  replay an input movie recorded by chip8 -record\n"
+            "  -stats       print opcode counters summed over all instances\n"
+            "  -prof <p>    profile the instances of one ROM: routines on stdout,\n"
+            "               flamegraph stacks in p.folded, p.pixels.folded,\n"
+            "               p.frames.folded and counted code in p.asm\n"
+            "  -prof-every <n>  sample every n cycles instead, with any engine\n"
+            "  -q           print only the aggregate line\n"
+            , prog);
+}
+
+/* A list names the same pack over and over, so each is mapped only once */
+static pack_t *get_pack(batch_t *b, const char *path)
+{
+    for (int i = 0; i < b->npacks; ++i)
+        if (!strcmp(b->packs[i].path, path)) return b->packs[i].pack;
+
+    pack_t *p = pack_open(path);
+    b->packs = realloc(b->packs, (b->npacks + 1) * sizeof *b->packs);
+    b->packs[b->npacks++] = (packs_t){ strdup(path), p };
+    return p;
+}
+
+static bool read_rom(batch_t *b, rom_t *r)
+{
+    char        path[4096];
+    const char *sel;
+    pack_rom_t  pr;
+
+    if (r->data) return true;
+    if (pack_spec(r->path, path, sizeof path, &sel)) {
+        pack_t *p = get_pack(b, path);
+        if (!p) return false;
+        if (!pack_select(p, sel, &pr)) {
+            fprintf(stderr, "%s: no such ROM in the pack\n", r->path);
+            return false;
+        }
+        r->data   = pr.data;
+        r->size   = pr.size;
+        r->hz     = pr.hz;
+        r->quirks = pr.quirks;
+        r->mapped = true;
+        return true;
+    }
+
+    FILE *f = fopen(r->path, "rb");
+    if (!f) { perror(r->path); return false; }
+
+    uint8_t *data = malloc(MEM_SIZE - 0x200);
+    r->size = fread(data, 1, MEM_SIZE - 0x200, f);
+    fclose(f);
+
+    if (r->size == 0) {
+        fprintf(stderr, "%s: empty ROM\n", r->path);
+        free(data);
+        return false;
+    }
+    r->data = data;
+    return true;
+}
+
+/* The movie's, -quirks, or the profile matching the pack's flags; a ROM
+   without one is not run */
+static bool rom_profile(const batch_t *b, rom_t *r)
+{
+    if (b->movie) r->quirks = b->movie->quirks;
+    else if (b->profile >= 0) {
+        r->profile = b->profile;
+        return true;
+    }
+    if (chip8_profile_find(r->quirks, &r->profile)) return true;
+
+    fprintf(stderr, "%s: no profile has quirks 0x%x\n", r->path, (unsigned)r->quirks);
+    if (!r->mapped) free((uint8_t *)r->data);
+    r->data = NULL;
+    return false;
+}
+
+static void push_rom(batch_t *b, rom_t r)
+{
+    b->roms = realloc(b->roms, (b->nroms + 1) * sizeof *b->roms);
+    b->roms[b->nroms++] = r;
+}
+
+/* A bare pack stands for every ROM in it, mapped right away */
+static void add_rom(batch_t *b, const char *path)
+{
+    size_t len = strlen(path);
+    if (len < 4 || strcmp(path + len - 4, ".c8p") != 0) {
+        push_rom(b, (rom_t){ .path = strdup(path) });
+        return;
+    }
+
+    pack_t *p = get_pack(b, path);
+    if (!p) exit(EXIT_FAILURE);
+    for (size_t i = 0; i < pack_count(p); ++i) {
+        pack_rom_t pr;
+        pack_get(p, i, &pr);
+
+        char *name = malloc(len + strlen(pr.name) + 2);
+        sprintf(name, "%s:%s", path, pr.name);
+        push_rom(b, (rom_t){ name, pr.data, pr.size, pr.hz, true, pr.quirks, 0 });
+    }
+}
+
+static void add_list(batch_t *b, const char *list)
+{
+    FILE *f = fopen(list, "r");
+    if (!f) { perror(list); exit(EXIT_FAILURE); }
+
+    char line[4096];
+    while (fgets(line, sizeof line, f)) {
+        line[strcspn(line, "\r\n")] = 0;
+        if (line[0] && line[0] != '#') add_rom(b, line);
+    }
+    fclose(f);
+}
+
+static batch_t parse_args(int argc, char *argv[])
+{
+    batch_t b = {0};
+    b.per_rom    = 1;
+    b.threads    = 0;
+    b.hz         = 0;
+    b.profile    = -1;
+    b.max_cycles = 10000000;
+    b.seed       = 1;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            add_list(&b, argv[++i]);
+        }
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            b.per_rom = atoi(argv[++i]);
+            if (b.per_rom < 1) b.per_rom = 1;
+        }
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            b.threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-hz") == 0 && i + 1 < argc) {
+            b.hz = atoi(argv[++i]);
+            if (b.hz < 60) {
+                fprintf(stderr, "Hz must be >=60\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (strcmp(argv[i], "-quirks") == 0 && i + 1 < argc) {
+            chip8_profile_t p;
+            if (!chip8_profile_parse(argv[++i], &p)) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            b.profile = p;
+        }
+        else if (strcmp(argv[i], "-cycles") == 0 && i + 1 < argc) {
+            b.max_cycles = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-engine") == 0 && i + 1 < argc) {
+            if (!engine_parse(argv[++i], &b.engine)) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (strcmp(argv[i], "-verify") == 0) {
+            b.flags |= ENGINE_VERIFY;
+        }
+        else if (strcmp(argv[i], "-noidle") == 0) {
+            b.flags |= ENGINE_NOIDLE;
+        }
+        else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc) {
+            b.seed = strtoul(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "-replay") == 0 && i + 1 < argc) {
+            if (!(b.movie = movie_load(argv[++i]))) exit(EXIT_FAILURE);
+        }
+        else if (strcmp(argv[i], "-stats") == 0) {
+            b.want_stats = true;
+        }
+        else if (strcmp(argv[i], "-prof") == 0 && i + 1 < argc) {
+            b.prof_prefix = argv[++i];
+        }
+        else if (strcmp(argv[i], "-prof-every") == 0 && i + 1 < argc) {
+            b.prof_every = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-q") == 0) {
+            b.quiet = true;
+        }
+        else if (argv[i][0] != '-') {
+            add_rom(&b, argv[i]);
+        }
+        else {
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (b.nroms == 0) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (b.prof_prefix && b.nroms != 1) {
+        fprintf(stderr, "-prof needs exactly one ROM\n");
+        exit(EXIT_FAILURE);
+    }
+    if (b.prof_every && (!b.prof_prefix || b.movie)) {
+        fprintf(stderr, "-prof-every needs -prof and no -replay\n");
+        exit(EXIT_FAILURE);
+    }
+    return b;
+}
+
+
+static uint16_t peek_op(const chip8_t *c)
+{
+    uint16_t pc = c->PC & (MEM_SIZE - 1);
+    return (c->memory.memory[pc] << 8) | c->memory.memory[(pc + 1) & (MEM_SIZE - 1)];
+}
+
+/* Checked once per frame: states from which the program can never progress */
+static bool stuck(const chip8_t *c, exit_t *why)
+{
+    uint16_t op = peek_op(c);
+
+    if (op == 0x00FD || (c->PC < 0x1000 && op == (0x1000 | c->PC))) {
+        *why = EXIT_HALT;
+        return true;
+    }
+    if ((op & 0xF0FF) == 0xF00A) {
+        for (int i = 0; i < 16; ++i)
+            if (c->keypad[i]) return false;
+        *why = EXIT_KEYWAIT;
+        return true;
+    }
+    return false;
+}
+
+static void run_instance(void *ctx, size_t idx, int worker)
+{
+    batch_t  *b   = ctx;
+    result_t *res = &b->results[idx];
+    rom_t    *rom = &b->roms[idx / b->per_rom];
+
+    res->rom = idx / b->per_rom;
+    if (!rom->data) { res->exit = EXIT_LOAD; return; }
+
+    chip8_t  *c = chip8_init();
+    engine_t *e = engine_init(b->engine, b->flags);
+    if (!e) { res->exit = EXIT_LOAD; chip8_destroy(c); return; }
+    /* from a pack this is the one copy, straight out of the mapping */
+    memcpy(c->memory.memory + 0x200, rom->data, rom->size);
+    chip8_set_profile(c, rom->profile);
+    /* one hook set per instance: the profiler wins over the counters */
+    if (b->profs && !b->prof_every) c->hooks = prof_hooks(b->profs[worker]);
+    else if (b->stats) c->hooks = &b->stats[worker].hooks;
+
+    if (b->movie) {
+        chip8_seed(c, b->movie->seed);
+        movie_play(b->movie, e, c);
+        res->cycles = b->movie->end;
+        res->hash   = chip8_fb_hash(c);
+        res->exit   = res->hash == b->movie->fb_hash ? EXIT_REPLAY : EXIT_DESYNC;
+        res->skipped = engine_skipped(e);
+        engine_destroy(e);
+        chip8_destroy(c);
+        return;
+    }
+    chip8_seed(c, b->seed);
+
+    uint64_t cycles = 0, sample = b->prof_every;
+    int      carry  = 0;
+    int      hz     = b->hz ? b->hz : rom->hz ? rom->hz : 500;
+    res->exit = EXIT_CYCLES;
+
+    while (cycles < b->max_cycles) {
+        uint64_t n = chip8_frame_cycles(hz, &carry);
+        if (n > b->max_cycles - cycles) n = b->max_cycles - cycles;
+
+        if (b->profs && b->prof_every) {
+            /* the engine runs unhooked between samples */
+            for (uint64_t left = n; left; ) {
+                uint64_t k = left < sample ? left : sample;
+                engine_run(e, c, k);
+                left -= k;
+                if (!(sample -= k)) {
+                    prof_sample(b->profs[worker], c, b->prof_every);
+                    sample = b->prof_every;
+                }
+            }
+        } else {
+            engine_run(e, c, n);
+        }
+        cycles += n;
+        chip8_update(c);
+
+        if (stuck(c, &res->exit)) break;
+    }
+
+    res->cycles = cycles;
+    res->hash   = chip8_fb_hash(c);
+    res->skipped = engine_skipped(e);
+    engine_destroy(e);
+    chip8_destroy(c);
+}
+
+
+int main(int argc, char *argv[])
+{
+    batch_t b = parse_args(argc, argv);
+
+    for (int i = 0; i < b.nroms; ++i) {
+        if (!read_rom(&b, &b.roms[i]) || !rom_profile(&b, &b.roms[i]) || !b.movie) continue;
+        if (pack_hash(b.roms[i].data, b.roms[i].size) != b.movie->rom_hash)
+            fprintf(stderr, "%s: not the ROM the movie was recorded on\n", b.roms[i].path);
+    }
+
+    size_t count = (size_t)b.nroms * b.per_rom;
+    b.results = calloc(count, sizeof *b.results);
+    if (b.threads < 1) b.threads = pool_cpus();
+    if (b.want_stats) {
+        b.stats = malloc(b.threads * sizeof *b.stats);
+        for (int i = 0; i < b.threads; ++i)
+            stats_init(&b.stats[i]);
+    }
+    if (b.prof_prefix) {
+        b.profs = calloc(b.threads, sizeof *b.profs);
+        for (int i = 0; i < b.threads; ++i)
+            if (!(b.profs[i] = prof_init())) exit(EXIT_FAILURE);
+    }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    pool_run(count, b.threads, run_instance, &b);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    uint64_t total = 0, skipped = 0;
+    for (size_t i = 0; i < count; ++i) {
+        result_t *r = &b.results[i];
+        total   += r->cycles;
+        skipped += r->skipped;
+        if (!b.quiet)
+            printf("%s\t#%zu\thash=%016llx\tcycles=%llu\texit=%s\n",
+                   b.roms[r->rom].path, i % b.per_rom,
+                   (unsigned long long)r->hash,
+                   (unsigned long long)r->cycles, exit_names[r->exit]);
+    }
+
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("engine=%s instances=%zu threads=%d instructions=%llu skipped=%llu "
+           "time=%.3fs ips=%.2fM\n",
+           engine_name(b.engine), count, b.threads, (unsigned long long)total,
+           (unsigned long long)skipped, secs, secs > 0 ? total / secs / 1e6 : 0.0);
+
+    if (b.stats) {
+        for (int i = 1; i < b.threads; ++i)
+            stats_merge(&b.stats[0], &b.stats[i]);
+        stats_print(stdout, &b.stats[0]);
+        free(b.stats);
+    }
+    if (b.profs) {
+        for (int i = 1; i < b.threads; ++i)
+            prof_merge(b.profs[0], b.profs[i]);
+        prof_print(stdout, b.profs[0]);
+
+        /* the listing decodes the ROM as loaded */
+        chip8_t *c = chip8_init();
+        if (c && b.roms[0].data) {
+            memcpy(c->memory.memory + 0x200, b.roms[0].data, b.roms[0].size);
+            prof_write(b.profs[0], c, b.prof_prefix);
+        }
+        chip8_destroy(c);
+        for (int i = 0; i < b.threads; ++i)
+            prof_destroy(b.profs[i]);
+        free(b.profs);
+    }
+
+    for (int i = 0; i < b.nroms; ++i) {
+        if (!b.roms[i].mapped) free((uint8_t *)b.roms[i].data);
+        free((char *)b.roms[i].path);
+    }
+    free(b.roms);
+    for (int i = 0; i < b.npacks; ++i) {
+        pack_close(b.packs[i].pack);
+        free((char *)b.packs[i].path);
+    }
+    free(b.packs);
+    free(b.results);
+    movie_destroy(b.movie);
+    return 0;
+}
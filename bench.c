@@ -0,0 +1,559 @@
+/* bench.c — core benchmark on synthetic ROMs, no SDL */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "chip8.h"
+#include "engine.h"
+#include "lanes.h"
+
+typedef struct {
+    const char    *name;
+    const uint8_t *code;
+    size_t         size;
+} prog_t;
+
+/* 8xyN arithmetic in a tight loop */
+static const uint8_t rom_alu[] = {
+    0x60,0x01,  /* 200: LD   V0, 01   */
+    0x61,0x03,  /* 202: LD   V1, 03   */
+    0x80,0x14,  /* 204: ADD  V0, V1   */
+    0x81,0x05,  /* 206: SUB  V1, V0   */
+    0x80,0x13,  /* 208: XOR  V0, V1   */
+    0x81,0x16,  /* 20A: SHR  V1       */
+    0x80,0x1E,  /* 20C: SHL  V0       */
+    0x80,0x11,  /* 20E: OR   V0, V1   */
+    0x81,0x02,  /* 210: AND  V1, V0   */
+    0x80,0x17,  /* 212: SUBN V0, V1   */
+    0x72,0x01,  /* 214: ADD  V2, 01   */
+    0x32,0x00,  /* 216: SE   V2, 00   */
+    0x12,0x04,  /* 218: JP   204      */
+    0x12,0x00,  /* 21A: JP   200      */
+};
+
+/* 15-row sprites walking across both screen edges */
+static const uint8_t rom_drw[] = {
+    0xA2,0x18,  /* 200: LD   I, 218   */
+    0x60,0x3C,  /* 202: LD   V0, 60   */
+    0x61,0x1C,  /* 204: LD   V1, 28   */
+    0xD0,0x1F,  /* 206: DRW  V0, V1, F */
+    0x70,0x03,  /* 208: ADD  V0, 03   */
+    0x71,0x05,  /* 20A: ADD  V1, 05   */
+    0x72,0x01,  /* 20C: ADD  V2, 01   */
+    0x32,0x40,  /* 20E: SE   V2, 40   */
+    0x12,0x06,  /* 210: JP   206      */
+    0x00,0xE0,  /* 212: CLS           */
+    0x62,0x00,  /* 214: LD   V2, 00   */
+    0x12,0x06,  /* 216: JP   206      */
+    0xFF,0x81,0xBD,0xA5,0xA5,0xBD,0x81,0xFF,
+    0x3C,0x7E,0xDB,0xFF,0xDB,0x66,0x3C,
+};
+
+/* Fx55/Fx65 sweeping a 960-byte buffer */
+static const uint8_t rom_mem[] = {
+    0xA4,0x00,  /* 200: LD   I, 400   */
+    0x60,0x00,  /* 202: LD   V0, 00   */
+    0x61,0x0F,  /* 204: LD   V1, 0F   */
+    0xFE,0x55,  /* 206: LD   [I], VE  */
+    0xFE,0x65,  /* 208: LD   VE, [I]  */
+    0xF1,0x1E,  /* 20A: ADD  I, V1    */
+    0x70,0x01,  /* 20C: ADD  V0, 01   */
+    0x30,0x40,  /* 20E: SE   V0, 40   */
+    0x12,0x06,  /* 210: JP   206      */
+    0x12,0x00,  /* 212: JP   200      */
+};
+
+/* Recursion 15 calls deep */
+static const uint8_t rom_call[] = {
+    0x60,0x00,  /* 200: LD   V0, 00   */
+    0x22,0x0A,  /* 202: CALL 20A      */
+    0x71,0x01,  /* 204: ADD  V1, 01   */
+    0x12,0x00,  /* 206: JP   200      */
+    0x00,0x00,  /* 208:               */
+    0x70,0x01,  /* 20A: ADD  V0, 01   */
+    0x30,0x0F,  /* 20C: SE   V0, 0F   */
+    0x22,0x0A,  /* 20E: CALL 20A      */
+    0x00,0xEE,  /* 210: RET           */
+};
+
+/* Game-like frame: move and redraw a sprite, score in BCD, wait on DT */
+static const uint8_t rom_game[] = {
+    0x00,0xE0,  /* 200: CLS           */
+    0x68,0x00,  /* 202: LD   V8, 00   */
+    0x69,0x00,  /* 204: LD   V9, 00   */
+    0x64,0x00,  /* 206: LD   V4, 00   */
+    0x63,0x02,  /* 208: LD   V3, 02   */
+    0xF3,0x15,  /* 20A: LD   DT, V3   */
+    0xA2,0x38,  /* 20C: LD   I, 238   */
+    0xD8,0x95,  /* 20E: DRW  V8, V9, 5 */
+    0xC2,0x07,  /* 210: RND  V2, 07   */
+    0x88,0x24,  /* 212: ADD  V8, V2   */
+    0x79,0x01,  /* 214: ADD  V9, 01   */
+    0xD8,0x95,  /* 216: DRW  V8, V9, 5 */
+    0x3F,0x00,  /* 218: SE   VF, 00   */
+    0x74,0x01,  /* 21A: ADD  V4, 01   */
+    0xE5,0x9E,  /* 21C: SKP  V5       */
+    0x78,0x01,  /* 21E: ADD  V8, 01   */
+    0xA3,0x00,  /* 220: LD   I, 300   */
+    0xF4,0x33,  /* 222: LD   B, V4    */
+    0xF2,0x65,  /* 224: LD   V2, [I]  */
+    0xF2,0x29,  /* 226: LD   F, V2    */
+    0x6A,0x38,  /* 228: LD   VA, 38   */
+    0x6B,0x00,  /* 22A: LD   VB, 00   */
+    0xDA,0xB5,  /* 22C: DRW  VA, VB, 5 */
+    0xDA,0xB5,  /* 22E: DRW  VA, VB, 5 */
+    0xF6,0x07,  /* 230: LD   V6, DT   */
+    0x36,0x00,  /* 232: SE   V6, 00   */
+    0x12,0x30,  /* 234: JP   230      */
+    0x12,0x08,  /* 236: JP   208      */
+    0x20,0x70,0xF8,0x70,0x20,
+};
+
+static const prog_t builtin[] = {
+    { "alu",  rom_alu,  sizeof rom_alu  },
+    { "drw",  rom_drw,  sizeof rom_drw  },
+    { "mem",  rom_mem,  sizeof rom_mem  },
+    { "call", rom_call, sizeof rom_call },
+    { "game", rom_game, sizeof rom_game },
+};
+
+#define NBUILTIN  (int)(sizeof builtin / sizeof builtin[0])
+
+typedef struct {
+    const prog_t *prog;
+    engine_kind_t engine;
+    chip8_profile_t profile;
+    char          name[16];         /* engine, engine/profile or lanes/N */
+    int           lanes;            /* 0: one instance through engine */
+    double        occupancy;        /* lanes: share of lane slots the groups filled */
+    uint64_t      instructions;     /* per trial */
+    uint64_t      frames;           /* per trial */
+    double        med, min, max;    /* seconds per trial */
+} result_t;
+
+typedef struct {
+    prog_t       *progs;
+    int           nprogs;
+    int           engines;          /* bit mask of engine_kind_t */
+    int           profiles;         /* bit mask of chip8_profile_t, run on switch */
+    int           trials;
+    int           hz;
+    uint64_t      cycles;
+    int           lanes;            /* lockstep rows with this many lanes */
+    const char   *csv;
+    const char   *json;
+    unsigned      flags;
+} bench_t;
+
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options] [rom.ch8...]\n"
+            "  -engine <e>  switch | cache | jit (default: all)\n"
+            "  -trials <n>  timed trials after one warm-up (default 5)\n"
+            "  -cycles <n>  instructions per trial (default 20000000)\n"
+            "  -hz <n>      CPU frequency, sets cycles per frame (default 500)\n"
+            "  -csv <file>  append results as CSV\n"
+            "  -json <file> write results as JSON\n"
+            "  -idle        let the engines skip idle loops (off: time every cycle)\n"
+            "  -lanes <n>   also run n lockstep lanes, seeded 1..n, after checking\n"
+            "               each against chip8_run for 600 frames\n"
+            "  -quirks <p>  also run the switch engine with quirk profile p\n"
+            "               (vip, chip48, schip, xochip or all)\n"
+            "ROM files given on the command line run after the built-in set.\n"
+            , prog);
+}
+
+static void add_rom(bench_t *b, const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) { perror(path); exit(EXIT_FAILURE); }
+
+    uint8_t *data = malloc(MEM_SIZE - 0x200);
+    size_t   size = fread(data, 1, MEM_SIZE - 0x200, f);
+    fclose(f);
+    if (size == 0) {
+        fprintf(stderr, "%s: empty ROM\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    b->progs = realloc(b->progs, (b->nprogs + 1) * sizeof *b->progs);
+    b->progs[b->nprogs++] = (prog_t){ path, data, size };
+}
+
+static bench_t parse_args(int argc, char *argv[])
+{
+    bench_t b = {0};
+    b.trials = 5;
+    b.hz     = 500;
+    b.cycles = 20000000;
+    b.flags  = ENGINE_NOIDLE;
+
+    b.progs = malloc(sizeof builtin);
+    memcpy(b.progs, builtin, sizeof builtin);
+    b.nprogs = NBUILTIN;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-engine") == 0 && i + 1 < argc) {
+            engine_kind_t k;
+            if (!engine_parse(argv[++i], &k)) { usage(argv[0]); exit(EXIT_FAILURE); }
+            b.engines |= 1 << k;
+        }
+        else if (strcmp(argv[i], "-trials") == 0 && i + 1 < argc) {
+            b.trials = atoi(argv[++i]);
+            if (b.trials < 1) b.trials = 1;
+        }
+        else if (strcmp(argv[i], "-cycles") == 0 && i + 1 < argc) {
+            b.cycles = strtoull(argv[++i], NULL, 10);
+            if (b.cycles == 0) b.cycles = 1;
+        }
+        else if (strcmp(argv[i], "-hz") == 0 && i + 1 < argc) {
+            b.hz = atoi(argv[++i]);
+            if (b.hz < 60) {
+                fprintf(stderr, "Hz must be >=60\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (strcmp(argv[i], "-lanes") == 0 && i + 1 < argc) {
+            b.lanes = atoi(argv[++i]);
+            if (b.lanes < 0) b.lanes = 0;
+        }
+        else if (strcmp(argv[i], "-quirks") == 0 && i + 1 < argc) {
+            chip8_profile_t p;
+            if (!strcmp(argv[++i], "all")) b.profiles |= ((1 << PROFILE_COUNT) - 1) & ~1;
+            else if (chip8_profile_parse(argv[i], &p)) b.profiles |= 1 << p;
+            else { usage(argv[0]); exit(EXIT_FAILURE); }
+        }
+        else if (strcmp(argv[i], "-idle") == 0) {
+            b.flags &= ~ENGINE_NOIDLE;
+        }
+        else if (strcmp(argv[i], "-csv") == 0 && i + 1 < argc) {
+            b.csv = argv[++i];
+        }
+        else if (strcmp(argv[i], "-json") == 0 && i + 1 < argc) {
+            b.json = argv[++i];
+        }
+        else if (argv[i][0] != '-') {
+            add_rom(&b, argv[i]);
+        }
+        else {
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (!b.engines) b.engines = (1 << ENGINE_COUNT) - 1;
+    return b;
+}
+
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Runs whole frames until at least cycles instructions have executed */
+static uint64_t run_frames(engine_t *e, chip8_t *c, int hz, int *carry,
+                           uint64_t cycles, uint64_t *frames)
+{
+    uint64_t done = 0;
+    *frames = 0;
+    while (done < cycles) {
+        uint64_t n = chip8_frame_cycles(hz, carry);
+        engine_run(e, c, n);
+        chip8_update(c);
+        done += n;
+        ++*frames;
+    }
+    return done;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void summarize(const bench_t *b, result_t *r, double *t)
+{
+    qsort(t, b->trials, sizeof *t, cmp_double);
+    r->min = t[0];
+    r->max = t[b->trials - 1];
+    r->med = b->trials & 1 ? t[b->trials / 2]
+                           : (t[b->trials / 2 - 1] + t[b->trials / 2]) / 2;
+}
+
+/* One warm-up trial fills caches and translates hot blocks, then the timed ones */
+static bool bench_one(const bench_t *b, result_t *r)
+{
+    chip8_t  *c = chip8_init();
+    engine_t *e = engine_init(r->engine, b->flags);
+    if (!c || !e) {
+        engine_destroy(e);
+        chip8_destroy(c);
+        return false;
+    }
+    chip8_seed(c, 1);
+    chip8_set_profile(c, r->profile);
+    memcpy(c->memory.memory + 0x200, r->prog->code, r->prog->size);
+
+    double  *t = malloc(b->trials * sizeof *t);
+    int      carry = 0;
+    uint64_t frames;
+
+    run_frames(e, c, b->hz, &carry, b->cycles, &frames);
+    for (int i = 0; i < b->trials; ++i) {
+        double t0 = now();
+        r->instructions = run_frames(e, c, b->hz, &carry, b->cycles, &r->frames);
+        t[i] = now() - t0;
+    }
+
+    summarize(b, r, t);
+    free(t);
+    engine_destroy(e);
+    chip8_destroy(c);
+    return true;
+}
+
+/* Lockstep lanes, instructions counted over all of them */
+static uint64_t run_lanes(lanes_t *L, int hz, int *carry, uint64_t cycles, uint64_t *frames)
+{
+    uint64_t done = 0;
+    *frames = 0;
+    while (done < cycles) {
+        uint64_t n = chip8_frame_cycles(hz, carry);
+        lanes_run(L, n);
+        lanes_update(L);
+        done += n * lanes_count(L);
+        ++*frames;
+    }
+    return done;
+}
+
+/*
+ * Before timing: every lane against its own machine under chip8_run,
+ * state hashes compared every VERIFY_EVERY frames (a hash reads all
+ * 64 KB of memory; a lane gone wrong stays wrong).  Lanes hold different
+ * keys at different times, so groups split and join again.
+ */
+#define VERIFY_FRAMES  600
+#define VERIFY_EVERY   10
+
+static bool verify_lanes(const bench_t *b, const prog_t *prog)
+{
+    lanes_t  *L   = lanes_init(b->lanes, prog->code, prog->size);
+    chip8_t **ref = calloc(b->lanes, sizeof *ref);
+    bool      ok  = L && ref;
+    int       carry = 0;
+
+    for (int l = 0; ok && l < b->lanes; ++l) {
+        lanes_seed(L, l, l + 1);
+        if (!(ref[l] = chip8_init())) { ok = false; break; }
+        memcpy(ref[l]->memory.memory + 0x200, prog->code, prog->size);
+        chip8_seed(ref[l], l + 1);
+    }
+
+    for (int f = 0; ok && f < VERIFY_FRAMES; ++f) {
+        for (int l = 0; l < b->lanes; ++l) {
+            int key = (f / 8 + l) & 0xF;
+            lanes_keypad(L, l)[key] = ref[l]->keypad[key] = (f + l) % 5 < 2;
+        }
+        uint64_t n = chip8_frame_cycles(b->hz, &carry);
+        lanes_run(L, n);
+        lanes_update(L);
+        for (int l = 0; ok && l < b->lanes; ++l) {
+            chip8_run(ref[l], n);
+            chip8_update(ref[l]);
+            if ((f + 1) % VERIFY_EVERY == 0 &&
+                chip8_state_hash(lanes_get(L, l)) != chip8_state_hash(ref[l])) {
+                fprintf(stderr, "%s: lane %d of %d differs from chip8_run by frame %d\n",
+                        prog->name, l, b->lanes, f);
+                ok = false;
+            }
+        }
+    }
+
+    for (int l = 0; ref && l < b->lanes; ++l)
+        chip8_destroy(ref[l]);
+    free(ref);
+    lanes_destroy(L);
+    return ok;
+}
+
+static bool bench_lanes(const bench_t *b, result_t *r)
+{
+    if (!verify_lanes(b, r->prog)) return false;
+
+    lanes_t *L = lanes_init(b->lanes, r->prog->code, r->prog->size);
+    if (!L) return false;
+    for (int l = 0; l < b->lanes; ++l)
+        lanes_seed(L, l, l + 1);
+
+    double  *t = malloc(b->trials * sizeof *t);
+    int      carry = 0;
+    uint64_t frames;
+
+    run_lanes(L, b->hz, &carry, b->cycles, &frames);
+    for (int i = 0; i < b->trials; ++i) {
+        double t0 = now();
+        r->instructions = run_lanes(L, b->hz, &carry, b->cycles, &r->frames);
+        t[i] = now() - t0;
+    }
+
+    const lanes_stats_t *s = lanes_stats(L);
+    r->occupancy = (double)(s->vector + s->scalar) / (s->steps * b->lanes);
+    summarize(b, r, t);
+    free(t);
+    lanes_destroy(L);
+    return true;
+}
+
+
+static void write_csv(const bench_t *b, const result_t *r, int n)
+{
+    FILE *f = fopen(b->csv, "a+");
+    if (!f) { perror(b->csv); return; }
+
+    /* header only for a fresh file, so runs accumulate into one table */
+    fseek(f, 0, SEEK_END);
+    if (ftell(f) == 0)
+        fprintf(f, "time,rom,engine,hz,trials,instructions,"
+                   "ips_median,ips_min,ips_max,ns_per_instr,fps\n");
+
+    long stamp = (long)time(NULL);
+    for (int i = 0; i < n; ++i) {
+        fprintf(f, "%ld,%s,%s,%d,%d,%llu,%.0f,%.0f,%.0f,%.3f,%.1f\n",
+                stamp, r[i].prog->name, r[i].name, b->hz, b->trials,
+                (unsigned long long)r[i].instructions,
+                r[i].instructions / r[i].med, r[i].instructions / r[i].max,
+                r[i].instructions / r[i].min, r[i].med * 1e9 / r[i].instructions,
+                r[i].frames / r[i].med);
+    }
+    fclose(f);
+}
+
+/* ROM names are paths from the command line: quote, backslash and
+ * control characters have to be escaped to keep the file valid JSON */
+static void json_str(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s; ++s) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') fprintf(f, "\\%c", c);
+        else if (c < 0x20)         fprintf(f, "\\u%04x", c);
+        else                       fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+static void write_json(const bench_t *b, const result_t *r, int n)
+{
+    FILE *f = fopen(b->json, "w");
+    if (!f) { perror(b->json); return; }
+
+    fprintf(f, "{\n  \"time\": %ld,\n  \"hz\": %d,\n  \"trials\": %d,\n  \"results\": [\n",
+            (long)time(NULL), b->hz, b->trials);
+    for (int i = 0; i < n; ++i) {
+        fprintf(f, "    {\"rom\": ");
+        json_str(f, r[i].prog->name);
+        fprintf(f, ", \"engine\": \"%s\", \"instructions\": %llu, "
+                   "\"ips_median\": %.0f, \"ips_min\": %.0f, \"ips_max\": %.0f, "
+                   "\"ns_per_instr\": %.3f, \"fps\": %.1f",
+                r[i].name,
+                (unsigned long long)r[i].instructions,
+                r[i].instructions / r[i].med, r[i].instructions / r[i].max,
+                r[i].instructions / r[i].min, r[i].med * 1e9 / r[i].instructions,
+                r[i].frames / r[i].med);
+        if (r[i].lanes)
+            fprintf(f, ", \"lanes\": %d, \"occupancy\": %.4f", r[i].lanes, r[i].occupancy);
+        fprintf(f, "}%s\n", i + 1 < n ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    fclose(f);
+}
+
+
+/* Lanes rows also carry the share of lane-instructions the kernels ran */
+static void print_row(const result_t *r)
+{
+    printf("%-10s %-13s %12.2f %5.1f..%-5.1f %9.3f %12.0f",
+           r->prog->name, r->name, r->instructions / r->med / 1e6,
+           100 * (r->min / r->med - 1), 100 * (r->max / r->med - 1),
+           r->med * 1e9 / r->instructions, r->frames / r->med);
+    if (r->lanes) printf("  occupancy %.1f%%", 100 * r->occupancy);
+    printf("\n");
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    bench_t   b = parse_args(argc, argv);
+    result_t *res = calloc((size_t)b.nprogs * (ENGINE_COUNT + PROFILE_COUNT + 1), sizeof *res);
+    int       n = 0;
+    bool      failed = false;
+
+    printf("%-10s %-13s %12s %12s %9s %12s\n",
+           "rom", "engine", "Minstr/s", "min..max %", "ns/instr", "frames/s");
+
+    for (int p = 0; p < b.nprogs; ++p) {
+        for (int k = 0; k < ENGINE_COUNT; ++k) {
+            if (!(b.engines & (1 << k))) continue;
+
+            result_t *r = &res[n];
+            r->prog   = &b.progs[p];
+            r->engine = k;
+            snprintf(r->name, sizeof r->name, "%s", engine_name(k));
+            if (!bench_one(&b, r)) {
+                fprintf(stderr, "%s: %s engine unavailable\n",
+                        r->prog->name, engine_name(k));
+                continue;
+            }
+            n++;
+
+            print_row(r);
+        }
+
+        /* the same interpreter specialized for each profile */
+        for (int q = 1; q < PROFILE_COUNT; ++q) {
+            if (!(b.profiles & (1 << q))) continue;
+
+            result_t *r = &res[n];
+            r->prog    = &b.progs[p];
+            r->engine  = ENGINE_SWITCH;
+            r->profile = q;
+            snprintf(r->name, sizeof r->name, "switch/%s", chip8_profile_name(q));
+            if (!bench_one(&b, r)) continue;
+            n++;
+            print_row(r);
+        }
+
+        if (b.lanes) {
+            result_t *r = &res[n];
+            r->prog  = &b.progs[p];
+            r->lanes = b.lanes;
+            snprintf(r->name, sizeof r->name, "lanes/%d", b.lanes);
+            if (!bench_lanes(&b, r)) {
+                fprintf(stderr, "%s: %s failed\n", r->prog->name, r->name);
+                failed = true;
+                continue;
+            }
+            n++;
+            print_row(r);
+        }
+    }
+
+    if (b.csv)  write_csv(&b, res, n);
+    if (b.json) write_json(&b, res, n);
+
+    for (int p = NBUILTIN; p < b.nprogs; ++p)
+        free((uint8_t *)b.progs[p].code);
+    free(b.progs);
+    free(res);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,431 @@
+/* brk.c — breakpoints, watchpoints and the debugger prompt, see brk.h */
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "brk.h"
+#include "dbg.h"
+
+enum { R_I = 16, R_DT, R_ST, R_SP };
+enum { CMP_EQ, CMP_NE, CMP_LT, CMP_LE, CMP_GT, CMP_GE };
+
+#define COND_MAX  4
+
+typedef struct {
+    int      what;                  /* V0..VF, then R_* */
+    int      cmp;
+    uint16_t value;
+} cond_t;
+
+typedef struct {
+    int      id;                    /* 0: free slot */
+    bool     watch;
+    uint16_t addr;
+    uint32_t len;                   /* watch: bytes from addr */
+    int      access;                /* watch: 1 << ACCESS_READ | 1 << ACCESS_WRITE */
+    int      ncond;
+    cond_t   cond[COND_MAX];
+} point_t;
+
+struct brk {
+    chip8_break_t marks;
+    point_t       pt[BRK_MAX];
+    int           next_id;
+
+    bool          stop;             /* prompt before the next instruction */
+    bool          resume;           /* the next instruction runs past its mark */
+    uint64_t      step;             /* instructions left to single-step */
+    bool          quit;
+    char          last[256];        /* repeated by an empty line */
+    char          why[64];          /* of the pending stop */
+};
+
+static const char *reg_names[] = {
+    "V0", "V1", "V2", "V3", "V4", "V5", "V6", "V7",
+    "V8", "V9", "VA", "VB", "VC", "VD", "VE", "VF", "I", "DT", "ST", "SP"
+};
+static const char *cmp_names[] = { "==", "!=", "<", "<=", ">", ">=" };
+
+
+brk_t* brk_init(void)
+{
+    brk_t *b = calloc(1, sizeof *b);
+    if (!b) return NULL;
+    b->next_id = 1;
+    strcpy(b->last, "step");
+    return b;
+}
+
+void brk_destroy(brk_t *b)
+{
+    free(b);
+}
+
+void brk_stop(brk_t *b)
+{
+    b->stop = true;
+    strcpy(b->why, "stopped");
+}
+
+bool brk_quit(const brk_t *b)
+{
+    return b->quit;
+}
+
+/* The bitmaps from the list, after any change to it */
+static void mark(brk_t *b)
+{
+    memset(&b->marks, 0, sizeof b->marks);
+    for (int i = 0; i < BRK_MAX; ++i) {
+        const point_t *p = &b->pt[i];
+        if (!p->id) continue;
+        if (!p->watch) {
+            b->marks.pc[p->addr >> 3] |= 1 << (p->addr & 7);
+            continue;
+        }
+        for (uint32_t k = 0; k < p->len; ++k) {
+            uint16_t a = p->addr + k;
+            b->marks.mem[a >> 3] |= 1 << (a & 7);
+        }
+        b->marks.watch = true;
+    }
+}
+
+static point_t *add(brk_t *b)
+{
+    for (int i = 0; i < BRK_MAX; ++i)
+        if (!b->pt[i].id) {
+            memset(&b->pt[i], 0, sizeof b->pt[i]);
+            return &b->pt[i];
+        }
+    fprintf(stderr, "At most %d breakpoints and watchpoints\n", BRK_MAX);
+    return NULL;
+}
+
+static bool parse_addr(const char **s, uint32_t *v)
+{
+    char *end;
+    unsigned long a = strtoul(*s, &end, 16);
+    if (end == *s || a >= MEM_SIZE) return false;
+    *v = a;
+    *s = end;
+    return true;
+}
+
+static bool parse_cond(const char **s, cond_t *c)
+{
+    const char *p = *s;
+    size_t      n;
+
+    c->what = -1;
+    for (int r = R_SP; r >= 0 && c->what < 0; --r) {
+        n = strlen(reg_names[r]);
+        if (!strncmp(p, reg_names[r], n)) c->what = r;
+    }
+    if (c->what < 0) return false;
+    p += strlen(reg_names[c->what]);
+
+    c->cmp = -1;
+    for (int k = CMP_GE; k >= 0 && c->cmp < 0; --k) {     /* "<=" before "<" */
+        n = strlen(cmp_names[k]);
+        if (!strncmp(p, cmp_names[k], n)) c->cmp = k;
+    }
+    if (c->cmp < 0) return false;
+    p += strlen(cmp_names[c->cmp]);
+
+    uint32_t v;
+    if (!parse_addr(&p, &v)) return false;
+    c->value = v;
+    *s = p;
+    return true;
+}
+
+bool brk_break(brk_t *b, const char *spec)
+{
+    const char *s = spec;
+    uint32_t    addr;
+    point_t     p = { 0 };
+
+    if (!parse_addr(&s, &addr)) goto bad;
+    p.addr = addr;
+    if (*s == ':') {
+        do {
+            ++s;
+            if (p.ncond == COND_MAX || !parse_cond(&s, &p.cond[p.ncond++])) goto bad;
+        } while (*s == '&');
+    }
+    if (*s) goto bad;
+
+    point_t *slot = add(b);
+    if (!slot) return false;
+    *slot    = p;
+    slot->id = b->next_id++;
+    mark(b);
+    return true;
+bad:
+    fprintf(stderr, "Bad breakpoint '%s': ADDR[:COND[&COND...]], e.g. 2A4:V3==5&I>=300\n", spec);
+    return false;
+}
+
+bool brk_watch(brk_t *b, const char *spec)
+{
+    const char *s = spec;
+    uint32_t    lo, hi;
+    point_t     p = { .watch = true };
+
+    if (!parse_addr(&s, &lo)) goto bad;
+    hi = lo;
+    if (*s == '-' || *s == '+') {
+        bool plus = *s++ == '+';
+        if (!parse_addr(&s, &hi)) goto bad;
+        hi = plus ? lo + hi - 1 : hi;
+        if (hi < lo || hi >= MEM_SIZE) goto bad;
+    }
+    p.addr   = lo;
+    p.len    = hi - lo + 1;
+    p.access = 1 << ACCESS_WRITE;
+    if (*s == ':') {
+        ++s;
+        if      (!strcmp(s, "r"))  p.access = 1 << ACCESS_READ;
+        else if (!strcmp(s, "w"))  p.access = 1 << ACCESS_WRITE;
+        else if (!strcmp(s, "rw")) p.access = 1 << ACCESS_READ | 1 << ACCESS_WRITE;
+        else goto bad;
+        s += strlen(s);
+    }
+    if (*s) goto bad;
+
+    point_t *slot = add(b);
+    if (!slot) return false;
+    *slot    = p;
+    slot->id = b->next_id++;
+    mark(b);
+    return true;
+bad:
+    fprintf(stderr, "Bad watchpoint '%s': ADDR[-END | +LEN][:r | :w | :rw]\n", spec);
+    return false;
+}
+
+
+static uint16_t op_at(const chip8_t *c, uint16_t pc)
+{
+    return c->memory.memory[pc] << 8 | c->memory.memory[(pc + 1) & (MEM_SIZE - 1)];
+}
+
+static int reg(const chip8_t *c, int what)
+{
+    switch (what) {
+        case R_I:  return c->I;
+        case R_DT: return c->DT;
+        case R_ST: return c->ST;
+        case R_SP: return c->SP;
+        default:   return c->regs[what];
+    }
+}
+
+static bool holds(const chip8_t *c, const point_t *p)
+{
+    for (int i = 0; i < p->ncond; ++i) {
+        int v = reg(c, p->cond[i].what), w = p->cond[i].value;
+        bool ok;
+        switch (p->cond[i].cmp) {
+            case CMP_EQ: ok = v == w; break;
+            case CMP_NE: ok = v != w; break;
+            case CMP_LT: ok = v <  w; break;
+            case CMP_LE: ok = v <= w; break;
+            case CMP_GT: ok = v >  w; break;
+            default:     ok = v >= w; break;
+        }
+        if (!ok) return false;
+    }
+    return true;
+}
+
+/* Why chip8_run_break stopped, if it was for a point that really applies */
+static bool hit(brk_t *b, const chip8_t *c)
+{
+    uint16_t op = op_at(c, c->PC);
+    uint16_t addr;
+    uint32_t len;
+    int      kind = chip8_access(c, op, &addr, &len);
+
+    for (int i = 0; i < BRK_MAX; ++i) {
+        const point_t *p = &b->pt[i];
+        if (!p->id) continue;
+
+        if (!p->watch) {
+            if (p->addr != c->PC || !holds(c, p)) continue;
+            snprintf(b->why, sizeof b->why, "breakpoint %d", p->id);
+            return true;
+        }
+        if (!kind || !(p->access & 1 << kind)) continue;
+        /* the access overlaps the range, allowing for wrap-around */
+        uint32_t off = (uint16_t)(p->addr - addr);
+        if (off < len || (uint16_t)(addr - p->addr) < p->len) {
+            snprintf(b->why, sizeof b->why, "watchpoint %d: %s %04X+%u", p->id,
+                     kind == ACCESS_READ ? "read" : "write", addr, (unsigned)len);
+            return true;
+        }
+    }
+    return false;
+}
+
+
+static void where(const chip8_t *c, const char *why)
+{
+    uint16_t op = op_at(c, c->PC);
+    char     buf[32];
+    const char *mnem = opcode(buf, sizeof buf, op);
+
+    if (op == 0xF000) {     /* the long operand is the next word */
+        snprintf(buf, sizeof buf, "LD I,%04X", op_at(c, c->PC + 2));
+        mnem = buf;
+    }
+    printf("%s at %04X: %04X  %s\n", why, c->PC, op, mnem);
+}
+
+static void regs(const chip8_t *c)
+{
+    printf("PC:%04X  I:%04X  SP:%02X  DT:%02X  ST:%02X  %s PLANE:%X\n",
+           c->PC, c->I, c->SP, c->DT, c->ST, c->hires ? "HIGH" : "LOW ", c->planes);
+    for (int i = 0; i < 16; ++i)
+        printf("│ V%-2X:%02X%s", i, c->regs[i], (i == 7 || i == 15) ? " │\n" : "");
+    if (c->SP) {
+        printf("stack:");
+        for (int i = 0; i < c->SP && i < 16; ++i)
+            printf(" %04X", c->memory.stack[i]);
+        printf("\n");
+    }
+}
+
+static void mem(const chip8_t *c, uint32_t addr, uint32_t len)
+{
+    for (uint32_t row = 0; row < len; row += 16) {
+        printf("%04X:", (uint16_t)(addr + row));
+        for (uint32_t i = row; i < row + 16 && i < len; ++i)
+            printf(" %02X", c->memory.memory[(uint16_t)(addr + i)]);
+        printf("\n");
+    }
+}
+
+static void info(const brk_t *b)
+{
+    for (int i = 0; i < BRK_MAX; ++i) {
+        const point_t *p = &b->pt[i];
+        if (!p->id) continue;
+        if (p->watch) {
+            printf("%2d  watch  %04X-%04X %s%s\n", p->id, p->addr, p->addr + p->len - 1,
+                   p->access & 1 << ACCESS_READ ? "r" : "",
+                   p->access & 1 << ACCESS_WRITE ? "w" : "");
+            continue;
+        }
+        printf("%2d  break  %04X", p->id, p->addr);
+        for (int k = 0; k < p->ncond; ++k)
+            printf("%c%s%s%X", k ? '&' : ':', reg_names[p->cond[k].what],
+                   cmp_names[p->cond[k].cmp], p->cond[k].value);
+        printf("\n");
+    }
+}
+
+static void help(void)
+{
+    printf("continue (c)        run to the next stop\n"
+           "step (s) [N]        run N instructions (default 1)\n"
+           "regs (r)            registers and stack\n"
+           "mem (m) ADDR [LEN]  hex dump, LEN bytes (default 40)\n"
+           "break (b) SPEC      ADDR[:COND[&COND...]], e.g. 2A4:V3==5&I>=300\n"
+           "watch (w) SPEC      ADDR[-END | +LEN][:r | :w | :rw]\n"
+           "info (i)            list breakpoints and watchpoints\n"
+           "delete (d) [N]      remove one, or all\n"
+           "quit (q)\n"
+           "An empty line repeats the last command; numbers are hex.\n");
+}
+
+static bool is(const char *cmd, const char *full)
+{
+    return !strcmp(cmd, full) || (cmd[0] == full[0] && !cmd[1]);
+}
+
+/* Reads commands until one lets the machine run again */
+static void prompt(brk_t *b, const chip8_t *c)
+{
+    char line[256];
+
+    where(c, b->why);
+    for (;;) {
+        printf("(chip8) ");
+        fflush(stdout);
+        if (!fgets(line, sizeof line, stdin)) {
+            b->quit = true;
+            return;
+        }
+        line[strcspn(line, "\r\n")] = 0;
+        if (line[0]) strcpy(b->last, line);
+        else         strcpy(line, b->last);
+
+        char *cmd = strtok(line, " \t"), *arg = strtok(NULL, " \t"), *arg2 = strtok(NULL, " \t");
+        if (!cmd) continue;
+
+        if (is(cmd, "continue")) {
+            return;
+        } else if (is(cmd, "step")) {
+            unsigned long long n = arg ? strtoull(arg, NULL, 16) : 1;
+            b->step = n ? n : 1;
+            return;
+        } else if (is(cmd, "regs")) {
+            regs(c);
+        } else if (is(cmd, "mem") && arg) {
+            mem(c, strtoul(arg, NULL, 16), arg2 ? strtoul(arg2, NULL, 16) : 0x40);
+        } else if (is(cmd, "break") && arg) {
+            brk_break(b, arg);
+        } else if (is(cmd, "watch") && arg) {
+            brk_watch(b, arg);
+        } else if (is(cmd, "info")) {
+            info(b);
+        } else if (is(cmd, "delete")) {
+            int id = arg ? atoi(arg) : 0;
+            for (int i = 0; i < BRK_MAX; ++i)
+                if (!id || b->pt[i].id == id) b->pt[i].id = 0;
+            mark(b);
+        } else if (is(cmd, "quit")) {
+            b->quit = true;
+            return;
+        } else {
+            help();
+        }
+    }
+}
+
+uint64_t brk_run(brk_t *b, chip8_t *c, uint64_t cycles)
+{
+    uint64_t done = 0;
+
+    while (done < cycles && !b->quit) {
+        if (b->stop) {
+            b->stop = false;
+            prompt(b, c);
+            b->resume = true;
+            continue;
+        }
+        if (b->step || b->resume) {
+            /* single steps, and the instruction a stop was made at, run unchecked */
+            chip8_cycle(c);
+            ++done;
+            b->resume = false;
+            if (b->step && !--b->step) {
+                brk_stop(b);
+                break;
+            }
+            continue;
+        }
+        done += chip8_run_break(c, cycles - done, &b->marks);
+        if (done < cycles) {
+            if (hit(b, c)) {
+                b->stop = true;
+                break;
+            }
+            b->resume = true;       /* a condition or access kind that does not apply */
+        }
+    }
+    return done;
+}
@@ -0,0 +1,38 @@
+#ifndef BRK_H
+#define BRK_H
+
+#include <stdbool.h>
+#include "chip8.h"
+
+/*
+ * Breakpoints and watchpoints with an interactive prompt on stdin.
+ * The machine runs through chip8_run_break, so between stops it costs
+ * one bitmap test per instruction; conditions and access kinds are
+ * only checked at marked addresses.
+ *
+ *   break  2A4            before the instruction at 2A4
+ *   break  2A4:V3==5&I>=300   ... when all the predicates hold
+ *                         (V0..VF, I, DT, ST, SP; == != < <= > >=; hex)
+ *   watch  300-30F:w      Fx33/Fx55/5xy2 writing any of 300..30F
+ *   watch  300+10:rw      reads too: Fx65/5xy3/Dxyn/F002
+ */
+#define BRK_MAX  64
+
+typedef struct brk brk_t;
+
+brk_t* brk_init(void);
+void brk_destroy(brk_t *b);
+bool brk_break(brk_t *b, const char *spec);
+bool brk_watch(brk_t *b, const char *spec);
+/* Prompt before the next instruction */
+void brk_stop(brk_t *b);
+/* `quit` was typed at the prompt */
+bool brk_quit(const brk_t *b);
+
+/*
+ * Runs up to cycles, returns the cycles run.  After a stop it returns
+ * early so the caller can draw; the prompt comes on the next call.
+ */
+uint64_t brk_run(brk_t *b, chip8_t *c, uint64_t cycles);
+
+#endif /* BRK_H */
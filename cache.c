@@ -0,0 +1,248 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+
+#ifdef __GNUC__
+/* labels-as-values are a GNU extension, used on purpose below */
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+/* Entry kinds are the OPC_* classes plus one "decode me" marker */
+#define K_DECODE   OPC_COUNT
+
+typedef struct {
+    uint8_t  kind;
+    uint8_t  x;
+    uint16_t nnn;           /* y = nnn>>4 & F, kk = nnn & FF, n = nnn & F */
+} centry_t;
+
+struct cache {
+    centry_t tab[MEM_SIZE / 2];
+};
+
+
+cache_t* cache_init(void)
+{
+    cache_t *k = malloc(sizeof *k);
+    if (!k) return NULL;
+    for (int i = 0; i < MEM_SIZE / 2; ++i)
+        k->tab[i].kind = K_DECODE;
+    return k;
+}
+
+void cache_destroy(cache_t *k)
+{
+    free(k);
+}
+
+void cache_invalidate(cache_t *k, uint16_t addr, uint32_t len)
+{
+    if (len == 0) return;
+    if (len > MEM_SIZE) len = MEM_SIZE;
+
+    /* one entry per two bytes, wrapping at the end of memory */
+    uint32_t last = (addr + len - 1) >> 1;
+    for (uint32_t e = addr >> 1; e <= last; ++e)
+        k->tab[e & (MEM_SIZE / 2 - 1)].kind = K_DECODE;
+}
+
+static void decode(cache_t *k, const chip8_t *c, uint16_t pc)
+{
+    uint16_t op = (c->memory.memory[pc] << 8) | c->memory.memory[pc + 1];
+    centry_t *e = &k->tab[pc >> 1];
+    e->x    = (op >> 8) & 0x0F;
+    e->nnn  = op & 0x0FFF;
+    e->kind = chip8_opclass(op);
+}
+
+
+#ifdef __GNUC__
+#define CASE(k)     case k: L_##k:
+#define DISPATCH()  goto *labels[e->kind]
+#else
+#define CASE(k)     case k:
+#define DISPATCH()  goto dispatch
+#endif
+
+/* Odd or out-of-range PCs have no entry and go through chip8_cycle */
+#define FETCH() do {                                            \
+        if ((c->PC & 1) || c->PC >= MEM_SIZE - 1) goto slow;    \
+        e = &k->tab[c->PC >> 1];                                \
+        c->PC += 2;                                             \
+        DISPATCH();                                             \
+    } while (0)
+
+#define NEXT() do { if (--left == 0) return; FETCH(); } while (0)
+
+#define X     (e->x)
+#define Y     ((e->nnn >> 4) & 0x0F)
+#define KK    (e->nnn & 0xFF)
+#define NNN   (e->nnn)
+#define V     (c->regs)
+#define M(a)  (c->memory.memory[(a) & (MEM_SIZE - 1)])
+#define SKIP() (c->PC += chip8_oplen(c, c->PC))
+
+void cache_run(cache_t *k, chip8_t *c, uint64_t cycles)
+{
+#ifdef __GNUC__
+    static const void *const labels[K_DECODE + 1] = {
+        &&L_OPC_NOP,
+        &&L_OPC_CLS,  &&L_OPC_RET,  &&L_OPC_JP,   &&L_OPC_CALL,
+        &&L_OPC_SE,   &&L_OPC_SNE,  &&L_OPC_SER,  &&L_OPC_LD,   &&L_OPC_ADD,
+        &&L_OPC_MOV,  &&L_OPC_OR,   &&L_OPC_AND,  &&L_OPC_XOR,  &&L_OPC_ADDR,
+        &&L_OPC_SUB,  &&L_OPC_SHR,  &&L_OPC_SUBN, &&L_OPC_SHL,  &&L_OPC_SNER,
+        &&L_OPC_LDI,  &&L_OPC_JPV0, &&L_OPC_RND,  &&L_OPC_DRW,  &&L_OPC_SKP,  &&L_OPC_SKNP,
+        &&L_OPC_GDT,  &&L_OPC_KEY,  &&L_OPC_SDT,  &&L_OPC_SST,  &&L_OPC_ADDI,
+        &&L_OPC_FONT, &&L_OPC_BCD,  &&L_OPC_STORE, &&L_OPC_LOAD,
+        &&L_OPC_SCD,  &&L_OPC_SCU,  &&L_OPC_SCR,  &&L_OPC_SCL,  &&L_OPC_EXIT,
+        &&L_OPC_LOW,  &&L_OPC_HIGH, &&L_OPC_SAVE, &&L_OPC_RESTORE,
+        &&L_OPC_LDIL, &&L_OPC_PLANE, &&L_OPC_AUDIO, &&L_OPC_BFONT,
+        &&L_OPC_PITCH, &&L_OPC_SRPL, &&L_OPC_LRPL,
+        &&L_K_DECODE,
+    };
+#endif
+    uint64_t  left = cycles;
+    centry_t *e;
+
+    if (left == 0) return;
+    FETCH();
+
+slow: {
+        uint16_t pc = c->PC & (MEM_SIZE - 1);
+        uint16_t op = (c->memory.memory[pc] << 8) | c->memory.memory[(pc + 1) & (MEM_SIZE - 1)];
+        chip8_cycle(c);
+        if ((op & 0xF0FF) == 0xF033) cache_invalidate(k, c->I, 3);
+        if ((op & 0xF0FF) == 0xF055) cache_invalidate(k, c->I, ((op >> 8) & 0xF) + 1);
+        if ((op & 0xF00F) == 0x5002) {
+            int x = (op >> 8) & 0xF, y = (op >> 4) & 0xF;
+            cache_invalidate(k, c->I, (x > y ? x - y : y - x) + 1);
+        }
+        NEXT();
+    }
+
+#ifndef __GNUC__
+dispatch:
+#endif
+    switch (e->kind) {
+        CASE(K_DECODE)
+            decode(k, c, c->PC - 2);
+            DISPATCH();
+
+        CASE(OPC_NOP)
+            NEXT();
+
+        /* plane-aware display ops and the rare SUPER-CHIP/XO-CHIP ones
+           go back through chip8_cycle */
+        CASE(OPC_CLS)
+        CASE(OPC_SCD)  CASE(OPC_SCU)  CASE(OPC_SCR)  CASE(OPC_SCL)
+        CASE(OPC_EXIT) CASE(OPC_LOW)  CASE(OPC_HIGH)
+        CASE(OPC_SAVE) CASE(OPC_RESTORE) CASE(OPC_LDIL)
+        CASE(OPC_PLANE) CASE(OPC_AUDIO) CASE(OPC_BFONT)
+        CASE(OPC_PITCH) CASE(OPC_SRPL) CASE(OPC_LRPL)
+            c->PC -= 2;
+            goto slow;
+
+        CASE(OPC_RET)
+            if (c->SP > 0) c->PC = c->memory.stack[--c->SP];
+            NEXT();
+
+        CASE(OPC_JP)
+            c->PC = NNN;
+            NEXT();
+
+        CASE(OPC_CALL)
+            if (c->SP < 16) {
+                c->memory.stack[c->SP++] = c->PC;
+                c->PC = NNN;
+            }
+            NEXT();
+
+        CASE(OPC_SE)   if (V[X] == KK)   SKIP(); NEXT();
+        CASE(OPC_SNE)  if (V[X] != KK)   SKIP(); NEXT();
+        CASE(OPC_SER)  if (V[X] == V[Y]) SKIP(); NEXT();
+        CASE(OPC_SNER) if (V[X] != V[Y]) SKIP(); NEXT();
+        CASE(OPC_LD)   V[X] = KK;        NEXT();
+        CASE(OPC_ADD)  V[X] += KK;       NEXT();
+        CASE(OPC_MOV)  V[X] = V[Y];      NEXT();
+        CASE(OPC_OR)   V[X] |= V[Y];     NEXT();
+        CASE(OPC_AND)  V[X] &= V[Y];     NEXT();
+        CASE(OPC_XOR)  V[X] ^= V[Y];     NEXT();
+
+        CASE(OPC_ADDR) {
+            uint16_t sum = V[X] + V[Y];
+            V[0xF] = (sum > 0xFF);
+            V[X] = sum & 0xFF;
+            NEXT();
+        }
+
+        CASE(OPC_SUB)
+            V[0xF] = (V[X] >= V[Y]);
+            V[X] -= V[Y];
+            NEXT();
+
+        CASE(OPC_SHR)
+            V[0xF] = V[X] & 1;
+            V[X] >>= 1;
+            NEXT();
+
+        CASE(OPC_SUBN)
+            V[0xF] = (V[Y] >= V[X]);
+            V[X] = V[Y] - V[X];
+            NEXT();
+
+        CASE(OPC_SHL)
+            V[0xF] = (V[X] >> 7) & 1;
+            V[X] <<= 1;
+            NEXT();
+
+        CASE(OPC_LDI)  c->I = NNN;              NEXT();
+        CASE(OPC_JPV0) c->PC = NNN + V[0];      NEXT();
+        CASE(OPC_RND)  V[X] = chip8_rand(c) & KK; NEXT();
+
+        CASE(OPC_DRW)
+            chip8_draw(c, V[X], V[Y], e->nnn & 0xF);
+            NEXT();
+
+        CASE(OPC_SKP)  if (c->keypad[V[X] & 0xF])  SKIP(); NEXT();
+        CASE(OPC_SKNP) if (!c->keypad[V[X] & 0xF]) SKIP(); NEXT();
+
+        CASE(OPC_GDT)  V[X] = c->DT;      NEXT();
+
+        CASE(OPC_KEY)
+            for (int i = 0; i < 16; ++i) {
+                if (c->keypad[i]) { V[X] = i; NEXT(); }
+            }
+            c->PC -= 2;
+            NEXT();
+
+        CASE(OPC_SDT)  c->DT = V[X];      NEXT();
+        CASE(OPC_SST)  c->ST = V[X];      NEXT();
+        CASE(OPC_ADDI) c->I += V[X];      NEXT();
+        CASE(OPC_FONT) c->I = V[X] * 5;   NEXT();
+
+        CASE(OPC_BCD) {
+            uint8_t val = V[X];
+            M(c->I)     = val / 100;
+            M(c->I + 1) = (val / 10) % 10;
+            M(c->I + 2) = val % 10;
+            cache_invalidate(k, c->I, 3);
+            NEXT();
+        }
+
+        CASE(OPC_STORE)
+            if (c->I + X < MEM_SIZE)
+                for (int i = 0; i <= X; ++i) c->memory.memory[c->I + i] = V[i];
+            else
+                for (int i = 0; i <= X; ++i) M(c->I + i) = V[i];
+            cache_invalidate(k, c->I, X + 1);
+            NEXT();
+
+        CASE(OPC_LOAD)
+            if (c->I + X < MEM_SIZE)
+                for (int i = 0; i <= X; ++i) V[i] = c->memory.memory[c->I + i];
+            else
+                for (int i = 0; i <= X; ++i) V[i] = M(c->I + i);
+            NEXT();
+    }
+}
@@ -0,0 +1,17 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "chip8.h"
+
+/*
+ * Pre-decoded instruction cache: one 4-byte entry per even address,
+ * decoded lazily on first execution and dispatched with threaded code.
+ */
+typedef struct cache cache_t;
+
+cache_t* cache_init(void);
+void cache_destroy(cache_t *k);
+void cache_invalidate(cache_t *k, uint16_t addr, uint32_t len);
+void cache_run(cache_t *k, chip8_t *c, uint64_t cycles);
+
+#endif /* CACHE_H */
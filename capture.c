@@ -0,0 +1,468 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "capture.h"
+
+/*
+ * The ring is single-producer single-consumer with head/tail counters,
+ * as the trace writer in dbg.c.  A slot is just the two bitplanes, so
+ * the emulator side costs one 2 KB copy per frame.  The writer expands
+ * a slot into scanlines of palette indices, (filter byte, w indices)
+ * per row as PNG wants them, and encodes from there.
+ *
+ * PNG is 8-bit indexed with a fixed-Huffman deflate stream.  Matches
+ * are only looked for one byte back (runs of a colour) and one row back
+ * (rows repeated by the scale), which is where all the redundancy of a
+ * scaled CHIP-8 screen is; a 512x256 frame takes 1-10 KB, within 3x
+ * of zlib -9 at a fraction of its time.
+ */
+typedef struct {
+    uint64_t frame;             /* emulated frame number */
+    bool     hires;
+    uint64_t FB[2][FB_H][FB_WORDS];
+} cslot_t;
+
+struct capture {
+    FILE     *out;              /* Y4M stream, NULL for PNG files */
+    char      dir[4000];
+    int       scale;
+    int       w, h;
+    unsigned  flags;
+    uint32_t  colors[4];
+    uint8_t   y[4], u[4], v[4];
+
+    cslot_t   ring[CAPTURE_SLOTS];
+    uint64_t  head;             /* frames queued by the emulator   */
+    uint64_t  tail;             /* frames written by the writer    */
+    bool      done;
+    pthread_t writer;
+
+    /* emulator side */
+    uint64_t  frames;
+    uint64_t  dups;
+    uint64_t  dropped;
+
+    /* writer side, buffers allocated once */
+    uint8_t  *raw;              /* h rows of (filter byte, w indices) */
+    uint8_t  *buf;              /* encoded frame                      */
+    size_t    buf_size;
+    uint64_t  written;
+    uint64_t  bytes;
+    bool      error;
+};
+
+/* Fixed Huffman codes, bit-reversed for an LSB-first writer */
+static uint16_t lit_code[288];
+static uint8_t  lit_bits[288];
+static uint32_t crc_table[256];
+
+static const uint16_t len_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t len_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static uint32_t reverse(uint32_t v, int n)
+{
+    uint32_t r = 0;
+    for (int i = 0; i < n; ++i, v >>= 1) r = r << 1 | (v & 1);
+    return r;
+}
+
+static void tables(void)
+{
+    static bool ready;
+    if (ready) return;
+
+    for (int s = 0; s < 288; ++s) {
+        uint32_t code;
+        int      n;
+        if      (s < 144) { code = 0x30 + s;         n = 8; }
+        else if (s < 256) { code = 0x190 + s - 144;  n = 9; }
+        else if (s < 280) { code = s - 256;          n = 7; }
+        else              { code = 0xC0 + s - 280;   n = 8; }
+        lit_code[s] = reverse(code, n);
+        lit_bits[s] = n;
+    }
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crc_table[i] = c;
+    }
+    ready = true;
+}
+
+static uint32_t crc32(uint32_t crc, const uint8_t *p, size_t n)
+{
+    crc = ~crc;
+    while (n--) crc = crc_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static uint32_t adler32(const uint8_t *p, size_t n)
+{
+    uint32_t a = 1, b = 0;
+    while (n) {
+        size_t k = n < 5552 ? n : 5552;     /* no overflow before the modulo */
+        n -= k;
+        while (k--) { a += *p++; b += a; }
+        a %= 65521;
+        b %= 65521;
+    }
+    return b << 16 | a;
+}
+
+static uint8_t *put_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+    return p + 4;
+}
+
+
+typedef struct {
+    uint8_t *p;
+    uint64_t acc;
+    int      n;
+} bits_t;
+
+static inline void put_bits(bits_t *b, uint32_t v, int n)
+{
+    b->acc |= (uint64_t)v << b->n;
+    b->n   += n;
+    while (b->n >= 8) {
+        *b->p++ = (uint8_t)b->acc;
+        b->acc >>= 8;
+        b->n    -= 8;
+    }
+}
+
+static inline void put_sym(bits_t *b, int s)
+{
+    put_bits(b, lit_code[s], lit_bits[s]);
+}
+
+static void put_match(bits_t *b, size_t len, size_t dist)
+{
+    int i = 28, j = 29;
+    while (len_base[i] > len)   --i;
+    while (dist_base[j] > dist) --j;
+    put_sym(b, 257 + i);
+    put_bits(b, len - len_base[i], len_extra[i]);
+    put_bits(b, reverse(j, 5), 5);
+    put_bits(b, dist - dist_base[j], dist_extra[j]);
+}
+
+static inline size_t match(const uint8_t *a, const uint8_t *b, size_t max)
+{
+    size_t n = 0;
+    if (max > 258) max = 258;
+    while (n < max && a[n] == b[n]) ++n;
+    return n;
+}
+
+/* One final fixed-Huffman block; returns the end of the output */
+static uint8_t *deflate(uint8_t *out, const uint8_t *src, size_t n, size_t stride)
+{
+    bits_t b = { out, 0, 0 };
+
+    put_bits(&b, 1, 1);         /* BFINAL */
+    put_bits(&b, 1, 2);         /* fixed Huffman */
+    for (size_t i = 0; i < n; ) {
+        size_t len = 0, dist = 0, l;
+        if (i >= stride && (l = match(src + i, src + i - stride, n - i)) > len)
+            len = l, dist = stride;
+        if (len < 258 && i >= 1 && (l = match(src + i, src + i - 1, n - i)) > len)
+            len = l, dist = 1;
+
+        if (len >= 3) {
+            put_match(&b, len, dist);
+            i += len;
+        } else {
+            put_sym(&b, src[i++]);
+        }
+    }
+    put_sym(&b, 256);
+    if (b.n) put_bits(&b, 0, 8 - b.n);
+    return b.p;
+}
+
+static uint8_t *chunk(uint8_t *p, const char *type, const uint8_t *data, size_t len)
+{
+    p = put_be32(p, len);
+    memcpy(p, type, 4);
+    if (data != p + 4) memmove(p + 4, data, len);
+    uint32_t crc = crc32(0, p, 4 + len);
+    return put_be32(p + 4 + len, crc);
+}
+
+static size_t encode_png(capture_t *cap)
+{
+    static const uint8_t sig[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    uint8_t *p = cap->buf, hdr[13], plte[12];
+
+    memcpy(p, sig, 8);
+    p += 8;
+
+    put_be32(hdr, cap->w);
+    put_be32(hdr + 4, cap->h);
+    hdr[8]  = 8;                /* bit depth */
+    hdr[9]  = 3;                /* indexed colour */
+    hdr[10] = hdr[11] = hdr[12] = 0;
+    p = chunk(p, "IHDR", hdr, sizeof hdr);
+
+    for (int i = 0; i < 4; ++i) {
+        plte[3 * i]     = cap->colors[i] >> 16;
+        plte[3 * i + 1] = cap->colors[i] >> 8;
+        plte[3 * i + 2] = cap->colors[i];
+    }
+    p = chunk(p, "PLTE", plte, sizeof plte);
+
+    /* the zlib stream is written in place, where the chunk data goes */
+    size_t   raw  = (size_t)(cap->w + 1) * cap->h;
+    uint8_t *data = p + 8, *z = data;
+    *z++ = 0x78;
+    *z++ = 0x01;
+    z = deflate(z, cap->raw, raw, cap->w + 1);
+    z = put_be32(z, adler32(cap->raw, raw));
+    p = chunk(p, "IDAT", data, z - data);
+
+    p = chunk(p, "IEND", p + 8, 0);
+    return p - cap->buf;
+}
+
+/* Planar 4:2:0, chroma averaged over 2x2 (only hires at scale 1 mixes) */
+static size_t encode_y4m(capture_t *cap)
+{
+    static const char tag[] = "FRAME\n";
+    size_t   stride = cap->w + 1;
+    uint8_t *p = cap->buf;
+
+    memcpy(p, tag, sizeof tag - 1);
+    p += sizeof tag - 1;
+    for (int y = 0; y < cap->h; ++y) {
+        const uint8_t *row = cap->raw + y * stride + 1;
+        for (int x = 0; x < cap->w; ++x) *p++ = cap->y[row[x]];
+    }
+    for (int k = 0; k < 2; ++k) {
+        const uint8_t *lut = k ? cap->v : cap->u;
+        for (int y = 0; y < cap->h; y += 2) {
+            const uint8_t *r0 = cap->raw + y * stride + 1, *r1 = r0 + stride;
+            for (int x = 0; x < cap->w; x += 2)
+                *p++ = (lut[r0[x]] + lut[r0[x + 1]] + lut[r1[x]] + lut[r1[x + 1]] + 2) >> 2;
+        }
+    }
+    return p - cap->buf;
+}
+
+/* Scanlines of palette indices, each FB row repeated to the scale */
+static void expand(capture_t *cap, const cslot_t *s)
+{
+    int    w      = s->hires ? FB_W : FB_W / 2;
+    int    h      = s->hires ? FB_H : FB_H / 2;
+    int    k      = cap->scale * (s->hires ? 1 : 2);   /* pixels per FB pixel */
+    size_t stride = cap->w + 1;
+
+    for (int y = 0; y < h; ++y) {
+        uint8_t *row = cap->raw + (size_t)y * k * stride, *p = row + 1;
+        row[0] = 0;             /* filter: none */
+        for (int x = 0; x < w; ++x, p += k) {
+            int      word = x >> 6;
+            unsigned bit  = 63 - (x & 63);
+            memset(p, ((s->FB[0][y][word] >> bit) & 1) | ((s->FB[1][y][word] >> bit) & 1) << 1, k);
+        }
+        for (int r = 1; r < k; ++r) memcpy(row + r * stride, row, stride);
+    }
+}
+
+static void write_frame(capture_t *cap, const cslot_t *s)
+{
+    if (cap->error) return;
+    expand(cap, s);
+
+    FILE  *f = cap->out;
+    char   path[4096];
+    size_t n = f ? encode_y4m(cap) : encode_png(cap);
+
+    if (!f) {
+        snprintf(path, sizeof path, "%s/%06llu.png", cap->dir, (unsigned long long)s->frame);
+        if (!(f = fopen(path, "wb"))) { perror(path); cap->error = true; return; }
+    }
+    if (fwrite(cap->buf, 1, n, f) != n) {
+        perror(f == cap->out ? "capture" : path);
+        cap->error = true;
+    }
+    if (f != cap->out && fclose(f) != 0 && !cap->error) {
+        perror(path);
+        cap->error = true;
+    }
+    cap->written++;
+    cap->bytes += n;
+}
+
+static void *capture_writer(void *arg)
+{
+    capture_t *cap = arg;
+    for (;;) {
+        uint64_t h = __atomic_load_n(&cap->head, __ATOMIC_ACQUIRE);
+        if (cap->tail == h) {
+            /* frames queued just before done was set are still ours */
+            if (__atomic_load_n(&cap->done, __ATOMIC_ACQUIRE)) {
+                if (__atomic_load_n(&cap->head, __ATOMIC_ACQUIRE) == cap->tail) break;
+                continue;
+            }
+            nanosleep(&(struct timespec){0, 1000000}, NULL);
+            continue;
+        }
+        while (cap->tail != h) {
+            write_frame(cap, &cap->ring[cap->tail % CAPTURE_SLOTS]);
+            __atomic_store_n(&cap->tail, cap->tail + 1, __ATOMIC_RELEASE);
+        }
+        if (cap->out) fflush(cap->out);
+    }
+    return NULL;
+}
+
+
+capture_t* capture_init(const char *path, int scale, const uint32_t colors[4],
+                        unsigned flags)
+{
+    if (scale < 1 || scale > 16) {
+        fprintf(stderr, "capture: scale must be 1..16\n");
+        return NULL;
+    }
+    capture_t *cap = calloc(1, sizeof *cap);
+    if (!cap) { perror("capture"); return NULL; }
+
+    size_t len = strlen(path);
+    bool   y4m = !strcmp(path, "-") || (len >= 4 && !strcmp(path + len - 4, ".y4m"));
+
+    tables();
+    cap->scale = scale;
+    cap->w     = FB_W * scale;
+    cap->h     = FB_H * scale;
+    cap->flags = flags;
+    memcpy(cap->colors, colors, sizeof cap->colors);
+    for (int i = 0; i < 4; ++i) {
+        /* BT.601, studio range */
+        int r = colors[i] >> 16 & 0xFF, g = colors[i] >> 8 & 0xFF, b = colors[i] & 0xFF;
+        cap->y[i] = (( 66 * r + 129 * g +  25 * b + 128) >> 8) + 16;
+        cap->u[i] = ((-38 * r -  74 * g + 112 * b + 128) >> 8) + 128;
+        cap->v[i] = ((112 * r -  94 * g -  18 * b + 128) >> 8) + 128;
+    }
+
+    /* worst case 10 bits a byte: a 3-byte match costs up to 30 */
+    size_t raw = (size_t)(cap->w + 1) * cap->h;
+    cap->buf_size = y4m ? (size_t)cap->w * cap->h * 3 / 2 + 16 : raw * 10 / 8 + 256;
+    cap->raw = malloc(raw);
+    cap->buf = malloc(cap->buf_size);
+    if (!cap->raw || !cap->buf) {
+        perror("capture");
+        capture_destroy(cap);
+        return NULL;
+    }
+
+    if (y4m && (flags & CAPTURE_DEDUP)) {
+        fprintf(stderr, "%s: Y4M has no timestamps, so frames cannot be skipped\n", path);
+        capture_destroy(cap);
+        return NULL;
+    }
+    if (y4m) {
+        cap->out = strcmp(path, "-") ? fopen(path, "wb") : stdout;
+        if (!cap->out) {
+            perror(path);
+            capture_destroy(cap);
+            return NULL;
+        }
+        fprintf(cap->out, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C420jpeg\n", cap->w, cap->h);
+    } else {
+        struct stat st;
+        if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+            fprintf(stderr, "%s: not a directory (PNG frames) nor *.y4m\n", path);
+            capture_destroy(cap);
+            return NULL;
+        }
+        snprintf(cap->dir, sizeof cap->dir, "%s", path);
+    }
+
+    int err = pthread_create(&cap->writer, NULL, capture_writer, cap);
+    if (err) {
+        fprintf(stderr, "capture: %s\n", strerror(err));
+        cap->done = true;       /* no writer to join */
+        capture_destroy(cap);
+        return NULL;
+    }
+    return cap;
+}
+
+void capture_destroy(capture_t *cap)
+{
+    if (!cap) return;
+    if (!cap->done) {
+        __atomic_store_n(&cap->done, true, __ATOMIC_RELEASE);
+        pthread_join(cap->writer, NULL);
+    }
+    if (cap->out && cap->out != stdout) fclose(cap->out);
+    else if (cap->out) fflush(cap->out);
+    free(cap->raw);
+    free(cap->buf);
+    free(cap);
+}
+
+bool capture_frame(capture_t *cap, const chip8_t *c)
+{
+    uint64_t frame = cap->frames++;
+
+    /* the last queued slot is only ever read by the writer */
+    if ((cap->flags & CAPTURE_DEDUP) && cap->head) {
+        const cslot_t *last = &cap->ring[(cap->head - 1) % CAPTURE_SLOTS];
+        if (last->hires == c->hires && !memcmp(last->FB, c->FB, sizeof c->FB)) {
+            cap->dups++;
+            return true;
+        }
+    }
+
+    while (cap->head - __atomic_load_n(&cap->tail, __ATOMIC_ACQUIRE) == CAPTURE_SLOTS) {
+        if (!(cap->flags & CAPTURE_WAIT)) {
+            cap->dropped++;
+            return false;
+        }
+        nanosleep(&(struct timespec){0, 100000}, NULL);
+    }
+
+    cslot_t *s = &cap->ring[cap->head % CAPTURE_SLOTS];
+    s->frame = frame;
+    s->hires = c->hires;
+    memcpy(s->FB, c->FB, sizeof s->FB);
+    __atomic_store_n(&cap->head, cap->head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/* Waits for the writer to catch up, so the counts are final */
+bool capture_print(FILE *f, const capture_t *cap)
+{
+    while (__atomic_load_n(&cap->tail, __ATOMIC_ACQUIRE) != cap->head)
+        nanosleep(&(struct timespec){0, 1000000}, NULL);
+
+    fprintf(f, "capture: frames %llu, written %llu, duplicates %llu, dropped %llu, "
+               "%.1f MB%s\n",
+            (unsigned long long)cap->frames, (unsigned long long)cap->written,
+            (unsigned long long)cap->dups, (unsigned long long)cap->dropped,
+            cap->bytes / 1e6, cap->error ? ", write errors" : "");
+    return !cap->error;
+}
@@ -0,0 +1,44 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "chip8.h"
+
+/*
+ * Frame capture: every emulated frame, palette-mapped and scaled, goes
+ * to a Y4M stream or to numbered PNG files.  The emulator only copies
+ * the framebuffer into a slot of a preallocated ring; a writer thread
+ * converts, encodes and writes it.  Nothing is allocated per frame.
+ *
+ *   out.y4m, -        one Y4M stream (4:2:0, 60 fps), - is stdout
+ *   anything else     a directory, one <frame>.png per frame
+ *
+ * The picture is FB_W*scale x FB_H*scale; a lores pixel is 2*scale.
+ */
+#define CAPTURE_SLOTS  16
+
+/* capture_init flags */
+#define CAPTURE_DEDUP  0x1  /* skip frames equal to the one before;
+                               PNG only, a Y4M stream would lose time */
+#define CAPTURE_WAIT   0x2  /* wait for a free slot instead of dropping */
+
+typedef struct capture capture_t;
+
+capture_t* capture_init(const char *path, int scale, const uint32_t colors[4],
+                        unsigned flags);
+/* Writes what is queued, then stops the writer */
+void capture_destroy(capture_t *cap);
+
+/*
+ * Queues the current frame.  Without CAPTURE_WAIT a full ring drops it
+ * and returns false, so a real-time caller is never held up.
+ */
+bool capture_frame(capture_t *cap, const chip8_t *c);
+
+/* Frames seen, written, collapsed and dropped; false after a write error */
+bool capture_print(FILE *f, const capture_t *cap);
+
+#endif /* CAPTURE_H */
@@ -0,0 +1,249 @@
+/* capturer.c — headless frame capture to Y4M or PNG, no SDL */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "capture.h"
+#include "chip8.h"
+#include "engine.h"
+#include "movie.h"
+#include "pack.h"
+#include "palette.h"
+
+/*
+ * Runs one ROM as fast as it goes and hands every 60 Hz frame to the
+ * capture writer, waiting for a slot rather than dropping: the writer
+ * is the slow side here.  Input comes from a movie, so a recorded
+ * session turns into a video of it.
+ */
+typedef struct {
+    const char   *rom_path;
+    const char   *out;
+    int           frames;       /* 0 – 600, or the whole movie */
+    int           hz;           /* 0 – the movie's or the pack's, else 500 */
+    int           profile;      /* -1 – the pack's */
+    int           palette;      /* -1 – the pack's */
+    int           scale;
+    uint32_t      seed;
+    movie_t      *movie;
+    engine_kind_t engine;
+    unsigned      flags;
+    bool          dedup;
+} capturer_t;
+
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options] -o <out> <rom.ch8 | pack.c8p:name | pack.c8p#hash>\n"
+            "  -o <out>      file.y4m, - (Y4M to stdout) or a directory for\n"
+            "                numbered PNG files\n"
+            "  -frames <n>   frames to capture (default 600, with -replay\n"
+            "                the whole movie)\n"
+            "  -replay <m>   input movie recorded by chip8 -record, with its\n"
+            "                frequency, quirks and seed\n"
+            "  -hz <n>       CPU frequency (default: the movie's or pack's, else 500)\n"
+            "  -quirks <p>   default | vip | chip48 | schip | xochip\n"
+            "  -seed <n>     PRNG seed (default 1)\n"
+            "  -s <n>        pixels per hires pixel, 1..16 (default 4)\n"
+            "  -p <p>        palette: bw | amber (default: the pack's, else bw)\n"
+            "  -dedup        skip frames equal to the previous one (PNG only:\n"
+            "                PNG files keep the frame number, Y4M would lose time)\n"
+            "  -engine <e>   switch | cache | jit (default switch)\n"
+            "  -noidle       execute idle loops instead of skipping them\n"
+            , prog);
+}
+
+static capturer_t parse_args(int argc, char *argv[])
+{
+    capturer_t k = {0};
+    k.profile = -1;
+    k.palette = -1;
+    k.scale   = 4;
+    k.seed    = 1;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            k.out = argv[++i];
+        }
+        else if (strcmp(argv[i], "-frames") == 0 && i + 1 < argc) {
+            k.frames = atoi(argv[++i]);
+            if (k.frames < 1) k.frames = 1;
+        }
+        else if (strcmp(argv[i], "-replay") == 0 && i + 1 < argc) {
+            if (!(k.movie = movie_load(argv[++i]))) exit(EXIT_FAILURE);
+        }
+        else if (strcmp(argv[i], "-hz") == 0 && i + 1 < argc) {
+            k.hz = atoi(argv[++i]);
+            if (k.hz < 60) {
+                fprintf(stderr, "Hz must be >=60\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (strcmp(argv[i], "-quirks") == 0 && i + 1 < argc) {
+            chip8_profile_t p;
+            if (!chip8_profile_parse(argv[++i], &p)) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            k.profile = p;
+        }
+        else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc) {
+            k.seed = strtoul(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            k.scale = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            const char *p = argv[++i];
+            if      (!strcmp(p, "amber")) k.palette = 1;
+            else if (!strcmp(p, "bw"))    k.palette = 0;
+        }
+        else if (strcmp(argv[i], "-dedup") == 0) {
+            k.dedup = true;
+        }
+        else if (strcmp(argv[i], "-engine") == 0 && i + 1 < argc) {
+            if (!engine_parse(argv[++i], &k.engine)) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (strcmp(argv[i], "-noidle") == 0) {
+            k.flags |= ENGINE_NOIDLE;
+        }
+        else if (argv[i][0] != '-' && !k.rom_path) {
+            k.rom_path = argv[i];
+        }
+        else {
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (!k.rom_path || !k.out) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    return k;
+}
+
+/* Returns the ROM size, 0 on failure; the pack fills what is not set */
+static size_t load_rom(chip8_t *c, capturer_t *k)
+{
+    char        path[4096];
+    const char *sel;
+    size_t      size = 0;
+
+    if (pack_spec(k->rom_path, path, sizeof path, &sel)) {
+        pack_t    *p = pack_open(path);
+        pack_rom_t r;
+        chip8_profile_t prof = PROFILE_DEFAULT;
+        if (!p) return 0;
+        if (!pack_select(p, sel, &r)) {
+            fprintf(stderr, "%s: no such ROM in the pack\n", k->rom_path);
+        } else if (k->profile < 0 && !chip8_profile_find(r.quirks, &prof)) {
+            fprintf(stderr, "%s: no profile has quirks 0x%x\n", k->rom_path, (unsigned)r.quirks);
+        } else {
+            memcpy(c->memory.memory + 0x200, r.data, r.size);
+            size = r.size;
+            if (k->profile < 0) k->profile = prof;
+            if (!k->hz) k->hz = r.hz;
+            if (k->palette < 0 && r.palette < 2) k->palette = r.palette;
+        }
+        pack_close(p);
+    } else {
+        FILE *f = fopen(k->rom_path, "rb");
+        if (!f) { perror(k->rom_path); return 0; }
+        size = fread(c->memory.memory + 0x200, 1, MEM_SIZE - 0x200, f);
+        fclose(f);
+        if (!size) fprintf(stderr, "%s: empty ROM\n", k->rom_path);
+    }
+
+    if (k->profile < 0) k->profile = PROFILE_DEFAULT;
+    if (k->palette < 0) k->palette = 0;
+    return size;
+}
+
+
+int main(int argc, char *argv[])
+{
+    capturer_t k = parse_args(argc, argv);
+    chip8_t   *c = chip8_init();
+    size_t     size = c ? load_rom(c, &k) : 0;
+
+    if (!size) {
+        chip8_destroy(c);
+        movie_destroy(k.movie);
+        return EXIT_FAILURE;
+    }
+    if (k.movie) {
+        if (pack_hash(c->memory.memory + 0x200, size) != k.movie->rom_hash)
+            fprintf(stderr, "%s: not the ROM the movie was recorded on\n", k.rom_path);
+        chip8_profile_t prof;
+        if (!chip8_profile_find(k.movie->quirks, &prof)) {
+            fprintf(stderr, "%s: no profile has quirks 0x%x\n", k.rom_path, k.movie->quirks);
+            chip8_destroy(c);
+            movie_destroy(k.movie);
+            return EXIT_FAILURE;
+        }
+        k.profile = prof;
+        k.hz      = k.movie->hz;
+        k.seed    = k.movie->seed;
+    }
+    if (!k.hz) k.hz = 500;
+    chip8_set_profile(c, k.profile);
+    chip8_seed(c, k.seed);
+
+    engine_t  *e   = engine_init(k.engine, k.flags);
+    capture_t *cap = capture_init(k.out, k.scale, palettes[k.palette & 1],
+                                  CAPTURE_WAIT | (k.dedup ? CAPTURE_DEDUP : 0));
+    if (!e || !cap) {
+        capture_destroy(cap);
+        engine_destroy(e);
+        chip8_destroy(c);
+        movie_destroy(k.movie);
+        return EXIT_FAILURE;
+    }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    /* as movie_play, with a capture after every whole frame */
+    uint64_t done = 0;
+    int      carry = 0, frames = 0;
+    size_t   ev = 0;
+    for (;;) {
+        if (k.frames ? frames == k.frames : !k.movie ? frames == 600 : done >= k.movie->end)
+            break;
+        uint64_t n = chip8_frame_cycles(k.hz, &carry), stop = done + n;
+        while (done < stop) {
+            uint64_t run = stop - done;
+            if (k.movie) {
+                const movie_t *m = k.movie;
+                for (; ev < m->count && m->ev[ev].cycle <= done; ++ev)
+                    c->keypad[m->ev[ev].key] = m->ev[ev].down;
+                if (ev < m->count && m->ev[ev].cycle < stop) run = m->ev[ev].cycle - done;
+            }
+            engine_run(e, c, run);
+            done += run;
+        }
+        chip8_update(c);
+        capture_frame(cap, c);
+        ++frames;
+    }
+
+    bool ok = capture_print(stderr, cap);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    fprintf(stderr, "%d frames in %.3fs, %.0f fps, x%.1f real time\n", frames, secs,
+            secs > 0 ? frames / secs : 0.0, secs > 0 ? frames / secs / 60 : 0.0);
+
+    capture_destroy(cap);
+    engine_destroy(e);
+    chip8_destroy(c);
+    movie_destroy(k.movie);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -4,17 +4,31 @@
 #include <time.h>
 #include <stdio.h>
 
-#include "dbg.h"
 #include "chip8.h"
 
+#ifdef __GNUC__
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#define POPCOUNT(v)   __builtin_popcountll(v)
+#else
+#define ALWAYS_INLINE inline
+static int POPCOUNT(uint64_t v) { int n = 0; for (; v; v &= v - 1) ++n; return n; }
+#endif
+
+#define HOOK(name, ...) \
+    do { if (hooked && c->hooks->name) c->hooks->name(c->hooks->ud, __VA_ARGS__); } while (0)
+
 /* Init/Destroy */
 chip8_t* chip8_init(void) 
 {
-    srand(time(NULL));
-
     chip8_t *chip8 = (chip8_t*)malloc(sizeof(chip8_t));
     memset(chip8, 0, sizeof *chip8);
     memcpy(chip8->memory.memory, font, sizeof font);
+    memcpy(chip8->memory.memory + FONT_BIG, font_big, sizeof font_big);
+    chip8->planes = 1;
+    chip8->pitch  = 64;         /* XO-CHIP default, 4000 Hz */
+
+    /* unseeded instances still differ from run to run and from each other */
+    chip8_seed(chip8, (uint32_t)time(NULL) ^ (uint32_t)(uintptr_t)chip8);
 
     chip8->PC=0x200;
     chip8->I=0;
@@ -29,19 +43,149 @@ void chip8_destroy(chip8_t *c) {
     free(c);
 }
 
+void chip8_seed(chip8_t *c, uint32_t seed) {
+    c->rng = seed ? seed : 0x9E3779B9;
+}
 
-static uint16_t chip8_fetch(chip8_t *c) {
-    uint16_t hi = c->memory.memory[c->PC];
-    uint16_t lo = c->memory.memory[c->PC + 1];
+
+#define MEM(a)  c->memory.memory[(a) & (MEM_SIZE - 1)]
+
+static uint16_t chip8_fetch(const chip8_t *c) {
+    uint16_t hi = MEM(c->PC);
+    uint16_t lo = MEM(c->PC + 1);
     return (hi << 8) | lo;
 }
 
-/* Cycle */
-void chip8_cycle(chip8_t *c) {
+/*
+ * Sprite rows are rotated into place, so x wraps for free: within one
+ * word in lores, across the two words of a row in hires.  Dxy0 draws
+ * 16x16.  Every selected plane takes its own rows from I onwards.
+ * QUIRK_CLIP wraps only the position; what crosses an edge is dropped.
+ */
+static ALWAYS_INLINE void draw_mode(chip8_t *c, uint8_t vx, uint8_t vy, uint8_t height,
+                                    const bool hi, const bool hooked, const unsigned q) {
+    unsigned shift = vx & (hi ? FB_W - 1 : FB_W / 2 - 1);
+    int      h     = hi ? FB_H : FB_H / 2;
+    bool     clip  = q & QUIRK_CLIP;
+    bool     wide  = height == 0;
+    int      rows  = wide ? 16 : height;
+    uint16_t addr  = c->I;
+    uint8_t  vf = 0;
+    int      drawn = 0, erased = 0;
+
+    /* hires: the row lands in word w from bit k on, the rest in the
+       other word (w ^ 1 wraps the right edge round to x = 0) */
+    unsigned w = hi ? shift >> 6 : 0, k = shift & 63;
+
+    for (int p = 0; p < 2; ++p) {
+        if (!(c->planes & (1 << p))) continue;
+
+        for (int row = 0; row < rows; row++) {
+            uint64_t s = (uint64_t)MEM(addr++) << 56, s1 = 0;
+            if (wide) s |= (uint64_t)MEM(addr++) << 48;
+            int y = clip ? (vy & (h - 1)) + row : (vy + row) & (h - 1);
+            if (!s || y >= h) continue;
+
+            if (!hi) {
+                if (clip)   s >>= k;
+                else if (k) s = (s >> k) | (s << (64 - k));
+            } else {
+                s1 = (s << (63 - k)) << 1;      /* no branch for k == 0 */
+                s >>= k;
+                if (clip && w) s1 = 0;          /* past the right edge */
+            }
+
+            uint64_t *fb = c->FB[p][y];
+            if (hooked) {
+                drawn  += POPCOUNT(s) + POPCOUNT(s1);
+                erased += POPCOUNT(fb[w] & s) + (hi ? POPCOUNT(fb[w ^ 1] & s1) : 0);
+            }
+            vf |= (fb[w] & s) != 0;
+            fb[w] ^= s;
+            if (hi) {
+                vf |= (fb[w ^ 1] & s1) != 0;
+                fb[w ^ 1] ^= s1;
+            }
+            c->dirty |= 1ULL << y;
+        }
+    }
+    c->regs[0xF] = vf;
+    HOOK(draw, c, drawn, erased);
+}
+
+/* One copy per mode, so lores rows never test for the second word */
+static ALWAYS_INLINE void draw(chip8_t *c, uint8_t vx, uint8_t vy, uint8_t height,
+                               const bool hooked, const unsigned q) {
+    if (c->hires) draw_mode(c, vx, vy, height, true, hooked, q);
+    else          draw_mode(c, vx, vy, height, false, hooked, q);
+}
+
+/* 00E0 and scrolls only touch the selected planes */
+static void clear(chip8_t *c) {
+    for (int p = 0; p < 2; ++p)
+        if (c->planes & (1 << p)) memset(c->FB[p], 0, sizeof c->FB[p]);
+    c->dirty = ~0ULL;
+}
+
+/* 00Cn/00Dn: whole rows move, n > 0 is down */
+static void scroll_v(chip8_t *c, int n) {
+    int    h   = chip8_height(c);
+    size_t row = sizeof c->FB[0][0];
+
+    for (int p = 0; p < 2; ++p) {
+        if (!(c->planes & (1 << p)) || n == 0) continue;
+        uint64_t (*fb)[FB_WORDS] = c->FB[p];
+        if (n > 0) {
+            memmove(fb[n], fb[0], (h - n) * row);
+            memset(fb[0], 0, n * row);
+        } else {
+            memmove(fb[0], fb[-n], (h + n) * row);
+            memset(fb[h + n], 0, -n * row);
+        }
+    }
+    c->dirty = ~0ULL;
+}
+
+/* 00FB/00FC: word shifts, carrying between the two words of a hires row */
+static void scroll_h(chip8_t *c, int n) {
+    int h = chip8_height(c);
+
+    for (int p = 0; p < 2; ++p) {
+        if (!(c->planes & (1 << p))) continue;
+        for (int y = 0; y < h; ++y) {
+            uint64_t *r = c->FB[p][y];
+            if (!c->hires)  r[0] = n > 0 ? r[0] >> n : r[0] << -n;
+            else if (n > 0) { r[1] = (r[1] >> n) | (r[0] << (64 - n)); r[0] >>= n; }
+            else            { r[0] = (r[0] << -n) | (r[1] >> (64 + n)); r[1] <<= -n; }
+        }
+    }
+    c->dirty = ~0ULL;
+}
+
+/* 00FE/00FF: switching modes starts from a blank screen */
+static void set_mode(chip8_t *c, bool hires) {
+    c->hires = hires;
+    memset(c->FB, 0, sizeof c->FB);
+    c->dirty = ~0ULL;
+}
+
+void chip8_draw(chip8_t *c, uint8_t vx, uint8_t vy, uint8_t height) {
+    draw(c, vx, vy, height, false, 0);
+}
+
+/* A taken skip steps over the whole next instruction */
+#define SKIP(cond) do {                                 \
+        bool taken_ = (cond);                           \
+        if (taken_) c->PC += chip8_oplen(c, c->PC);     \
+        HOOK(skip, c, op, taken_);                      \
+    } while (0)
+
+/* Cycle; q is a constant QUIRK_* mask in every copy */
+static ALWAYS_INLINE void cycle(chip8_t *c, const bool hooked, const unsigned q) {
     uint16_t op = chip8_fetch(c);
     c->PC += 2;
 
-    debug_log(c, op);
+    HOOK(exec, c, op);
 
     uint8_t  x = (op >> 8) & 0x0F;
     uint8_t  y = (op >> 4) & 0x0F;
@@ -51,14 +195,24 @@ void chip8_cycle(chip8_t *c) {
 
     switch (op & 0xF000) {
         case 0x0000:
-            if (byte == 0xE0) {
+            if (op == 0x00E0) {
                 // 00E0: CLS
-                memset(c->FB, 0, sizeof(c->FB));
-            } else if (byte == 0xEE) {
+                clear(c);
+            } else if (op == 0x00EE) {
                 // 00EE: RET
                 if (c->SP > 0) {
                     c->PC = c->memory.stack[--c->SP];
                 }
+            } else if (x == 0 && y == 0xC) {
+                scroll_v(c, nibble);                    // 00Cn: SCD n
+            } else if (x == 0 && y == 0xD) {
+                scroll_v(c, -nibble);                   // 00Dn: SCU n
+            } else switch (op) {
+                case 0x00FB: scroll_h(c, 4);   break;   // 00FB: SCR
+                case 0x00FC: scroll_h(c, -4);  break;   // 00FC: SCL
+                case 0x00FD: c->PC -= 2;       break;   // 00FD: EXIT, stays put
+                case 0x00FE: set_mode(c, false); break; // 00FE: LOW
+                case 0x00FF: set_mode(c, true);  break; // 00FF: HIGH
             }
             break;
 
@@ -77,17 +231,27 @@ void chip8_cycle(chip8_t *c) {
 
         case 0x3000:
             // 3xkk: SE Vx, byte
-            if (c->regs[x] == byte) c->PC += 2;
+            SKIP(c->regs[x] == byte);
             break;
 
         case 0x4000:
             // 4xkk: SNE Vx, byte
-            if (c->regs[x] != byte) c->PC += 2;
+            SKIP(c->regs[x] != byte);
             break;
 
         case 0x5000:
-            // 5xy0: SE Vx, Vy
-            if (c->regs[x] == c->regs[y]) c->PC += 2;
+            if (nibble == 0) {
+                // 5xy0: SE Vx, Vy
+                SKIP(c->regs[x] == c->regs[y]);
+            } else if (nibble == 2 || nibble == 3) {
+                // 5xy2/5xy3: LD [I], Vx-Vy / LD Vx-Vy, [I], either direction
+                int d = x <= y ? 1 : -1;
+                for (int i = 0, r = x; ; ++i, r += d) {
+                    if (nibble == 2) MEM(c->I + i) = c->regs[r];
+                    else             c->regs[r] = MEM(c->I + i);
+                    if (r == y) break;
+                }
+            }
             break;
 
         case 0x6000:
@@ -103,9 +267,18 @@ void chip8_cycle(chip8_t *c) {
         case 0x8000:
             switch (nibble) {
                 case 0x0: c->regs[x] = c->regs[y]; break;  // 8xy0: LD  Vx, Vy
-                case 0x1: c->regs[x] |= c->regs[y]; break; // 8xy1: OR  Vx, Vy
-                case 0x2: c->regs[x] &= c->regs[y]; break; // 8xy2: AND Vx, Vy
-                case 0x3: c->regs[x] ^= c->regs[y]; break; // 8xy3: XOR Vx, Vy
+                case 0x1:                                  // 8xy1: OR  Vx, Vy
+                    c->regs[x] |= c->regs[y];
+                    if (q & QUIRK_VF_RESET) c->regs[0xF] = 0;
+                    break;
+                case 0x2:                                  // 8xy2: AND Vx, Vy
+                    c->regs[x] &= c->regs[y];
+                    if (q & QUIRK_VF_RESET) c->regs[0xF] = 0;
+                    break;
+                case 0x3:                                  // 8xy3: XOR Vx, Vy
+                    c->regs[x] ^= c->regs[y];
+                    if (q & QUIRK_VF_RESET) c->regs[0xF] = 0;
+                    break;
                 case 0x4: {
                     // 8xy4: ADD Vx, Vy
                     uint16_t sum = c->regs[x] + c->regs[y];
@@ -120,6 +293,12 @@ void chip8_cycle(chip8_t *c) {
                     break;
                 case 0x6:
                     // 8xy6: SHR Vx, Vy
+                    if (q & QUIRK_SHIFT_VY) {
+                        uint8_t v = c->regs[y];
+                        c->regs[x]   = v >> 1;
+                        c->regs[0xF] = v & 1;
+                        break;
+                    }
                     c->regs[0xF] = c->regs[x] & 1;
                     c->regs[x] >>= 1;
                     break;
@@ -129,7 +308,13 @@ void chip8_cycle(chip8_t *c) {
                     c->regs[x] = c->regs[y] - c->regs[x];
                     break;
                 case 0xE:
-                    // 8xy0: SHL Vx, Vy
+                    // 8xyE: SHL Vx, Vy
+                    if (q & QUIRK_SHIFT_VY) {
+                        uint8_t v = c->regs[y];
+                        c->regs[x]   = v << 1;
+                        c->regs[0xF] = v >> 7;
+                        break;
+                    }
                     c->regs[0xF] = (c->regs[x] >> 7) & 1;
                     c->regs[x] <<= 1;
                     break;
@@ -138,7 +323,7 @@ void chip8_cycle(chip8_t *c) {
 
         case 0x9000:
             // 9xy0: SNE Vx, Vy
-            if (c->regs[x] != c->regs[y]) c->PC += 2;
+            SKIP(c->regs[x] != c->regs[y]);
             break;
 
         case 0xA000:
@@ -147,52 +332,48 @@ void chip8_cycle(chip8_t *c) {
             break;
 
         case 0xB000:
-            // Bnnn: JP V0, addr
-            c->PC = addr + c->regs[0];
+            // Bnnn: JP V0, addr / Bxnn: JP Vx, xnn
+            c->PC = addr + c->regs[q & QUIRK_JUMP_VX ? x : 0];
             break;
 
         case 0xC000:
             // Cxkk: RND Vx, byte
-            c->regs[x] = (rand() & 0xFF) & byte;
+            c->regs[x] = chip8_rand(c) & byte;
             break;
 
-        case 0xD000: {
+        case 0xD000:
             // Dxyn: DRW Vx, Vy, nibble
-            uint8_t height = nibble;
-            uint8_t vx = c->regs[x];
-            uint8_t vy = c->regs[y];
-            c->regs[0xF] = 0;
-
-            for (int row = 0; row < height; row++) {
-                uint8_t sprite = c->memory.memory[c->I + row];
-                for (int col = 0; col < 8; col++) {
-                    if (sprite & (0x80 >> col)) {
-                        int px = (vx + col) % 64;
-                        int py = (vy + row) % 32;
-                        int index = py * 64 + px;
-                        if (c->FB[index]) {
-                            c->regs[0xF] = 1;
-                        }
-                        c->FB[index] ^= 1;
-                    }
-                }
-            }
+            draw(c, c->regs[x], c->regs[y], nibble, hooked, q);
             break;
-        }
 
         case 0xE000:
             switch (byte) {
                 case 0x9E:
-                    if (c->keypad[c->regs[x]]) c->PC += 2;
+                    SKIP(c->keypad[c->regs[x] & 0xF]);
                     break;
                 case 0xA1:
-                    if (!c->keypad[c->regs[x]]) c->PC += 2;
+                    SKIP(!c->keypad[c->regs[x] & 0xF]);
                     break;
             }
             break;
 
         case 0xF000:
             switch (byte) {
+                case 0x00:
+                    // F000 nnnn: LD I, long
+                    if (x == 0) {
+                        c->I = (MEM(c->PC) << 8) | MEM(c->PC + 1);
+                        c->PC += 2;
+                    }
+                    break;
+                case 0x01: c->planes = x & 3; break;     // Fn01: PLANE n
+                case 0x02:
+                    // F002: AUDIO, 16 pattern bytes from I
+                    if (x != 0) break;
+                    for (int i = 0; i < 16; ++i)
+                        c->pattern[i] = MEM(c->I + i);
+                    c->audio_dirty |= AUDIO_PATTERN;
+                    break;
                 case 0x07: c->regs[x] = c->DT; break;    // Fx07: LD  Vx, DT
                 case 0x0A: {
                     // Fx0A: LD Vx, K — wait for key press
@@ -213,29 +394,390 @@ void chip8_cycle(chip8_t *c) {
                 case 0x18: c->ST = c->regs[x]; break;    // Fx18: LD  ST, Vx
                 case 0x1E: c->I += c->regs[x]; break;    // Fx1E: ADD I, Vx
                 case 0x29: c->I = c->regs[x] * 5; break; // Fx29: LD  F, Vx
+                case 0x30: c->I = FONT_BIG + (c->regs[x] & 0xF) * 10; break; // Fx30: LD HF, Vx
                 case 0x33: {
                     uint8_t val = c->regs[x];
-                    c->memory.memory[c->I]     = val / 100;
-                    c->memory.memory[c->I + 1] = (val / 10) % 10;
-                    c->memory.memory[c->I + 2] = val % 10;
+                    MEM(c->I)     = val / 100;
+                    MEM(c->I + 1) = (val / 10) % 10;
+                    MEM(c->I + 2) = val % 10;
                     break;
                 }
+                case 0x3A:
+                    // Fx3A: PITCH Vx
+                    c->pitch = c->regs[x];
+                    c->audio_dirty |= AUDIO_PITCH;
+                    break;
                 case 0x55:
                     // Fx55: LD [I], Vx
-                    for (int i = 0; i <= x; ++i)
-                        c->memory.memory[c->I + i] = c->regs[i];
+                    if (c->I + x < MEM_SIZE)    /* no wrap: plain indexing */
+                        for (int i = 0; i <= x; ++i) c->memory.memory[c->I + i] = c->regs[i];
+                    else
+                        for (int i = 0; i <= x; ++i) MEM(c->I + i) = c->regs[i];
+                    if (q & QUIRK_MEM_I)  c->I += x + 1;
+                    if (q & QUIRK_MEM_IX) c->I += x;
                     break;
                 case 0x65:
                     // Fx65: LD Vx, [I]
-                    for (int i = 0; i <= x; ++i)
-                        c->regs[i] = c->memory.memory[c->I + i];
+                    if (c->I + x < MEM_SIZE)
+                        for (int i = 0; i <= x; ++i) c->regs[i] = c->memory.memory[c->I + i];
+                    else
+                        for (int i = 0; i <= x; ++i) c->regs[i] = MEM(c->I + i);
+                    if (q & QUIRK_MEM_I)  c->I += x + 1;
+                    if (q & QUIRK_MEM_IX) c->I += x;
                     break;
+                case 0x75: memcpy(c->rpl, c->regs, x + 1); break;  // Fx75: LD R, Vx
+                case 0x85: memcpy(c->regs, c->rpl, x + 1); break;  // Fx85: LD Vx, R
             }
             break;
     }
 }
 
+#define Q_DEFAULT  0
+#define Q_VIP      (QUIRK_VF_RESET | QUIRK_SHIFT_VY | QUIRK_MEM_I | QUIRK_CLIP)
+#define Q_CHIP48   (QUIRK_MEM_IX | QUIRK_CLIP | QUIRK_JUMP_VX)
+#define Q_SCHIP    (QUIRK_CLIP | QUIRK_JUMP_VX)
+#define Q_XOCHIP   (QUIRK_SHIFT_VY | QUIRK_MEM_I)
+
+/* Plain and hooked single steps and loops of one profile */
+#define PROFILE(name, q)                                                                      \
+    static void cycle_##name(chip8_t *c)            { cycle(c, false, q); }                  \
+    static void cycle_##name##_hooked(chip8_t *c)   { cycle(c, true, q); }                   \
+    static void run_##name(chip8_t *c, uint64_t n)  { while (n--) cycle(c, false, q); }      \
+    static void run_##name##_hooked(chip8_t *c, uint64_t n) { while (n--) cycle(c, true, q); }
+
+PROFILE(default, Q_DEFAULT)
+PROFILE(vip,     Q_VIP)
+PROFILE(chip48,  Q_CHIP48)
+PROFILE(schip,   Q_SCHIP)
+PROFILE(xochip,  Q_XOCHIP)
+
+static const struct {
+    const char *name;
+    unsigned    quirks;
+    void      (*cycle[2])(chip8_t *c);                  /* plain, hooked */
+    void      (*run[2])(chip8_t *c, uint64_t cycles);
+} profiles[PROFILE_COUNT] = {
+#define ENTRY(id, name, q)  [id] = { #name, q, { cycle_##name, cycle_##name##_hooked }, \
+                                               { run_##name, run_##name##_hooked } }
+    ENTRY(PROFILE_DEFAULT, default, Q_DEFAULT),
+    ENTRY(PROFILE_VIP,     vip,     Q_VIP),
+    ENTRY(PROFILE_CHIP48,  chip48,  Q_CHIP48),
+    ENTRY(PROFILE_SCHIP,   schip,   Q_SCHIP),
+    ENTRY(PROFILE_XOCHIP,  xochip,  Q_XOCHIP),
+#undef ENTRY
+};
+
+/* The default profile is called directly: the engines step through it */
+void chip8_cycle(chip8_t *c) {
+    if (c->profile)     profiles[c->profile].cycle[c->hooks != NULL](c);
+    else if (c->hooks)  cycle_default_hooked(c);
+    else                cycle_default(c);
+}
+
+/* Profile and hooks are picked once per call, the loop tests neither */
+void chip8_run(chip8_t *c, uint64_t cycles) {
+    profiles[c->profile].run[c->hooks != NULL](c, cycles);
+}
+
+void chip8_set_profile(chip8_t *c, chip8_profile_t p) {
+    c->profile = p < PROFILE_COUNT ? p : PROFILE_DEFAULT;
+}
+
+unsigned chip8_profile_quirks(chip8_profile_t p) {
+    return profiles[p].quirks;
+}
+
+const char* chip8_profile_name(chip8_profile_t p) {
+    return profiles[p].name;
+}
+
+bool chip8_profile_find(unsigned quirks, chip8_profile_t *p) {
+    for (int i = 0; i < PROFILE_COUNT; ++i)
+        if (profiles[i].quirks == quirks) { *p = i; return true; }
+    return false;
+}
+
+bool chip8_profile_parse(const char *name, chip8_profile_t *p) {
+    char *end;
+    unsigned long q = strtoul(name, &end, 0);
+
+    if (*name && !*end) return chip8_profile_find(q, p);
+    for (int i = 0; i < PROFILE_COUNT; ++i)
+        if (!strcmp(name, profiles[i].name)) { *p = i; return true; }
+    return false;
+}
+
+int chip8_access(const chip8_t *c, uint16_t op, uint16_t *addr, uint32_t *len) {
+    uint8_t x = (op >> 8) & 0x0F, y = (op >> 4) & 0x0F;
+
+    *addr = c->I;
+    switch (op & 0xF00F) {
+        case 0x5002: *len = (x > y ? x - y : y - x) + 1; return ACCESS_WRITE;
+        case 0x5003: *len = (x > y ? x - y : y - x) + 1; return ACCESS_READ;
+    }
+    if ((op & 0xF000) == 0xD000) {
+        /* rows from I for every selected plane, two bytes a row for Dxy0 */
+        int n = op & 0xF;
+        *len = (n ? n : 32) * (((c->planes & 1) != 0) + ((c->planes & 2) != 0));
+        return *len ? ACCESS_READ : ACCESS_NONE;
+    }
+    switch (op & 0xF0FF) {
+        case 0xF033: *len = 3;      return ACCESS_WRITE;
+        case 0xF055: *len = x + 1;  return ACCESS_WRITE;
+        case 0xF065: *len = x + 1;  return ACCESS_READ;
+        case 0xF002: if (x) break; *len = 16; return ACCESS_READ;
+    }
+    *len = 0;
+    return ACCESS_NONE;
+}
+
+#define MARKED(bits, a)  ((bits)[(uint16_t)(a) >> 3] & (1 << ((a) & 7)))
+
+static bool watched(const chip8_t *c, const chip8_break_t *b) {
+    uint16_t addr;
+    uint32_t len;
+
+    /* only 5xyN, Dxyn and Fxnn touch memory: skip the decode for the rest */
+    if (!(1 << (c->memory.memory[c->PC] >> 4) & (1 << 0x5 | 1 << 0xD | 1 << 0xF))) return false;
+    if (!chip8_access(c, chip8_fetch(c), &addr, &len)) return false;
+    for (uint32_t i = 0; i < len; ++i)
+        if (MARKED(b->mem, (uint16_t)(addr + i))) return true;
+    return false;
+}
+
+/* One test per instruction on top of chip8_run, two for memory ops while watching */
+uint64_t chip8_run_break(chip8_t *c, uint64_t cycles, const chip8_break_t *b) {
+    void (*step)(chip8_t *c) = profiles[c->profile].cycle[c->hooks != NULL];
+
+    for (uint64_t n = 0; n < cycles; ++n) {
+        if (MARKED(b->pc, c->PC) || (b->watch && watched(c, b))) return n;
+        if (c->profile || c->hooks) step(c);
+        else                        cycle(c, false, 0);
+    }
+    return cycles;
+}
+
+/* Same matching as cycle(), including the opcodes it ignores */
+int chip8_opclass(uint16_t op) {
+    uint8_t byte = op & 0xFF;
+
+    switch (op & 0xF000) {
+        case 0x0000:
+            if (op == 0x00E0) return OPC_CLS;
+            if (op == 0x00EE) return OPC_RET;
+            if ((op & 0xFFF0) == 0x00C0) return OPC_SCD;
+            if ((op & 0xFFF0) == 0x00D0) return OPC_SCU;
+            switch (op) {
+                case 0x00FB: return OPC_SCR;
+                case 0x00FC: return OPC_SCL;
+                case 0x00FD: return OPC_EXIT;
+                case 0x00FE: return OPC_LOW;
+                case 0x00FF: return OPC_HIGH;
+            }
+            return OPC_NOP;
+        case 0x1000: return OPC_JP;
+        case 0x2000: return OPC_CALL;
+        case 0x3000: return OPC_SE;
+        case 0x4000: return OPC_SNE;
+        case 0x5000:
+            switch (op & 0xF) {
+                case 0x0: return OPC_SER;
+                case 0x2: return OPC_SAVE;
+                case 0x3: return OPC_RESTORE;
+            }
+            return OPC_NOP;
+        case 0x6000: return OPC_LD;
+        case 0x7000: return OPC_ADD;
+        case 0x8000:
+            switch (op & 0xF) {
+                case 0x0: return OPC_MOV;
+                case 0x1: return OPC_OR;
+                case 0x2: return OPC_AND;
+                case 0x3: return OPC_XOR;
+                case 0x4: return OPC_ADDR;
+                case 0x5: return OPC_SUB;
+                case 0x6: return OPC_SHR;
+                case 0x7: return OPC_SUBN;
+                case 0xE: return OPC_SHL;
+            }
+            return OPC_NOP;
+        case 0x9000: return OPC_SNER;
+        case 0xA000: return OPC_LDI;
+        case 0xB000: return OPC_JPV0;
+        case 0xC000: return OPC_RND;
+        case 0xD000: return OPC_DRW;
+        case 0xE000:
+            if (byte == 0x9E) return OPC_SKP;
+            if (byte == 0xA1) return OPC_SKNP;
+            return OPC_NOP;
+        case 0xF000:
+            switch (byte) {
+                case 0x00: return op == 0xF000 ? OPC_LDIL : OPC_NOP;
+                case 0x01: return OPC_PLANE;
+                case 0x02: return op == 0xF002 ? OPC_AUDIO : OPC_NOP;
+                case 0x07: return OPC_GDT;
+                case 0x0A: return OPC_KEY;
+                case 0x15: return OPC_SDT;
+                case 0x18: return OPC_SST;
+                case 0x1E: return OPC_ADDI;
+                case 0x29: return OPC_FONT;
+                case 0x30: return OPC_BFONT;
+                case 0x33: return OPC_BCD;
+                case 0x3A: return OPC_PITCH;
+                case 0x55: return OPC_STORE;
+                case 0x65: return OPC_LOAD;
+                case 0x75: return OPC_SRPL;
+                case 0x85: return OPC_LRPL;
+            }
+            return OPC_NOP;
+    }
+    return OPC_NOP;
+}
+
+/*
+ * Idle loops: starting at PC, run instructions that touch nothing but
+ * PC, V and I, and see whether they come back to PC with V and I as they
+ * were.  Timers and keys only change between engine_run calls, so such
+ * a loop then repeats identically until the call ends.  The first pass
+ * may still differ (Fx07 picking up a freshly ticked DT), so a second
+ * pass is compared with the first; *lead is then the first pass, to be
+ * executed before skipping.  Covers Fx0A without a key, Fx07/SE/JP delay
+ * waits, key polling and JP-to-self.  Returns the loop length, 0 if PC
+ * is not in an idle loop.
+ */
+#define IDLE_MAX  8                 /* longest loop looked for */
+#define IDLE_OPS  0xC67A            /* top nibbles handled below: 1 3 4 5 6 9 A E F */
+
+int chip8_idle_loop(const chip8_t *c, int *lead) {
+    uint8_t  v[16], v1[16];
+    uint16_t pc = c->PC, I = c->I, I1 = 0;
+    int      first = 0;
+
+    /* called once per engine_run, so reject most code on one byte */
+    if (pc >= MEM_SIZE - 3 || !((IDLE_OPS >> (c->memory.memory[pc] >> 4)) & 1))
+        return 0;
+    memcpy(v, c->regs, sizeof v);
+
+    for (int n = 1; n <= 2 * IDLE_MAX; ++n) {
+        if (pc >= MEM_SIZE - 3) return 0;
+        uint16_t op = (c->memory.memory[pc] << 8) | c->memory.memory[pc + 1];
+        uint8_t  x = (op >> 8) & 0x0F;
+        uint8_t  y = (op >> 4) & 0x0F;
+        uint8_t  byte = op & 0xFF;
+        pc += 2;
+
+#define SKIP_IF(cond)  do { if (cond) pc += chip8_oplen(c, pc); } while (0)
+        switch (op & 0xF000) {
+            case 0x1000: pc = op & 0x0FFF;               break;
+            case 0x3000: SKIP_IF(v[x] == byte);          break;
+            case 0x4000: SKIP_IF(v[x] != byte);          break;
+            case 0x9000: SKIP_IF(v[x] != v[y]);          break;
+            case 0x5000:
+                if (op & 0xF) return 0;
+                SKIP_IF(v[x] == v[y]);
+                break;
+            case 0x6000: v[x] = byte;                    break;
+            case 0xA000: I = op & 0x0FFF;                break;
+            case 0xE000:
+                if      (byte == 0x9E) SKIP_IF(c->keypad[v[x] & 0xF]);
+                else if (byte == 0xA1) SKIP_IF(!c->keypad[v[x] & 0xF]);
+                else return 0;
+                break;
+            case 0xF000:
+                if (op == 0xF000) {
+                    I = (c->memory.memory[pc] << 8) | c->memory.memory[pc + 1];
+                    pc += 2;
+                    break;
+                }
+                if (byte == 0x07) { v[x] = c->DT; break; }
+                if (byte == 0x0A) {
+                    for (int i = 0; i < 16; ++i)
+                        if (c->keypad[i]) return 0;
+                    pc -= 2;
+                    break;
+                }
+                return 0;
+            default:
+                return 0;
+        }
+#undef SKIP_IF
+
+        if (pc != c->PC) continue;
+
+        if (!first) {
+            if (I == c->I && !memcmp(v, c->regs, sizeof v)) {
+                *lead = 0;
+                return n;
+            }
+            first = n;
+            I1 = I;
+            memcpy(v1, v, sizeof v);
+        } else {
+            if (I != I1 || memcmp(v, v1, sizeof v)) return 0;
+            *lead = first;
+            return n - first;
+        }
+    }
+    return 0;
+}
+
 void chip8_update(chip8_t *c) {
     if(c->DT > 0) --c->DT;
     if(c->ST > 0) --c->ST;
+    if (c->hooks && c->hooks->frame) c->hooks->frame(c->hooks->ud, c);
+}
+
+/* FNV-1a over the mode and both planes, used to compare runs */
+uint64_t chip8_fb_hash(const chip8_t *c) {
+    uint64_t h = 0xCBF29CE484222325ULL;
+    h = (h ^ c->hires) * 0x100000001B3ULL;
+    for (int p = 0; p < 2; ++p)
+        for (int y = 0; y < FB_H; ++y)
+            for (int w = 0; w < FB_WORDS; ++w)
+                for (int b = 56; b >= 0; b -= 8) {
+                    h ^= (c->FB[p][y][w] >> b) & 0xFF;
+                    h *= 0x100000001B3ULL;
+                }
+    return h;
+}
+
+static inline uint64_t mix(uint64_t h, uint64_t w) {
+    h = (h ^ w) * 0x9E3779B97F4A7C15ULL;
+    return h ^ (h >> 29);
+}
+
+static uint64_t mix_bytes(uint64_t h, const void *p, size_t len) {
+    for (size_t i = 0; i < len; i += 8) {
+        uint64_t w;
+        memcpy(&w, (const uint8_t *)p + i, 8);
+        h = mix(h, w);
+    }
+    return h;
+}
+
+/*
+ * Everything a program can observe, plus the PRNG: it is hashed every
+ * frame by chip8-conform, so memory goes a word at a time through four
+ * independent chains.
+ */
+uint64_t chip8_state_hash(const chip8_t *c) {
+    uint64_t h = chip8_fb_hash(c);
+    uint64_t m[4] = { 1, 2, 3, 4 };
+
+    h = mix(h, c->PC | (uint64_t)c->I << 16 | (uint64_t)c->SP << 32 |
+               (uint64_t)c->DT << 40 | (uint64_t)c->ST << 48 | (uint64_t)c->planes << 56);
+    h = mix(h, c->rng | (uint64_t)c->pitch << 32);
+    h = mix_bytes(h, c->regs, sizeof c->regs);
+    h = mix_bytes(h, c->memory.stack, sizeof c->memory.stack);
+    h = mix_bytes(h, c->rpl, sizeof c->rpl);
+    h = mix_bytes(h, c->pattern, sizeof c->pattern);
+    for (size_t i = 0; i < MEM_SIZE; i += 32)
+        for (int k = 0; k < 4; ++k) {
+            uint64_t w;
+            memcpy(&w, c->memory.memory + i + 8 * k, 8);
+            m[k] = mix(m[k], w);
+        }
+    for (int k = 0; k < 4; ++k)
+        h = mix(h, m[k]);
+    return h;
 }
@@ -5,8 +5,11 @@
 #include <stdbool.h>
 
 
-#define MEM_SIZE 1024*4       /* 4Kb                */
-#define FRAMEBUFF 64*32       /* 2048 pixels        */
+#define MEM_SIZE (1024*64)    /* 64Kb, XO-CHIP      */
+#define FB_W      128         /* hires width, lores uses the top-left 64x32 */
+#define FB_H      64          /* hires height       */
+#define FB_WORDS  (FB_W / 64) /* 64-bit words per plane row */
+#define FONT_BIG  0x50        /* address of the 8x10 SUPER-CHIP digits */
 
 typedef struct {
     uint8_t memory[MEM_SIZE];
@@ -32,6 +35,73 @@ static const uint8_t font[80] = {
     0xF0,0x80,0xF0,0x80,0x80   // F
 };
 
+static const uint8_t font_big[160] = {
+    0xFF,0xFF,0xC3,0xC3,0xC3,0xC3,0xC3,0xC3,0xFF,0xFF,  // 0
+    0x18,0x78,0x78,0x18,0x18,0x18,0x18,0x18,0xFF,0xFF,  // 1
+    0xFF,0xFF,0x03,0x03,0xFF,0xFF,0xC0,0xC0,0xFF,0xFF,  // 2
+    0xFF,0xFF,0x03,0x03,0xFF,0xFF,0x03,0x03,0xFF,0xFF,  // 3
+    0xC3,0xC3,0xC3,0xC3,0xFF,0xFF,0x03,0x03,0x03,0x03,  // 4
+    0xFF,0xFF,0xC0,0xC0,0xFF,0xFF,0x03,0x03,0xFF,0xFF,  // 5
+    0xFF,0xFF,0xC0,0xC0,0xFF,0xFF,0xC3,0xC3,0xFF,0xFF,  // 6
+    0xFF,0xFF,0x03,0x03,0x06,0x0C,0x18,0x18,0x18,0x18,  // 7
+    0xFF,0xFF,0xC3,0xC3,0xFF,0xFF,0xC3,0xC3,0xFF,0xFF,  // 8
+    0xFF,0xFF,0xC3,0xC3,0xFF,0xFF,0x03,0x03,0xFF,0xFF,  // 9
+    0x7E,0xFF,0xC3,0xC3,0xC3,0xFF,0xFF,0xC3,0xC3,0xC3,  // A
+    0xFC,0xFC,0xC3,0xC3,0xFC,0xFC,0xC3,0xC3,0xFC,0xFC,  // B
+    0x3C,0xFF,0xC3,0xC0,0xC0,0xC0,0xC0,0xC3,0xFF,0x3C,  // C
+    0xFC,0xFE,0xC3,0xC3,0xC3,0xC3,0xC3,0xC3,0xFE,0xFC,  // D
+    0xFF,0xFF,0xC0,0xC0,0xFF,0xFF,0xC0,0xC0,0xFF,0xFF,  // E
+    0xFF,0xFF,0xC0,0xC0,0xFF,0xFF,0xC0,0xC0,0xC0,0xC0   // F
+};
+
+/* Instruction classes, in chip8_cycle's decode order */
+enum {
+    OPC_NOP,                  /* 0nnn SYS and undefined opcodes */
+    OPC_CLS,  OPC_RET,  OPC_JP,   OPC_CALL,
+    OPC_SE,   OPC_SNE,  OPC_SER,  OPC_LD,   OPC_ADD,
+    OPC_MOV,  OPC_OR,   OPC_AND,  OPC_XOR,  OPC_ADDR,
+    OPC_SUB,  OPC_SHR,  OPC_SUBN, OPC_SHL,  OPC_SNER,
+    OPC_LDI,  OPC_JPV0, OPC_RND,  OPC_DRW,  OPC_SKP,  OPC_SKNP,
+    OPC_GDT,  OPC_KEY,  OPC_SDT,  OPC_SST,  OPC_ADDI,
+    OPC_FONT, OPC_BCD,  OPC_STORE, OPC_LOAD,
+    /* SUPER-CHIP and XO-CHIP */
+    OPC_SCD,  OPC_SCU,  OPC_SCR,  OPC_SCL,  OPC_EXIT, OPC_LOW,  OPC_HIGH,
+    OPC_SAVE, OPC_RESTORE, OPC_LDIL, OPC_PLANE, OPC_AUDIO, OPC_BFONT,
+    OPC_PITCH, OPC_SRPL, OPC_LRPL,
+    OPC_COUNT
+};
+
+/* chip8_t.audio_dirty */
+#define AUDIO_PATTERN  0x1
+#define AUDIO_PITCH    0x2
+
+/*
+ * Behaviour that differs between CHIP-8 variants.  None set is this
+ * emulator's original mix: shifts in place, I kept, wrapping sprites.
+ */
+#define QUIRK_VF_RESET  0x01  /* 8xy1/8xy2/8xy3 clear VF                  */
+#define QUIRK_SHIFT_VY  0x02  /* 8xy6/8xyE shift Vy into Vx               */
+#define QUIRK_MEM_I     0x04  /* Fx55/Fx65 leave I past the last register */
+#define QUIRK_MEM_IX    0x08  /* ... one short of it, I += x              */
+#define QUIRK_CLIP      0x10  /* Dxyn clips at the edges instead of wrapping */
+#define QUIRK_JUMP_VX   0x20  /* Bxnn jumps to xnn + Vx, not nnn + V0     */
+
+/*
+ * Each profile is its own copy of the interpreter with the flags folded
+ * in as constants, so the hot loop tests none of them.  Only the
+ * default one is translated by the cache and JIT engines.
+ */
+typedef enum {
+    PROFILE_DEFAULT,
+    PROFILE_VIP,              /* COSMAC VIP */
+    PROFILE_CHIP48,
+    PROFILE_SCHIP,            /* SUPER-CHIP 1.1 */
+    PROFILE_XOCHIP,
+    PROFILE_COUNT
+} chip8_profile_t;
+
+struct chip8_hooks;
+
 typedef struct 
 {
     uint16_t PC;              /* program counter    */
@@ -43,14 +113,119 @@ typedef struct
     uint8_t DT;               /* delay timer        */
     uint8_t ST;               /* sound timer        */
 
-    bool    FB[FRAMEBUFF];    /* framebuffer        */
+    /* two bitplanes of packed rows, bit 63 of word 0 is x=0; lores
+       uses word 0 of rows 0..31 only */
+    uint64_t FB[2][FB_H][FB_WORDS];
+    uint64_t dirty;           /* FB rows changed since last draw */
+    bool     hires;           /* 128x64 SUPER-CHIP mode */
+    uint8_t  planes;          /* XO-CHIP plane mask for drawing, 1..3 */
     uint8_t keypad[16];       /* Keyboard           */
+    uint32_t rng;             /* xorshift32 state for Cxkk, never 0 */
+
+    uint8_t  rpl[16];         /* SUPER-CHIP flag registers, Fx75/Fx85 */
+    uint8_t  pattern[16];     /* XO-CHIP audio pattern, F002 */
+    uint8_t  pitch;           /* XO-CHIP pattern pitch, Fx3A */
+    uint8_t  audio_dirty;     /* AUDIO_* changes not yet sent to the audio side */
+
+    const struct chip8_hooks *hooks;  /* NULL: uninstrumented fast path */
+    uint8_t  profile;         /* chip8_profile_t, set by chip8_set_profile */
 } chip8_t;
 
+/*
+ * Instrumentation callbacks, any may be NULL.  The interpreter is built
+ * twice from one body; the plain copy contains no hook code at all and
+ * is the one used while c->hooks is NULL.
+ */
+typedef struct chip8_hooks {
+    void *ud;
+    /* before each instruction, PC already points past it */
+    void (*exec)(void *ud, chip8_t *c, uint16_t op);
+    /* after Dxyn: pixels set by the sprite and pixels it erased */
+    void (*draw)(void *ud, chip8_t *c, int drawn, int erased);
+    /* after a conditional skip (3/4/5/9xxx, Ex9E/ExA1) */
+    void (*skip)(void *ud, chip8_t *c, uint16_t op, bool taken);
+    /* after chip8_update ticked the timers: a 60 Hz frame is over */
+    void (*frame)(void *ud, chip8_t *c);
+} chip8_hooks_t;
+
 
 chip8_t* chip8_init(void);
 void chip8_destroy(chip8_t *c);
+void chip8_seed(chip8_t *c, uint32_t seed);
 void chip8_cycle(chip8_t *c);
+void chip8_run(chip8_t *c, uint64_t cycles);
 void chip8_update(chip8_t *c);
+int  chip8_opclass(uint16_t op);
+int  chip8_idle_loop(const chip8_t *c, int *lead);
+/* Dxyn of the default profile, for the translating engines */
+void chip8_draw(chip8_t *c, uint8_t vx, uint8_t vy, uint8_t height);
+
+void chip8_set_profile(chip8_t *c, chip8_profile_t p);
+unsigned    chip8_profile_quirks(chip8_profile_t p);
+const char* chip8_profile_name(chip8_profile_t p);
+/* A profile by name, or by its QUIRK_* flags as a number */
+bool chip8_profile_parse(const char *name, chip8_profile_t *p);
+/* The profile with exactly these flags */
+bool chip8_profile_find(unsigned quirks, chip8_profile_t *p);
+
+/* Memory the instruction op at c->PC would touch: [*addr, *addr + *len), wrapping */
+enum { ACCESS_NONE, ACCESS_READ, ACCESS_WRITE };
+int  chip8_access(const chip8_t *c, uint16_t op, uint16_t *addr, uint32_t *len);
+
+/*
+ * Stop marks for chip8_run_break, one bit per address: an instruction
+ * at a marked PC, or one reading or writing a marked byte, is not run.
+ * mem is only looked at while watch is set.
+ */
+typedef struct {
+    uint8_t pc[MEM_SIZE / 8];
+    uint8_t mem[MEM_SIZE / 8];
+    bool    watch;
+} chip8_break_t;
+
+/* chip8_run up to a mark; returns the cycles run */
+uint64_t chip8_run_break(chip8_t *c, uint64_t cycles, const chip8_break_t *b);
+uint64_t chip8_fb_hash(const chip8_t *c);
+/* The framebuffer, registers, stack, memory and PRNG; not keys or hooks */
+uint64_t chip8_state_hash(const chip8_t *c);
+
+/* Per-instance PRNG, so seeded runs repeat and threads share nothing */
+static inline uint8_t chip8_rand(chip8_t *c)
+{
+    uint32_t x = c->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    c->rng = x;
+    return x >> 24;
+}
+
+/* Cycles to run in the next 60 Hz frame, the fraction carried over */
+static inline uint64_t chip8_frame_cycles(int hz, int *carry)
+{
+    *carry += hz;
+    uint64_t n = *carry / 60;
+    *carry %= 60;
+    return n;
+}
+
+/* Bytes taken by the instruction at addr: XO-CHIP's F000 nnnn is four */
+static inline uint16_t chip8_oplen(const chip8_t *c, uint16_t addr)
+{
+    return c->memory.memory[addr] == 0xF0 &&
+           c->memory.memory[(addr + 1) & (MEM_SIZE - 1)] == 0x00 ? 4 : 2;
+}
+
+/* Display size in the current mode */
+static inline int chip8_width(const chip8_t *c)  { return c->hires ? FB_W : FB_W / 2; }
+static inline int chip8_height(const chip8_t *c) { return c->hires ? FB_H : FB_H / 2; }
+
+/* Plane bits of a pixel of the current mode: 0 off, 1..3 colour */
+static inline int chip8_pixel(const chip8_t *c, int x, int y)
+{
+    int      w   = x >> 6;
+    unsigned bit = 63 - (x & 63);
+    return ((c->FB[0][y][w] >> bit) & 1) | ((c->FB[1][y][w] >> bit) & 1) << 1;
+}
 
 #endif /* CHIP8_H */
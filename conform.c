@@ -0,0 +1,634 @@
+/* conform.c — headless conformance runs against golden hashes, no SDL */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "chip8.h"
+#include "engine.h"
+#include "pack.h"
+#include "pool.h"
+
+/*
+ * Every ROM runs a fixed number of 60 Hz frames from a fixed seed, with
+ * its key script applied at frame starts.  After each frame the
+ * framebuffer hash and the whole-state hash are taken; a golden file
+ * holds them for every frame, so a change shows up at the first frame
+ * it affects.  With -vs a second engine runs alongside and the first
+ * frame the two disagree on is replayed cycle by cycle.
+ *
+ * Golden file <dir>/<pack_hash>.golden, text:
+ *   # hz=500 quirks=default seed=1 keys=<hash> frames=600
+ *   <fb hash> <state hash>        one line per frame
+ */
+
+typedef struct {
+    int      frame;
+    uint8_t  key;
+    bool     down;
+} key_ev_t;
+
+typedef struct {
+    char           *path;
+    const uint8_t  *data;
+    size_t          size;
+    bool            mapped;     /* data points into a pack */
+    int             hz;         /* from a pack, 0 – not set */
+    uint32_t        quirks;     /* from a pack */
+    chip8_profile_t profile;
+    int             frames;     /* 0 – -frames */
+    char           *keys_path;  /* NULL – -keys */
+    key_ev_t       *keys;       /* by frame */
+    size_t          nkeys;
+    uint64_t        keys_hash;
+} rom_t;
+
+typedef struct {
+    bool        fail;
+    int         frame;          /* first bad frame, -1 – none */
+    char        why[256];
+    uint64_t    fb, state;      /* after the last frame */
+    uint64_t    cycles;
+} result_t;
+
+typedef struct {
+    const char *path;
+    pack_t     *pack;
+} packs_t;
+
+typedef struct {
+    rom_t      *roms;
+    int         nroms;
+    packs_t    *packs;
+    int         npacks;
+    int         frames;
+    int         hz;             /* 0 – the pack's, else 500 */
+    int         profile;        /* -1 – the pack's, else default */
+    uint32_t    seed;
+    engine_kind_t engine;
+    int         vs;             /* second engine, -1 – none */
+    unsigned    flags;
+    const char *keys_path;      /* for ROMs without their own */
+    const char *golden;
+    bool        update;
+    int         threads;
+    bool        quiet;
+    result_t   *results;
+} conform_t;
+
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options] <rom.ch8 | pack.c8p[:name | #hash]...>\n"
+            "  -l <file>     read ROMs from file, one per line:\n"
+            "                path [frames=N] [keys=FILE]\n"
+            "  -frames <n>   frames per ROM (default 600)\n"
+            "  -hz <n>       CPU frequency (default: the pack's, else 500)\n"
+            "  -quirks <p>   default | vip | chip48 | schip | xochip\n"
+            "                (default: the pack's, else default)\n"
+            "  -seed <n>     PRNG seed (default 1)\n"
+            "  -keys <file>  key script: \"frame key 1|0\" per line, hex key\n"
+            "  -engine <e>   engine under test: switch | cache | jit (default switch)\n"
+            "  -vs <e>       run engine e alongside, report the first cycle\n"
+            "                where the two machines differ\n"
+            "  -noidle       execute idle loops instead of skipping them\n"
+            "  -golden <dir> compare every frame with dir/<hash>.golden\n"
+            "  -update       write the golden files instead\n"
+            "  -j <n>        worker threads (default: all cores)\n"
+            "  -q            print only failures and the summary\n"
+            , prog);
+}
+
+/* A list names the same pack over and over, so each is mapped only once */
+static pack_t *get_pack(conform_t *h, const char *path)
+{
+    for (int i = 0; i < h->npacks; ++i)
+        if (!strcmp(h->packs[i].path, path)) return h->packs[i].pack;
+
+    pack_t *p = pack_open(path);
+    h->packs = realloc(h->packs, (h->npacks + 1) * sizeof *h->packs);
+    h->packs[h->npacks++] = (packs_t){ strdup(path), p };
+    return p;
+}
+
+static void push_rom(conform_t *h, rom_t r)
+{
+    h->roms = realloc(h->roms, (h->nroms + 1) * sizeof *h->roms);
+    h->roms[h->nroms++] = r;
+}
+
+/* A bare pack stands for every ROM in it */
+static void add_rom(conform_t *h, const char *path, int frames, const char *keys)
+{
+    size_t len = strlen(path);
+    rom_t  r   = { .frames = frames };
+
+    if (len < 4 || strcmp(path + len - 4, ".c8p") != 0) {
+        r.path      = strdup(path);
+        r.keys_path = keys ? strdup(keys) : NULL;
+        push_rom(h, r);
+        return;
+    }
+
+    pack_t *p = get_pack(h, path);
+    if (!p) exit(EXIT_FAILURE);
+    for (size_t i = 0; i < pack_count(p); ++i) {
+        pack_rom_t pr;
+        pack_get(p, i, &pr);
+
+        r.path = malloc(len + strlen(pr.name) + 2);
+        sprintf(r.path, "%s:%s", path, pr.name);
+        r.data   = pr.data;
+        r.size   = pr.size;
+        r.mapped = true;
+        r.hz     = pr.hz;
+        r.quirks = pr.quirks;
+        r.keys_path = keys ? strdup(keys) : NULL;
+        push_rom(h, r);
+    }
+}
+
+static void add_list(conform_t *h, const char *list)
+{
+    FILE *f = fopen(list, "r");
+    if (!f) { perror(list); exit(EXIT_FAILURE); }
+
+    char line[4096];
+    for (int n = 1; fgets(line, sizeof line, f); ++n) {
+        line[strcspn(line, "\r\n")] = 0;
+        if (!line[0] || line[0] == '#') continue;
+
+        char       *path = strtok(line, " \t"), *tok;
+        int         frames = 0;
+        const char *keys = NULL;
+        while ((tok = strtok(NULL, " \t"))) {
+            if      (!strncmp(tok, "frames=", 7)) frames = atoi(tok + 7);
+            else if (!strncmp(tok, "keys=", 5))   keys = tok + 5;
+            else {
+                fprintf(stderr, "%s:%d: bad field '%s'\n", list, n, tok);
+                exit(EXIT_FAILURE);
+            }
+        }
+        add_rom(h, path, frames, keys);
+    }
+    fclose(f);
+}
+
+static conform_t parse_args(int argc, char *argv[])
+{
+    conform_t h = {0};
+    h.frames  = 600;
+    h.profile = -1;
+    h.seed    = 1;
+    h.vs      = -1;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            add_list(&h, argv[++i]);
+        }
+        else if (strcmp(argv[i], "-frames") == 0 && i + 1 < argc) {
+            h.frames = atoi(argv[++i]);
+            if (h.frames < 1) h.frames = 1;
+        }
+        else if (strcmp(argv[i], "-hz") == 0 && i + 1 < argc) {
+            h.hz = atoi(argv[++i]);
+            if (h.hz < 60) {
+                fprintf(stderr, "Hz must be >=60\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (strcmp(argv[i], "-quirks") == 0 && i + 1 < argc) {
+            chip8_profile_t p;
+            if (!chip8_profile_parse(argv[++i], &p)) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            h.profile = p;
+        }
+        else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc) {
+            h.seed = strtoul(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "-keys") == 0 && i + 1 < argc) {
+            h.keys_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "-engine") == 0 && i + 1 < argc) {
+            if (!engine_parse(argv[++i], &h.engine)) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (strcmp(argv[i], "-vs") == 0 && i + 1 < argc) {
+            engine_kind_t k;
+            if (!engine_parse(argv[++i], &k)) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            h.vs = k;
+        }
+        else if (strcmp(argv[i], "-noidle") == 0) {
+            h.flags |= ENGINE_NOIDLE;
+        }
+        else if (strcmp(argv[i], "-golden") == 0 && i + 1 < argc) {
+            h.golden = argv[++i];
+        }
+        else if (strcmp(argv[i], "-update") == 0) {
+            h.update = true;
+        }
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            h.threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-q") == 0) {
+            h.quiet = true;
+        }
+        else if (argv[i][0] != '-') {
+            add_rom(&h, argv[i], 0, NULL);
+        }
+        else {
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (!h.nroms || (h.update && !h.golden)) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    return h;
+}
+
+
+/* "frame key 1|0" lines; the hash goes into the golden header */
+static bool read_keys(rom_t *r, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) { perror(path); return false; }
+
+    char     line[256];
+    size_t   cap = 0;
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (int n = 1; fgets(line, sizeof line, f); ++n) {
+        int      frame, down;
+        unsigned key;
+        if (line[0] == '#' || line[strspn(line, " \t\r\n")] == 0) continue;
+        if (sscanf(line, "%d %x %d", &frame, &key, &down) != 3 || frame < 0 || key > 15) {
+            fprintf(stderr, "%s:%d: expected \"frame key 1|0\"\n", path, n);
+            fclose(f);
+            return false;
+        }
+        if (r->nkeys == cap) {
+            cap = cap ? cap * 2 : 64;
+            r->keys = realloc(r->keys, cap * sizeof *r->keys);
+        }
+        /* kept in file order within a frame: a press and release both apply */
+        size_t k = r->nkeys++;
+        for (; k && r->keys[k - 1].frame > frame; --k)
+            r->keys[k] = r->keys[k - 1];
+        r->keys[k] = (key_ev_t){ frame, key, down != 0 };
+        hash = (hash ^ ((uint64_t)frame << 8 | key << 1 | (down != 0))) * 0x100000001B3ULL;
+    }
+    fclose(f);
+    r->keys_hash = hash;
+    return true;
+}
+
+static bool read_rom(conform_t *h, rom_t *r)
+{
+    char        path[4096];
+    const char *sel;
+    pack_rom_t  pr;
+
+    if (!r->data && pack_spec(r->path, path, sizeof path, &sel)) {
+        pack_t *p = get_pack(h, path);
+        if (!p) return false;
+        if (!pack_select(p, sel, &pr)) {
+            fprintf(stderr, "%s: no such ROM in the pack\n", r->path);
+            return false;
+        }
+        r->data   = pr.data;
+        r->size   = pr.size;
+        r->mapped = true;
+        r->hz     = pr.hz;
+        r->quirks = pr.quirks;
+    } else if (!r->data) {
+        FILE *f = fopen(r->path, "rb");
+        if (!f) { perror(r->path); return false; }
+
+        uint8_t *data = malloc(MEM_SIZE - 0x200);
+        r->size = fread(data, 1, MEM_SIZE - 0x200, f);
+        fclose(f);
+        if (r->size == 0) {
+            fprintf(stderr, "%s: empty ROM\n", r->path);
+            free(data);
+            return false;
+        }
+        r->data = data;
+    }
+
+    if (h->profile >= 0) {
+        r->profile = h->profile;
+    } else if (!chip8_profile_find(r->quirks, &r->profile)) {
+        fprintf(stderr, "%s: no profile has quirks 0x%x\n", r->path, (unsigned)r->quirks);
+        return false;
+    }
+    if (!r->frames) r->frames = h->frames;
+    if (!r->hz)     r->hz = h->hz ? h->hz : 500;
+    else if (h->hz) r->hz = h->hz;
+
+    const char *keys = r->keys_path ? r->keys_path : h->keys_path;
+    return !keys || read_keys(r, keys);
+}
+
+
+/* One machine and its engine, both freshly started */
+typedef struct {
+    chip8_t  *c;
+    engine_t *e;
+    int       carry;
+    size_t    key;              /* next key event */
+} run_t;
+
+static bool start(run_t *m, const conform_t *h, const rom_t *r, engine_kind_t kind)
+{
+    m->c     = chip8_init();
+    m->e     = engine_init(kind, h->flags);
+    m->carry = 0;
+    m->key   = 0;
+    if (!m->c || !m->e) return false;
+    memcpy(m->c->memory.memory + 0x200, r->data, r->size);
+    chip8_set_profile(m->c, r->profile);
+    chip8_seed(m->c, h->seed);
+    return true;
+}
+
+static void stop(run_t *m)
+{
+    engine_destroy(m->e);
+    chip8_destroy(m->c);
+}
+
+/* Keys of this frame, then its cycles; returns them */
+static uint64_t frame_begin(run_t *m, const rom_t *r, int frame, int hz)
+{
+    for (; m->key < r->nkeys && r->keys[m->key].frame <= frame; ++m->key)
+        m->c->keypad[r->keys[m->key].key] = r->keys[m->key].down;
+    return chip8_frame_cycles(hz, &m->carry);
+}
+
+/* The first thing a and b disagree on, for the report */
+static void state_diff(char *buf, size_t len, const chip8_t *a, const chip8_t *b)
+{
+#define DIFF(name, x, y) \
+    if ((x) != (y)) { snprintf(buf, len, "%s %X vs %X", name, (unsigned)(x), (unsigned)(y)); return; }
+    char name[16];
+    DIFF("PC", a->PC, b->PC);
+    DIFF("I", a->I, b->I);
+    DIFF("SP", a->SP, b->SP);
+    DIFF("DT", a->DT, b->DT);
+    DIFF("ST", a->ST, b->ST);
+    for (int i = 0; i < 16; ++i) {
+        snprintf(name, sizeof name, "V%X", i);
+        DIFF(name, a->regs[i], b->regs[i]);
+    }
+    for (int i = 0; i < 16; ++i) {
+        snprintf(name, sizeof name, "stack[%d]", i);
+        DIFF(name, a->memory.stack[i], b->memory.stack[i]);
+    }
+    for (uint32_t i = 0; i < MEM_SIZE; ++i) {
+        snprintf(name, sizeof name, "mem[%04X]", (unsigned)i);
+        DIFF(name, a->memory.memory[i], b->memory.memory[i]);
+    }
+    DIFF("hires", a->hires, b->hires);
+    DIFF("planes", a->planes, b->planes);
+    DIFF("rng", a->rng, b->rng);
+    DIFF("pitch", a->pitch, b->pitch);
+    if (memcmp(a->FB, b->FB, sizeof a->FB)) { snprintf(buf, len, "framebuffer"); return; }
+    if (memcmp(a->rpl, b->rpl, sizeof a->rpl)) { snprintf(buf, len, "RPL flags"); return; }
+    snprintf(buf, len, "audio pattern");
+#undef DIFF
+}
+
+/*
+ * The engines first disagreed after frame `bad`: both start over, run
+ * to that frame, then go through it one cycle at a time.
+ */
+static void bisect(const conform_t *h, const rom_t *r, int bad, result_t *res)
+{
+    run_t    a = {0}, b = {0};
+    uint64_t cycle = 0;
+    char     diff[128];
+
+    if (!start(&a, h, r, h->engine) || !start(&b, h, r, h->vs)) goto out;
+    for (int f = 0; f <= bad; ++f) {
+        uint64_t n = frame_begin(&a, r, f, r->hz);
+        frame_begin(&b, r, f, r->hz);
+
+        if (f < bad) {
+            engine_run(a.e, a.c, n);
+            engine_run(b.e, b.c, n);
+            cycle += n;
+        } else {
+            for (uint64_t k = 0; k < n; ++k, ++cycle) {
+                uint16_t pc = a.c->PC;
+                uint16_t op = a.c->memory.memory[pc] << 8 | a.c->memory.memory[(pc + 1) & (MEM_SIZE - 1)];
+                engine_run(a.e, a.c, 1);
+                engine_run(b.e, b.c, 1);
+                if (chip8_state_hash(a.c) == chip8_state_hash(b.c)) continue;
+                state_diff(diff, sizeof diff, a.c, b.c);
+                snprintf(res->why, sizeof res->why,
+                         "%s/%s differ at cycle %llu (frame %d), after %04X at %04X: %s",
+                         engine_name(h->engine), engine_name(h->vs),
+                         (unsigned long long)cycle, f, op, pc, diff);
+                goto out;
+            }
+        }
+        chip8_update(a.c);
+        chip8_update(b.c);
+    }
+    /* block-sized runs disagree where single cycles do not */
+    snprintf(res->why, sizeof res->why, "%s/%s differ after frame %d, not cycle by cycle",
+             engine_name(h->engine), engine_name(h->vs), bad);
+out:
+    stop(&a);
+    stop(&b);
+}
+
+static void golden_path(char *buf, size_t len, const conform_t *h, const rom_t *r)
+{
+    snprintf(buf, len, "%s/%016llx.golden", h->golden,
+             (unsigned long long)pack_hash(r->data, r->size));
+}
+
+static void golden_header(char *buf, size_t len, const conform_t *h, const rom_t *r)
+{
+    snprintf(buf, len, "# hz=%d quirks=%s seed=%u keys=%016llx frames=%d\n",
+             r->hz, chip8_profile_name(r->profile), (unsigned)h->seed,
+             (unsigned long long)r->keys_hash, r->frames);
+}
+
+/* Written aside and renamed, so a ROM listed twice cannot tear the file */
+static void golden_write(const conform_t *h, const rom_t *r, const uint64_t *hash,
+                         int worker, result_t *res)
+{
+    char path[4096], tmp[4200], head[256];
+
+    golden_path(path, sizeof path, h, r);
+    snprintf(tmp, sizeof tmp, "%s.%d", path, worker);
+    golden_header(head, sizeof head, h, r);
+
+    FILE *f = fopen(tmp, "w");
+    if (!f) { snprintf(res->why, sizeof res->why, "cannot write the golden file"); res->fail = true; return; }
+    fputs(head, f);
+    for (int i = 0; i < r->frames; ++i)
+        fprintf(f, "%016llx %016llx\n",
+                (unsigned long long)hash[2 * i], (unsigned long long)hash[2 * i + 1]);
+    if (fclose(f) != 0 || rename(tmp, path) != 0) {
+        snprintf(res->why, sizeof res->why, "cannot write the golden file");
+        res->fail = true;
+    }
+}
+
+static void golden_check(const conform_t *h, const rom_t *r, const uint64_t *hash, result_t *res)
+{
+    char path[4096], head[256], line[256];
+
+    golden_path(path, sizeof path, h, r);
+    golden_header(head, sizeof head, h, r);
+    res->fail = true;
+
+    FILE *f = fopen(path, "r");
+    if (!f) { snprintf(res->why, sizeof res->why, "no golden file"); return; }
+    if (!fgets(line, sizeof line, f) || strcmp(line, head)) {
+        snprintf(res->why, sizeof res->why, "golden file made with other settings");
+        fclose(f);
+        return;
+    }
+    for (int i = 0; i < r->frames; ++i) {
+        unsigned long long fb, state;
+        if (!fgets(line, sizeof line, f) || sscanf(line, "%llx %llx", &fb, &state) != 2) {
+            snprintf(res->why, sizeof res->why, "golden file ends at frame %d", i);
+            fclose(f);
+            return;
+        }
+        if (fb != hash[2 * i] || state != hash[2 * i + 1]) {
+            res->frame = i;
+            snprintf(res->why, sizeof res->why, "frame %d: %s differs from the golden file",
+                     i, fb != hash[2 * i] ? "framebuffer" : "state");
+            fclose(f);
+            return;
+        }
+    }
+    fclose(f);
+    res->fail = false;
+}
+
+static void check_rom(void *ctx, size_t idx, int worker)
+{
+    conform_t *h   = ctx;
+    rom_t     *r   = &h->roms[idx];
+    result_t  *res = &h->results[idx];
+    run_t      a = {0}, b = {0};
+
+    res->frame = -1;
+    if (!r->data) {
+        res->fail = true;
+        snprintf(res->why, sizeof res->why, "not loaded");
+        return;
+    }
+
+    uint64_t *hash = malloc(2 * r->frames * sizeof *hash);
+    if (!hash || !start(&a, h, r, h->engine) || (h->vs >= 0 && !start(&b, h, r, h->vs))) {
+        res->fail = true;
+        snprintf(res->why, sizeof res->why, "cannot start the engines");
+        goto out;
+    }
+
+    for (int f = 0; f < r->frames; ++f) {
+        uint64_t n = frame_begin(&a, r, f, r->hz);
+        engine_run(a.e, a.c, n);
+        chip8_update(a.c);
+        res->cycles += n;
+        hash[2 * f]     = chip8_fb_hash(a.c);
+        hash[2 * f + 1] = chip8_state_hash(a.c);
+
+        if (h->vs < 0) continue;
+        frame_begin(&b, r, f, r->hz);
+        engine_run(b.e, b.c, n);
+        chip8_update(b.c);
+        if (chip8_state_hash(b.c) != hash[2 * f + 1]) {
+            res->fail  = true;
+            res->frame = f;
+            bisect(h, r, f, res);
+            goto out;
+        }
+    }
+    res->fb    = hash[2 * (r->frames - 1)];
+    res->state = hash[2 * (r->frames - 1) + 1];
+
+    if (h->update)      golden_write(h, r, hash, worker, res);
+    else if (h->golden) golden_check(h, r, hash, res);
+out:
+    stop(&a);
+    stop(&b);
+    free(hash);
+}
+
+
+int main(int argc, char *argv[])
+{
+    conform_t h = parse_args(argc, argv);
+
+    /* a ROM that fails here is reported as not loaded */
+    for (int i = 0; i < h.nroms; ++i) {
+        rom_t *r = &h.roms[i];
+        if (read_rom(&h, r)) continue;
+        if (!r->mapped) free((uint8_t *)r->data);
+        r->data   = NULL;
+        r->mapped = true;
+    }
+
+    h.results = calloc(h.nroms, sizeof *h.results);
+    if (h.threads < 1) h.threads = pool_cpus();
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    pool_run(h.nroms, h.threads, check_rom, &h);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    int      failed = 0;
+    uint64_t cycles = 0;
+    for (int i = 0; i < h.nroms; ++i) {
+        const result_t *r = &h.results[i];
+        cycles += r->cycles;
+        failed += r->fail;
+        if (r->fail)
+            printf("%s\tFAIL\t%s\n", h.roms[i].path, r->why);
+        else if (!h.quiet)
+            printf("%s\tok\tfb=%016llx\tstate=%016llx\n", h.roms[i].path,
+                   (unsigned long long)r->fb, (unsigned long long)r->state);
+    }
+
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("roms=%d failed=%d engine=%s%s%s threads=%d instructions=%llu "
+           "time=%.3fs roms/min=%.0f\n",
+           h.nroms, failed, engine_name(h.engine), h.vs >= 0 ? " vs=" : "",
+           h.vs >= 0 ? engine_name(h.vs) : "", h.threads, (unsigned long long)cycles,
+           secs, secs > 0 ? h.nroms / secs * 60 : 0.0);
+
+    for (int i = 0; i < h.nroms; ++i) {
+        if (!h.roms[i].mapped) free((uint8_t *)h.roms[i].data);
+        free(h.roms[i].path);
+        free(h.roms[i].keys_path);
+        free(h.roms[i].keys);
+    }
+    free(h.roms);
+    for (int i = 0; i < h.npacks; ++i) {
+        pack_close(h.packs[i].pack);
+        free((char *)h.packs[i].path);
+    }
+    free(h.packs);
+    free(h.results);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -1,11 +1,52 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
 #include "dbg.h"
 
+/*
+ * Mode 1 writes a binary trace instead of text.  Each record holds PC,
+ * opcode and only the registers that changed since the previous one;
+ * the first record of every block carries the full state, so blocks
+ * decode on their own.  Records go into fixed-size blocks of a ring:
+ * streaming mode hands full blocks to a writer thread (lock-free SPSC,
+ * head/tail counters), flight-recorder mode just overwrites the oldest
+ * block and dumps the ring at exit.
+ */
+#define TRACE_RECS     4096                       /* records per block   */
+#define TRACE_REC_MAX  (4 + 3 + 16 + 2 + 3)       /* full-state record   */
+#define TRACE_BYTES    (TRACE_RECS * TRACE_REC_MAX)
+#define TRACE_STREAM   64                         /* blocks when streaming */
+
+#define M_I   (1u << 16)
+#define M_SP  (1u << 17)
+#define M_DT  (1u << 18)
+#define M_ST  (1u << 19)
+#define M_ALL 0xFFFFFu
+
+typedef struct {
+    uint32_t recs;
+    uint32_t bytes;
+    uint8_t  data[TRACE_BYTES];
+} tblock_t;
 
-static FILE* log;
-static int   mode;
+static FILE*     log;
+static int       mode;
 
-static const char *opcode(char *buf, size_t len, uint16_t op)
+static tblock_t *ring;
+static uint64_t  nblocks;
+static uint64_t  head;            /* blocks completed by the emulator   */
+static uint64_t  tail;            /* blocks written by the writer thread */
+static bool      flight;          /* overwrite instead of waiting        */
+static bool      done;
+static pthread_t writer;
+static trace_rec_t last;
+
+const char *opcode(char *buf, size_t len, uint16_t op)
 {
     uint8_t  x   = (op >> 8) & 0x0F;
     uint8_t  y   = (op >> 4) & 0x0F;
@@ -16,13 +57,27 @@ static const char *opcode(char *buf, size_t len, uint16_t op)
         case 0x0000:
             if      (op == 0x00E0) return "CLS";
             else if (op == 0x00EE) return "RET";
-            else                   { snprintf(buf,len,"SYS %03X",nnn); return buf; }
+            else if (op == 0x00FB) return "SCR";
+            else if (op == 0x00FC) return "SCL";
+            else if (op == 0x00FD) return "EXIT";
+            else if (op == 0x00FE) return "LOW";
+            else if (op == 0x00FF) return "HIGH";
+            else if ((op & 0xFFF0) == 0x00C0) snprintf(buf,len,"SCD %X",op&0xF);
+            else if ((op & 0xFFF0) == 0x00D0) snprintf(buf,len,"SCU %X",op&0xF);
+            else                   snprintf(buf,len,"SYS %03X",nnn);
+            return buf;
 
         case 0x1000: snprintf(buf,len,"JP %03X",nnn);           return buf;
         case 0x2000: snprintf(buf,len,"CALL %03X",nnn);         return buf;
         case 0x3000: snprintf(buf,len,"SE V%X,%02X",x,kk);      return buf;
         case 0x4000: snprintf(buf,len,"SNE V%X,%02X",x,kk);     return buf;
-        case 0x5000: snprintf(buf,len,"SE V%X,V%X",x,y);        return buf;
+        case 0x5000:
+            switch (op & 0xF) {
+                case 0x0: snprintf(buf,len,"SE V%X,V%X",x,y);       return buf;
+                case 0x2: snprintf(buf,len,"LD [I],V%X-V%X",x,y);   return buf;
+                case 0x3: snprintf(buf,len,"LD V%X-V%X,[I]",x,y);   return buf;
+            }
+            break;
         case 0x6000: snprintf(buf,len,"LD V%X,%02X",x,kk);      return buf;
         case 0x7000: snprintf(buf,len,"ADD V%X,%02X",x,kk);     return buf;
 
@@ -54,15 +109,22 @@ static const char *opcode(char *buf, size_t len, uint16_t op)
 
         case 0xF000:
             switch (kk) {
+                case 0x00: if (x) break; snprintf(buf,len,"LD I,long");  return buf;
+                case 0x01: snprintf(buf,len,"PLANE %X",x);      return buf;
+                case 0x02: if (x) break; snprintf(buf,len,"AUDIO");      return buf;
                 case 0x07: snprintf(buf,len,"LD V%X,DT",x);     return buf;
                 case 0x0A: snprintf(buf,len,"LD V%X,K",x);      return buf;
                 case 0x15: snprintf(buf,len,"LD DT,V%X",x);     return buf;
                 case 0x18: snprintf(buf,len,"LD ST,V%X",x);     return buf;
                 case 0x1E: snprintf(buf,len,"ADD I,V%X",x);     return buf;
                 case 0x29: snprintf(buf,len,"LD F,V%X",x);      return buf;
+                case 0x30: snprintf(buf,len,"LD HF,V%X",x);     return buf;
                 case 0x33: snprintf(buf,len,"LD B,V%X",x);      return buf;
+                case 0x3A: snprintf(buf,len,"PITCH V%X",x);     return buf;
                 case 0x55: snprintf(buf,len,"LD [I],V%X",x);    return buf;
                 case 0x65: snprintf(buf,len,"LD V%X,[I]",x);    return buf;
+                case 0x75: snprintf(buf,len,"LD R,V%X",x);      return buf;
+                case 0x85: snprintf(buf,len,"LD V%X,R",x);      return buf;
             }
             break;
     }
@@ -70,46 +132,189 @@ static const char *opcode(char *buf, size_t len, uint16_t op)
     return buf;
 }
 
-void debug_init(int m) {
-    if (m == 1) {
-        log = fopen("dbg.log", "w");
-        mode=1;
+static void write_block(const tblock_t *b)
+{
+    fwrite(&b->recs, sizeof b->recs, 1, log);
+    fwrite(&b->bytes, sizeof b->bytes, 1, log);
+    fwrite(b->data, 1, b->bytes, log);
+}
+
+static void *trace_writer(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        uint64_t h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+        if (tail == h) {
+            /* the last block may be published just before done */
+            if (__atomic_load_n(&done, __ATOMIC_ACQUIRE)) {
+                if (__atomic_load_n(&head, __ATOMIC_ACQUIRE) == tail) break;
+                continue;
+            }
+            nanosleep(&(struct timespec){0, 1000000}, NULL);
+            continue;
+        }
+        while (tail != h) {
+            write_block(&ring[tail % nblocks]);
+            __atomic_store_n(&tail, tail + 1, __ATOMIC_RELEASE);
+        }
+        fflush(log);
+    }
+    return NULL;
+}
+
+/* keep_millions > 0 selects the flight recorder: only the last N million
+   instructions (rounded up to whole blocks) are kept and written at exit */
+void debug_init(int m, int keep_millions) {
+    mode = m;
+    if (m != 1) return;
+
+    log = fopen("dbg.trace", "wb");
+    if (!log) { perror("dbg.trace"); mode = 0; return; }
+    fwrite(TRACE_MAGIC, 1, 4, log);
+    fputc(TRACE_VERSION, log);
+    fwrite("\0\0\0", 1, 3, log);
+
+    flight  = keep_millions > 0;
+    nblocks = flight ? ((uint64_t)keep_millions * 1000000 + TRACE_RECS - 1) / TRACE_RECS + 1
+                     : TRACE_STREAM;
+    /* untouched pages of a block are never committed by the OS */
+    ring = malloc(nblocks * sizeof *ring);
+    if (!ring) { perror("trace"); fclose(log); log = NULL; mode = 0; return; }
+    ring[0].recs = ring[0].bytes = 0;
+
+    int err = flight ? 0 : pthread_create(&writer, NULL, trace_writer, NULL);
+    if (err) {
+        fprintf(stderr, "trace: %s\n", strerror(err));
+        fclose(log); log = NULL;
+        remove("dbg.trace");
+        free(ring);  ring = NULL;
+        mode = 0;
     }
-    else mode=2;
 }
 
 void debug_destroy(void) {
-    if (log) fclose(log);
+    if (!log) return;
+
+    tblock_t *cur = &ring[head % nblocks];
+    if (flight) {
+        uint64_t first = head >= nblocks - 1 ? head - (nblocks - 1) : 0;
+        for (uint64_t b = first; b < head; ++b)
+            write_block(&ring[b % nblocks]);
+        if (cur->recs) write_block(cur);
+    } else {
+        if (cur->recs) __atomic_store_n(&head, head + 1, __ATOMIC_RELEASE);
+        __atomic_store_n(&done, true, __ATOMIC_RELEASE);
+        pthread_join(writer, NULL);
+    }
+    fclose(log);
+    free(ring);
+    log  = NULL;
+    ring = NULL;
 }
 
-void debug_sbs(void) {
-    fprintf(stdout, "\n--- press ENTER to step ---\n");
-    fflush(stdout);
-    while (getchar() != '\n') { }
+static void trace_put(const chip8_t *c, uint16_t op)
+{
+    tblock_t *b = &ring[head % nblocks];
+    trace_rec_t now;
+    uint32_t mask = 0;
+
+    now.pc = c->PC - 2;
+    now.op = op;
+    now.I  = c->I;
+    now.SP = c->SP;
+    now.DT = c->DT;
+    now.ST = c->ST;
+    memcpy(now.regs, c->regs, 16);
+
+    if (b->recs == 0) {
+        mask = M_ALL;
+    } else {
+        for (int i = 0; i < 16; ++i)
+            if (now.regs[i] != last.regs[i]) mask |= 1u << i;
+        if (now.I  != last.I)  mask |= M_I;
+        if (now.SP != last.SP) mask |= M_SP;
+        if (now.DT != last.DT) mask |= M_DT;
+        if (now.ST != last.ST) mask |= M_ST;
+    }
+    last = now;
+
+    uint8_t *p = b->data + b->bytes;
+    *p++ = now.pc; *p++ = now.pc >> 8;
+    *p++ = now.op; *p++ = now.op >> 8;
+    *p++ = mask;   *p++ = mask >> 8;   *p++ = mask >> 16;
+    for (int i = 0; i < 16; ++i)
+        if (mask & (1u << i)) *p++ = now.regs[i];
+    if (mask & M_I)  { *p++ = now.I; *p++ = now.I >> 8; }
+    if (mask & M_SP) *p++ = now.SP;
+    if (mask & M_DT) *p++ = now.DT;
+    if (mask & M_ST) *p++ = now.ST;
+    b->bytes = p - b->data;
+
+    if (++b->recs < TRACE_RECS) return;
+
+    /* block full: publish it and move on */
+    if (!flight) {
+        while (head + 1 - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) >= nblocks)
+            nanosleep(&(struct timespec){0, 100000}, NULL);
+    }
+    __atomic_store_n(&head, head + 1, __ATOMIC_RELEASE);
+    ring[head % nblocks].recs  = 0;
+    ring[head % nblocks].bytes = 0;
+}
+
+/* Applies one record to *r (which holds the previous state), returns
+   the bytes consumed or 0 if the buffer is truncated */
+size_t trace_decode(const uint8_t *p, size_t len, trace_rec_t *r)
+{
+    const uint8_t *s = p, *end = p + len;
+    if (len < 7) return 0;
+
+    r->pc = p[0] | p[1] << 8;
+    r->op = p[2] | p[3] << 8;
+    uint32_t mask = p[4] | p[5] << 8 | (uint32_t)p[6] << 16;
+    p += 7;
+
+    for (int i = 0; i < 16; ++i)
+        if (mask & (1u << i)) { if (p >= end) return 0; r->regs[i] = *p++; }
+    if (mask & M_I)  { if (p + 2 > end) return 0; r->I = p[0] | p[1] << 8; p += 2; }
+    if (mask & M_SP) { if (p >= end) return 0; r->SP = *p++; }
+    if (mask & M_DT) { if (p >= end) return 0; r->DT = *p++; }
+    if (mask & M_ST) { if (p >= end) return 0; r->ST = *p++; }
+    return p - s;
+}
+
+/* The text line mode 1 used to write to dbg.log */
+void trace_print(FILE *f, const trace_rec_t *r)
+{
+    char buf[64];
+    const char *mnem = opcode(buf, sizeof(buf), r->op);
+    fprintf(f,
+        "%04X: %-15s I=%03X SP=%02X DT=%02X ST=%02X "
+        "V0=%02X V1=%02X V2=%02X V3=%02X V4=%02X V5=%02X "
+        "V6=%02X V7=%02X V8=%02X V9=%02X VA=%02X VB=%02X "
+        "VC=%02X VD=%02X VE=%02X VF=%02X\n",
+        r->pc, mnem, r->I, r->SP, r->DT, r->ST,
+        r->regs[0],  r->regs[1],  r->regs[2],  r->regs[3],
+        r->regs[4],  r->regs[5],  r->regs[6],  r->regs[7],
+        r->regs[8],  r->regs[9],  r->regs[10], r->regs[11],
+        r->regs[12], r->regs[13], r->regs[14], r->regs[15]);
+}
+
+static void debug_exec(void *ud, chip8_t *c, uint16_t op) {
+    (void)ud;
+    debug_log(c, op);
+}
+
+static const chip8_hooks_t hooks = { NULL, debug_exec, NULL, NULL, NULL };
+
+/* Hooks to attach to the traced instance, NULL unless tracing (mode 2,
+   the prompt, is brk.c's and runs without hooks) */
+const chip8_hooks_t *debug_hooks(void) {
+    return mode == 1 ? &hooks : NULL;
 }
 
 void debug_log(chip8_t *c, uint16_t op) {
-    char mnem[64];
-    opcode(mnem,sizeof(mnem),op);
     if ( mode == 1 ) {
-        fprintf(log,
-            "%04X: %-15s I=%03X SP=%02X DT=%02X ST=%02X "
-            "V0=%02X V1=%02X V2=%02X V3=%02X V4=%02X V5=%02X "
-            "V6=%02X V7=%02X V8=%02X V9=%02X VA=%02X VB=%02X "
-            "VC=%02X VD=%02X VE=%02X VF=%02X\n",
-            c->PC-2, mnem, c->I, c->SP, c->DT, c->ST,
-            c->regs[0],  c->regs[1],  c->regs[2],  c->regs[3],
-            c->regs[4],  c->regs[5],  c->regs[6],  c->regs[7],
-            c->regs[8],  c->regs[9],  c->regs[10], c->regs[11],
-            c->regs[12], c->regs[13], c->regs[14], c->regs[15]);
-        fflush(log);
+        trace_put(c, op);
     }
-    else if ( mode == 2) {
-        printf("%04X: %-15s  I:%03X  SP:%02X  DT:%02X  ST:%02X\n",
-               c->PC-2, mnem, c->I, c->SP, c->DT, c->ST);
-        for (int i = 0; i < 16; ++i) {
-            printf("│ V%-2X:%02X%s", i, c->regs[i], (i==7||i==15)?" │\n":"");
-        }
-        debug_sbs();
-    }
-}
\ No newline at end of file
+}
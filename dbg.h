@@ -1,11 +1,30 @@
 #ifndef DBG_H
 #define DBG_H
 
+#include <stdio.h>
 #include "chip8.h"
 
-void debug_init(int mode);
+/* One decoded trace record: the state before the instruction at pc ran */
+typedef struct {
+    uint16_t pc;
+    uint16_t op;
+    uint16_t I;
+    uint8_t  SP;
+    uint8_t  DT;
+    uint8_t  ST;
+    uint8_t  regs[16];
+} trace_rec_t;
+
+#define TRACE_MAGIC     "C8TR"
+#define TRACE_VERSION   1
+
+void debug_init(int mode, int keep_millions);
 void debug_log(chip8_t *c, uint16_t op);
-void debug_sbs(void);
+const chip8_hooks_t *debug_hooks(void);
 void debug_destroy(void);
 
-#endif
\ No newline at end of file
+const char *opcode(char *buf, size_t len, uint16_t op);
+size_t trace_decode(const uint8_t *p, size_t len, trace_rec_t *r);
+void trace_print(FILE *f, const trace_rec_t *r);
+
+#endif
@@ -0,0 +1,123 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "engine.h"
+#include "cache.h"
+#include "jit.h"
+
+struct engine {
+    engine_kind_t kind;
+    cache_t      *cache;
+    jit_t        *jit;
+    bool          idle;         /* skip idle loops */
+    uint64_t      skipped;
+};
+
+/* Idle loops are looked for at most this many cycles apart */
+#define IDLE_SLICE  1024
+
+static const char *names[ENGINE_COUNT] = { "switch", "cache", "jit" };
+
+
+engine_t* engine_init(engine_kind_t kind, unsigned flags)
+{
+    engine_t *e = calloc(1, sizeof *e);
+    if (!e) return NULL;
+
+    e->kind = kind;
+    e->idle = !(flags & ENGINE_NOIDLE);
+    if ((kind == ENGINE_CACHE && !(e->cache = cache_init())) ||
+        (kind == ENGINE_JIT   && !(e->jit = jit_init(flags & ENGINE_VERIFY)))) {
+        free(e);
+        return NULL;
+    }
+    return e;
+}
+
+void engine_destroy(engine_t *e)
+{
+    if (!e) return;
+    cache_destroy(e->cache);
+    jit_destroy(e->jit);
+    free(e);
+}
+
+static void run(engine_t *e, chip8_t *c, uint64_t cycles)
+{
+    /* the translators know the default profile only */
+    switch (c->profile ? ENGINE_SWITCH : e->kind) {
+        case ENGINE_CACHE:
+            cache_run(e->cache, c, cycles);
+            break;
+        case ENGINE_JIT:
+            jit_run(e->jit, c, cycles);
+            break;
+        default:
+            chip8_run(c, cycles);
+            break;
+    }
+}
+
+void engine_run(engine_t *e, chip8_t *c, uint64_t cycles)
+{
+    /* only the interpreter reports to hooks, and it sees every cycle */
+    if (c->hooks) {
+        chip8_run(c, cycles);
+        return;
+    }
+    if (!e->idle) {
+        run(e, c, cycles);
+        return;
+    }
+
+    /*
+     * Nothing outside the core changes during this call, so once PC is in
+     * an idle loop every remaining whole iteration is a no-op: account
+     * for them and only execute the partial one, which keeps PC (and so
+     * the cycle count) exactly where plain execution would leave it.
+     */
+    while (cycles) {
+        int lead, len = chip8_idle_loop(c, &lead);
+        if (len && cycles > (uint64_t)lead) {
+            run(e, c, lead);
+            cycles -= lead;
+
+            uint64_t skip = cycles - cycles % len;
+            e->skipped += skip;
+            cycles     -= skip;
+            run(e, c, cycles);
+            return;
+        }
+        uint64_t n = cycles < IDLE_SLICE ? cycles : IDLE_SLICE;
+        run(e, c, n);
+        cycles -= n;
+    }
+}
+
+uint64_t engine_skipped(const engine_t *e)
+{
+    return e->skipped;
+}
+
+/* Must be called whenever memory is changed from outside the engine */
+void engine_invalidate(engine_t *e, uint16_t addr, uint32_t len)
+{
+    if (e->cache) cache_invalidate(e->cache, addr, len);
+    if (e->jit)   jit_invalidate(e->jit, addr, len);
+}
+
+bool engine_parse(const char *name, engine_kind_t *kind)
+{
+    for (int i = 0; i < ENGINE_COUNT; ++i) {
+        if (!strcmp(name, names[i])) {
+            *kind = (engine_kind_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* engine_name(engine_kind_t kind)
+{
+    return names[kind];
+}
@@ -0,0 +1,30 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stdbool.h>
+#include "chip8.h"
+
+typedef enum {
+    ENGINE_SWITCH,          /* chip8_cycle, reference interpreter     */
+    ENGINE_CACHE,           /* pre-decoded cache with threaded code   */
+    ENGINE_JIT,             /* x86-64 basic-block recompiler          */
+    ENGINE_COUNT
+} engine_kind_t;
+
+/* engine_init flags */
+#define ENGINE_VERIFY  0x1  /* check every translated block against chip8_cycle */
+#define ENGINE_NOIDLE  0x2  /* execute idle loops instead of skipping them     */
+
+typedef struct engine engine_t;
+
+engine_t* engine_init(engine_kind_t kind, unsigned flags);
+void engine_destroy(engine_t *e);
+void engine_run(engine_t *e, chip8_t *c, uint64_t cycles);
+void engine_invalidate(engine_t *e, uint16_t addr, uint32_t len);
+/* Cycles accounted for by idle-loop skipping rather than executed */
+uint64_t engine_skipped(const engine_t *e);
+
+bool engine_parse(const char *name, engine_kind_t *kind);
+const char* engine_name(engine_kind_t kind);
+
+#endif /* ENGINE_H */
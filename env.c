@@ -0,0 +1,380 @@
+/* env.c — batched environments over chip8_cycle, see env.h */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "env.h"
+#include "pack.h"
+#include "pool.h"
+
+#define ENV_CHUNK  64               /* environments per pool job */
+
+typedef struct {
+    chip8_t  *c;
+    int       carry;                /* of chip8_frame_cycles */
+    uint32_t  frames;               /* in this episode */
+    uint32_t  episode;
+    int       score, penalty;       /* at the last step */
+    bool      over;                 /* reset before the next step */
+} slot_t;
+
+struct env {
+    env_config_t cfg;
+    int          n;
+    chip8_t     *initial;           /* freshly loaded machine, copied on reset */
+    slot_t      *s;
+    pool_t      *pool;              /* kept from env_init to env_destroy */
+};
+
+/* Arguments of one batched call, shared by the pool's jobs */
+typedef struct {
+    env_t          *E;
+    const uint16_t *keys;           /* NULL – reset */
+    uint8_t        *obs;
+    float          *reward;
+    uint8_t        *done;
+} call_t;
+
+
+void env_config_default(env_config_t *cfg)
+{
+    memset(cfg, 0, sizeof *cfg);
+    cfg->profile       = -1;
+    cfg->frames        = 4;
+    cfg->obs           = ENV_OBS_BITS;
+    cfg->score.addr    = -1;
+    cfg->penalty.addr  = -1;
+    cfg->done_addr     = -1;
+    cfg->seed          = 1;
+}
+
+static bool parse_counter(const char *s, env_counter_t *ctr)
+{
+    char *end;
+    long  addr = strtol(s, &end, 0);
+
+    if (end == s || addr < 0 || addr >= MEM_SIZE) return false;
+    ctr->addr = addr;
+    if      (!*end || !strcmp(end, ":u8")) ctr->fmt = ENV_U8;
+    else if (!strcmp(end, ":u16"))         ctr->fmt = ENV_U16;
+    else if (!strcmp(end, ":bcd"))         ctr->fmt = ENV_BCD;
+    else return false;
+    return true;
+}
+
+static bool parse_done(const char *s, env_config_t *cfg)
+{
+    char *end;
+    long  addr = strtol(s, &end, 0), value = 1;
+
+    if (end == s || addr < 0 || addr >= MEM_SIZE) return false;
+    if (*end == ':') {
+        const char *v = end + 1;
+        value = strtol(v, &end, 0);
+        if (end == v || value < 0 || value > 0xFF) return false;
+    }
+    if (*end) return false;
+    cfg->done_addr  = addr;
+    cfg->done_value = value;
+    return true;
+}
+
+static bool parse_field(env_config_t *cfg, const char *tok)
+{
+    const char *eq = strchr(tok, '=');
+    if (!eq) return false;
+
+    size_t      klen = eq - tok;
+    const char *v    = eq + 1;
+
+#define KEY(k)  (klen == sizeof k - 1 && !strncmp(tok, k, klen))
+    if (KEY("rom")) {
+        if (strlen(v) >= sizeof cfg->rom) return false;
+        strcpy(cfg->rom, v);
+    }
+    else if (KEY("hz"))         cfg->hz = atoi(v);
+    else if (KEY("quirks")) {
+        chip8_profile_t p;
+        if (!chip8_profile_parse(v, &p)) return false;
+        cfg->profile = p;
+    }
+    else if (KEY("frames"))     cfg->frames = atoi(v);
+    else if (KEY("max_frames")) cfg->max_frames = strtoul(v, NULL, 0);
+    else if (KEY("seed"))       cfg->seed = strtoul(v, NULL, 0);
+    else if (KEY("threads"))    cfg->threads = atoi(v);
+    else if (KEY("score"))      return parse_counter(v, &cfg->score);
+    else if (KEY("penalty"))    return parse_counter(v, &cfg->penalty);
+    else if (KEY("done"))       return parse_done(v, cfg);
+    else if (KEY("obs")) {
+        if      (!strcmp(v, "bits"))  cfg->obs = ENV_OBS_BITS;
+        else if (!strcmp(v, "bytes")) cfg->obs = ENV_OBS_BYTES;
+        else return false;
+    }
+    else return false;
+#undef KEY
+    return true;
+}
+
+bool env_config_load(env_config_t *cfg, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) { perror(path); return false; }
+
+    char line[4096];
+    bool ok = true;
+    for (int n = 1; ok && fgets(line, sizeof line, f); ++n) {
+        line[strcspn(line, "\r\n")] = 0;
+        if (line[0] == '#') continue;
+
+        for (char *tok = strtok(line, " \t"); ok && tok; tok = strtok(NULL, " \t")) {
+            ok = parse_field(cfg, tok);
+            if (!ok) fprintf(stderr, "%s:%d: bad field '%s'\n", path, n, tok);
+        }
+    }
+    fclose(f);
+    return ok;
+}
+
+
+/* The ROM into m's memory at 0x200; a pack may also supply hz and the profile */
+static bool load_rom(const char *spec, chip8_t *m, int *hz, int *profile)
+{
+    char        path[4096];
+    const char *sel;
+
+    if (pack_spec(spec, path, sizeof path, &sel)) {
+        pack_t    *p = pack_open(path);
+        pack_rom_t r;
+        if (!p) return false;
+        bool found = pack_select(p, sel, &r);
+        if (found) {
+            chip8_profile_t prof;
+            memcpy(m->memory.memory + 0x200, r.data, r.size);
+            if (!*hz) *hz = r.hz;
+            if (*profile < 0 && !(found = chip8_profile_find(r.quirks, &prof)))
+                fprintf(stderr, "%s: no profile has quirks 0x%x\n", spec, (unsigned)r.quirks);
+            else if (*profile < 0)
+                *profile = prof;
+        }
+        else fprintf(stderr, "%s: no such ROM in the pack\n", spec);
+        pack_close(p);
+        return found;
+    }
+
+    FILE *f = fopen(spec, "rb");
+    if (!f) { perror(spec); return false; }
+    size_t size = fread(m->memory.memory + 0x200, 1, MEM_SIZE - 0x200, f);
+    fclose(f);
+    if (size == 0) {
+        fprintf(stderr, "%s: empty ROM\n", spec);
+        return false;
+    }
+    return true;
+}
+
+env_t* env_init(const env_config_t *cfg, int n)
+{
+    if (n < 1) return NULL;
+
+    env_t *E = calloc(1, sizeof *E);
+    if (!E) return NULL;
+    E->cfg = *cfg;
+    E->n   = n;
+    if (E->cfg.frames < 1) E->cfg.frames = 1;
+
+    E->initial = chip8_init();
+    if (!E->initial || !load_rom(cfg->rom, E->initial, &E->cfg.hz, &E->cfg.profile)) {
+        env_destroy(E);
+        return NULL;
+    }
+    if (!E->cfg.hz) E->cfg.hz = 500;
+    if (E->cfg.profile < 0) E->cfg.profile = PROFILE_DEFAULT;
+    chip8_set_profile(E->initial, E->cfg.profile);
+
+    E->s = calloc(n, sizeof *E->s);
+    if (!E->s) { env_destroy(E); return NULL; }
+    for (int i = 0; i < n; ++i) {
+        E->s[i].c = malloc(sizeof *E->s[i].c);
+        if (!E->s[i].c) { env_destroy(E); return NULL; }
+        E->s[i].over = true;
+        E->s[i].episode = (uint32_t)-1;     /* the first reset makes it 0 */
+    }
+
+    /* no more threads than chunks: the rest would only spin stealing */
+    int jobs    = (n + ENV_CHUNK - 1) / ENV_CHUNK;
+    int threads = E->cfg.threads > 0 ? E->cfg.threads : pool_cpus();
+    if (!(E->pool = pool_init(threads < jobs ? threads : jobs))) {
+        env_destroy(E);
+        return NULL;
+    }
+    return E;
+}
+
+void env_destroy(env_t *E)
+{
+    if (!E) return;
+    pool_destroy(E->pool);
+    for (int i = 0; E->s && i < E->n; ++i)
+        free(E->s[i].c);
+    free(E->s);
+    chip8_destroy(E->initial);
+    free(E);
+}
+
+int env_count(const env_t *E)
+{
+    return E->n;
+}
+
+size_t env_obs_size(const env_t *E)
+{
+    return E->cfg.obs == ENV_OBS_BYTES ? 64 * 32 : 64 * 32 / 8;
+}
+
+const chip8_t* env_machine(const env_t *E, int i)
+{
+    return E->s[i].c;
+}
+
+
+static int counter(const chip8_t *c, const env_counter_t *ctr)
+{
+    const uint8_t *m = c->memory.memory;
+    uint16_t       a = ctr->addr;
+
+    if (ctr->addr < 0) return 0;
+    switch (ctr->fmt) {
+        case ENV_U16: return m[a] << 8 | m[(uint16_t)(a + 1)];
+        case ENV_BCD: return m[a] * 100 + m[(uint16_t)(a + 1)] * 10 + m[(uint16_t)(a + 2)];
+        default:      return m[a];
+    }
+}
+
+static bool ended(const env_t *E, const slot_t *s)
+{
+    const chip8_t *c = s->c;
+    const uint8_t *m = c->memory.memory;
+
+    if (E->cfg.done_addr >= 0 && m[E->cfg.done_addr] == E->cfg.done_value) return true;
+    if (m[c->PC] == 0x00 && m[(uint16_t)(c->PC + 1)] == 0xFD) return true;
+    return E->cfg.max_frames && s->frames >= E->cfg.max_frames;
+}
+
+/* Bit i of the result is bits 2i and 2i+1 of v or'ed: a hires row pair to lores */
+static uint32_t fold(uint64_t v)
+{
+    v = (v | v >> 1)  & 0x5555555555555555ULL;
+    v = (v | v >> 1)  & 0x3333333333333333ULL;
+    v = (v | v >> 2)  & 0x0F0F0F0F0F0F0F0FULL;
+    v = (v | v >> 4)  & 0x00FF00FF00FF00FFULL;
+    v = (v | v >> 8)  & 0x0000FFFF0000FFFFULL;
+    v = (v | v >> 16) & 0x00000000FFFFFFFFULL;
+    return v;
+}
+
+static void observe(const env_t *E, const chip8_t *c, uint8_t *out)
+{
+    if (E->cfg.obs == ENV_OBS_BYTES) {
+        int s = c->hires ? 2 : 1;
+        for (int y = 0; y < 32; ++y)
+            for (int x = 0; x < 64; ++x) {
+                int p = chip8_pixel(c, s * x, s * y);
+                if (c->hires)
+                    p |= chip8_pixel(c, 2 * x + 1, 2 * y) | chip8_pixel(c, 2 * x, 2 * y + 1) |
+                         chip8_pixel(c, 2 * x + 1, 2 * y + 1);
+                *out++ = p;
+            }
+        return;
+    }
+
+    for (int y = 0; y < 32; ++y) {
+        uint64_t row;
+        if (!c->hires) {
+            row = c->FB[0][y][0] | c->FB[1][y][0];
+        } else {
+            uint64_t l = 0, r = 0;
+            for (int p = 0; p < 2; ++p)
+                for (int k = 0; k < 2; ++k) {
+                    l |= c->FB[p][2 * y + k][0];
+                    r |= c->FB[p][2 * y + k][1];
+                }
+            row = (uint64_t)fold(l) << 32 | fold(r);
+        }
+        for (int b = 56; b >= 0; b -= 8)
+            *out++ = row >> b;
+    }
+}
+
+static void reset_one(env_t *E, int i)
+{
+    slot_t *s = &E->s[i];
+
+    *s->c = *E->initial;
+    s->episode++;
+    chip8_seed(s->c, E->cfg.seed + s->episode * (uint32_t)E->n + (uint32_t)i);
+    s->carry   = 0;
+    s->frames  = 0;
+    s->score   = counter(s->c, &E->cfg.score);
+    s->penalty = counter(s->c, &E->cfg.penalty);
+    s->over    = false;
+}
+
+static void step_one(env_t *E, int i, uint16_t keys, float *reward, uint8_t *done)
+{
+    slot_t  *s = &E->s[i];
+    chip8_t *c;
+
+    if (s->over) reset_one(E, i);
+    c = s->c;
+    for (int k = 0; k < 16; ++k)
+        c->keypad[k] = keys >> k & 1;
+
+    for (int f = 0; f < E->cfg.frames && !s->over; ++f) {
+        chip8_run(c, chip8_frame_cycles(E->cfg.hz, &s->carry));
+        chip8_update(c);
+        s->frames++;
+        s->over = ended(E, s);
+    }
+
+    int score = counter(c, &E->cfg.score), penalty = counter(c, &E->cfg.penalty);
+    *reward    = (score - s->score) - (penalty - s->penalty);
+    *done      = s->over;
+    s->score   = score;
+    s->penalty = penalty;
+}
+
+static void run_chunk(void *ctx, size_t job, int worker)
+{
+    call_t *a    = ctx;
+    env_t  *E    = a->E;
+    size_t  size = env_obs_size(E);
+    int     lo   = job * ENV_CHUNK, hi = lo + ENV_CHUNK < E->n ? lo + ENV_CHUNK : E->n;
+    (void)worker;
+
+    for (int i = lo; i < hi; ++i) {
+        if (a->keys) step_one(E, i, a->keys[i], &a->reward[i], &a->done[i]);
+        else reset_one(E, i);
+        observe(E, E->s[i].c, a->obs + i * size);
+    }
+}
+
+/* Chunks of environments share nothing, so any thread may take any */
+static void run_all(call_t *a)
+{
+    size_t jobs = (a->E->n + ENV_CHUNK - 1) / ENV_CHUNK;
+    pool_exec(a->E->pool, jobs, run_chunk, a);
+}
+
+void env_reset(env_t *E, uint8_t *obs)
+{
+    call_t a = { .E = E, .obs = obs };
+    run_all(&a);
+}
+
+void env_step(env_t *E, const uint16_t *keys, uint8_t *obs, float *reward, uint8_t *done)
+{
+    call_t a = { .E = E, .keys = keys, .obs = obs, .reward = reward, .done = done };
+    run_all(&a);
+}
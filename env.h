@@ -0,0 +1,78 @@
+#ifndef ENV_H
+#define ENV_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chip8.h"
+
+/*
+ * Batched environments for training agents: n copies of one ROM, reset
+ * and stepped together.  An action is a keypad bitmask (bit k – key k)
+ * held for `frames` 60 Hz frames.  The reward is the change of a score
+ * kept in the ROM's RAM, minus the change of an optional penalty
+ * counter; an episode ends when a RAM byte takes a given value, when
+ * the ROM executes 00FD, or after max_frames.  Observations go straight
+ * into the caller's buffer, env_obs_size bytes per environment:
+ *
+ *   ENV_OBS_BITS   64x32, 8 bytes per row, MSB is x=0
+ *   ENV_OBS_BYTES  64x32, one byte per pixel, 0 off or XO-CHIP colour 1..3
+ *
+ * Hires screens are folded to 64x32, a pixel lit if any of its 2x2 is.
+ */
+#define ENV_OBS_BITS   0
+#define ENV_OBS_BYTES  1
+
+#define ENV_U8    0                 /* counter formats */
+#define ENV_U16   1                 /* big endian, as the ROM would store it */
+#define ENV_BCD   2                 /* three digits, as Fx33 writes them */
+
+typedef struct {
+    int       addr;                 /* -1 – not used */
+    int       fmt;
+} env_counter_t;
+
+typedef struct {
+    char          rom[4096];        /* path or pack.c8p:name / pack.c8p#hash */
+    int           hz;               /* 0 – the pack's, else 500 */
+    int           profile;          /* chip8_profile_t, -1 – the pack's, else default */
+    int           frames;           /* frames an action is held */
+    uint32_t      max_frames;       /* episode length limit, 0 – none */
+    int           obs;              /* ENV_OBS_* */
+    env_counter_t score;            /* reward: its increase */
+    env_counter_t penalty;          /* minus its increase */
+    int           done_addr;        /* -1 – not used */
+    uint8_t       done_value;
+    uint32_t      seed;             /* episode e of env i is seeded seed + e * n + i */
+    int           threads;          /* 0 – all cores */
+} env_config_t;
+
+typedef struct env env_t;
+
+void env_config_default(env_config_t *cfg);
+/*
+ * Reads key=value fields separated by blanks or newlines, '#' starts a
+ * comment line: rom hz quirks frames max_frames obs=bits|bytes seed threads
+ * score=ADDR[:u8|u16|bcd] penalty=ADDR[:fmt] done=ADDR[:VALUE]
+ */
+bool env_config_load(env_config_t *cfg, const char *path);
+
+/* NULL (with a message) if the ROM can't be loaded */
+env_t* env_init(const env_config_t *cfg, int n);
+void env_destroy(env_t *E);
+int    env_count(const env_t *E);
+size_t env_obs_size(const env_t *E);
+
+/* New episodes everywhere, obs: env_count * env_obs_size bytes */
+void env_reset(env_t *E, uint8_t *obs);
+/*
+ * One action per environment.  An environment that reported done is
+ * reset before its action is applied, so a batch never stalls.
+ */
+void env_step(env_t *E, const uint16_t *keys, uint8_t *obs, float *reward, uint8_t *done);
+
+/* The machine behind environment i, read only */
+const chip8_t* env_machine(const env_t *E, int i);
+
+#endif /* ENV_H */
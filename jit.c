@@ -0,0 +1,393 @@
+#define _DEFAULT_SOURCE
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jit.h"
+
+#if defined(__x86_64__)
+
+#include <sys/mman.h>
+
+#define JIT_HOT       16          /* interpreted visits before translating */
+#define JIT_COLD      0xFF        /* hot[] marker: block start not translatable */
+#define JIT_MAXOPS    64          /* CHIP-8 instructions per block */
+#define JIT_OPCODE    (7 + 16 * 16)   /* most x86 one op emits: FF65 */
+#define JIT_TAIL      10          /* set_pc + ret closing a block */
+#define JIT_BUFSIZE   (1 << 20)
+
+typedef void (*block_fn)(chip8_t *c);
+
+typedef struct {
+    uint8_t  *code;
+    uint32_t  end;                /* first address after what the block read */
+    uint8_t   len;                /* instructions executed by one call */
+} block_t;
+
+struct jit {
+    block_t   blocks[MEM_SIZE / 2];
+    uint8_t   hot[MEM_SIZE / 2];
+    uint8_t  *buf;
+    size_t    used;
+    uint8_t  *p;                  /* emit cursor */
+
+    bool      verify;
+    chip8_t   shadow;
+    uint64_t  mismatches;
+};
+
+/* chip8_t field offsets, addressed as [rdi + disp32] */
+#define OFF_PC     offsetof(chip8_t, PC)
+#define OFF_MEM    offsetof(chip8_t, memory.memory)
+#define OFF_V(r)   (offsetof(chip8_t, regs) + (r))
+#define OFF_I      offsetof(chip8_t, I)
+#define OFF_DT     offsetof(chip8_t, DT)
+#define OFF_ST     offsetof(chip8_t, ST)
+#define OFF_KEY    offsetof(chip8_t, keypad)
+
+enum { AL = 0, CL = 1 };
+
+
+jit_t* jit_init(bool verify)
+{
+    jit_t *j = calloc(1, sizeof *j);
+    if (!j) return NULL;
+
+    j->buf = mmap(NULL, JIT_BUFSIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (j->buf == MAP_FAILED) {
+        perror("jit: mmap");
+        free(j);
+        return NULL;
+    }
+    j->verify = verify;
+    return j;
+}
+
+void jit_destroy(jit_t *j)
+{
+    if (!j) return;
+    if (j->verify)
+        fprintf(stderr, "jit: %llu block mismatches\n",
+                (unsigned long long)j->mismatches);
+    munmap(j->buf, JIT_BUFSIZE);
+    free(j);
+}
+
+static void jit_flush(jit_t *j)
+{
+    memset(j->blocks, 0, sizeof j->blocks);
+    memset(j->hot, 0, sizeof j->hot);
+    j->used = 0;
+}
+
+/* Drop every block overlapping [addr, addr+len) */
+void jit_invalidate(jit_t *j, uint16_t addr, uint32_t len)
+{
+    uint32_t lo = addr > 2 * JIT_MAXOPS ? addr - 2 * JIT_MAXOPS : 0;
+    uint32_t hi = (uint32_t)addr + (len < MEM_SIZE ? len : MEM_SIZE);
+
+    if (hi > MEM_SIZE) jit_invalidate(j, 0, hi - MEM_SIZE);    /* wrapped */
+
+    for (uint32_t s = lo & ~1u; s < hi && s < MEM_SIZE; s += 2) {
+        block_t *b = &j->blocks[s >> 1];
+        if (b->code ? b->end > addr : s + 2 > addr) {
+            b->code = NULL;
+            j->hot[s >> 1] = 0;
+        }
+    }
+}
+
+
+/* Emitters */
+static void e8(jit_t *j, uint8_t v)   { *j->p++ = v; }
+static void e16(jit_t *j, uint16_t v) { memcpy(j->p, &v, 2); j->p += 2; }
+static void e32(jit_t *j, uint32_t v) { memcpy(j->p, &v, 4); j->p += 4; }
+
+/* opcode byte(s) already emitted; ModRM for [rdi + disp32] */
+static void mem(jit_t *j, int reg, size_t disp)
+{
+    e8(j, 0x80 | (reg << 3) | 7);
+    e32(j, (uint32_t)disp);
+}
+
+static void load8(jit_t *j, int reg, size_t d)   { e8(j, 0x8A); mem(j, reg, d); }
+static void store8(jit_t *j, int reg, size_t d)  { e8(j, 0x88); mem(j, reg, d); }
+
+static void store16i(jit_t *j, size_t d, uint16_t v)
+{
+    e8(j, 0x66); e8(j, 0xC7); mem(j, 0, d); e16(j, v);
+}
+
+static void set_pc(jit_t *j, uint16_t pc) { store16i(j, OFF_PC, pc); }
+static void ret(jit_t *j)                 { e8(j, 0xC3); }
+
+/* Two-way exit: PC = skip ? past the next op : pc+2, jcc is the "skip"
+   condition; the next op's length is read now, its block covers it */
+static void skip_exit(jit_t *j, const chip8_t *c, uint8_t jcc, uint16_t pc)
+{
+    set_pc(j, pc + 2 + chip8_oplen(c, pc + 2));
+    e8(j, jcc); e8(j, 9);         /* over the 9-byte store below */
+    set_pc(j, pc + 2);
+    ret(j);
+}
+
+/*
+ * Emit one instruction.  Returns 1 if it continues the block, 2 if it
+ * ends it (control flow, exit already emitted), 0 if not translatable.
+ * Flag-producing ALU ops follow chip8_cycle's statement order exactly,
+ * including the re-read of Vx after VF is written.
+ */
+static int emit_op(jit_t *j, const chip8_t *c, uint16_t op, uint16_t pc)
+{
+    uint8_t x  = (op >> 8) & 0xF;
+    uint8_t y  = (op >> 4) & 0xF;
+    uint8_t kk = op & 0xFF;
+    uint16_t nnn = op & 0xFFF;
+
+    switch (op & 0xF000) {
+        case 0x1000:
+            set_pc(j, nnn); ret(j);
+            return 2;
+
+        case 0x3000:
+            e8(j, 0x80); mem(j, 7, OFF_V(x)); e8(j, kk);     /* cmp [Vx], kk */
+            skip_exit(j, c, 0x74, pc);                          /* je */
+            return 2;
+
+        case 0x4000:
+            e8(j, 0x80); mem(j, 7, OFF_V(x)); e8(j, kk);
+            skip_exit(j, c, 0x75, pc);                          /* jne */
+            return 2;
+
+        case 0x5000:
+        case 0x9000:
+            if (op & 0xF) return 0;                          /* 5xy2/5xy3 */
+            load8(j, AL, OFF_V(x));
+            e8(j, 0x3A); mem(j, AL, OFF_V(y));               /* cmp al, [Vy] */
+            skip_exit(j, c, (op & 0xF000) == 0x5000 ? 0x74 : 0x75, pc);
+            return 2;
+
+        case 0x6000:
+            e8(j, 0xC6); mem(j, 0, OFF_V(x)); e8(j, kk);     /* mov [Vx], kk */
+            return 1;
+
+        case 0x7000:
+            e8(j, 0x80); mem(j, 0, OFF_V(x)); e8(j, kk);     /* add [Vx], kk */
+            return 1;
+
+        case 0x8000:
+            switch (op & 0xF) {
+                case 0x0:
+                    load8(j, AL, OFF_V(y)); store8(j, AL, OFF_V(x));
+                    return 1;
+                case 0x1: case 0x2: case 0x3: {
+                    static const uint8_t alu[] = { 0, 0x08, 0x20, 0x30 };
+                    load8(j, AL, OFF_V(y));
+                    e8(j, alu[op & 0xF]); mem(j, AL, OFF_V(x));   /* op [Vx], al */
+                    return 1;
+                }
+                case 0x4:
+                    load8(j, AL, OFF_V(x));
+                    e8(j, 0x02); mem(j, AL, OFF_V(y));       /* add al, [Vy] */
+                    e8(j, 0x0F); e8(j, 0x92); e8(j, 0xC1);   /* setc cl */
+                    store8(j, CL, OFF_V(0xF));
+                    store8(j, AL, OFF_V(x));
+                    return 1;
+                case 0x5:
+                case 0x7: {
+                    uint8_t a = (op & 0xF) == 0x5 ? x : y;
+                    uint8_t b = (op & 0xF) == 0x5 ? y : x;
+                    load8(j, AL, OFF_V(a));
+                    e8(j, 0x3A); mem(j, AL, OFF_V(b));       /* cmp al, [b] */
+                    e8(j, 0x0F); e8(j, 0x93); e8(j, 0xC1);   /* setae cl */
+                    store8(j, CL, OFF_V(0xF));
+                    load8(j, AL, OFF_V(a));
+                    e8(j, 0x2A); mem(j, AL, OFF_V(b));       /* sub al, [b] */
+                    store8(j, AL, OFF_V(x));
+                    return 1;
+                }
+                case 0x6:
+                    load8(j, AL, OFF_V(x));
+                    e8(j, 0x24); e8(j, 0x01);                /* and al, 1 */
+                    store8(j, AL, OFF_V(0xF));
+                    load8(j, AL, OFF_V(x));
+                    e8(j, 0xD0); e8(j, 0xE8);                /* shr al, 1 */
+                    store8(j, AL, OFF_V(x));
+                    return 1;
+                case 0xE:
+                    load8(j, AL, OFF_V(x));
+                    e8(j, 0xC0); e8(j, 0xE8); e8(j, 7);      /* shr al, 7 */
+                    store8(j, AL, OFF_V(0xF));
+                    load8(j, AL, OFF_V(x));
+                    e8(j, 0x00); e8(j, 0xC0);                /* add al, al */
+                    store8(j, AL, OFF_V(x));
+                    return 1;
+            }
+            return 0;
+
+        case 0xA000:
+            store16i(j, OFF_I, nnn);
+            return 1;
+
+        case 0xE000:
+            if (kk != 0x9E && kk != 0xA1) return 0;
+            e8(j, 0x0F); e8(j, 0xB6); mem(j, AL, OFF_V(x));  /* movzx eax, [Vx] */
+            e8(j, 0x83); e8(j, 0xE0); e8(j, 0x0F);           /* and eax, 15 */
+            e8(j, 0x80); e8(j, 0xBC); e8(j, 0x07);           /* cmp [rdi+rax+d], 0 */
+            e32(j, (uint32_t)OFF_KEY); e8(j, 0);
+            skip_exit(j, c, kk == 0x9E ? 0x75 : 0x74, pc);
+            return 2;
+
+        case 0xF000:
+            switch (kk) {
+                case 0x07:
+                    load8(j, AL, OFF_DT); store8(j, AL, OFF_V(x));
+                    return 1;
+                case 0x15:
+                    load8(j, AL, OFF_V(x)); store8(j, AL, OFF_DT);
+                    return 1;
+                case 0x18:
+                    load8(j, AL, OFF_V(x)); store8(j, AL, OFF_ST);
+                    return 1;
+                case 0x1E:
+                    e8(j, 0x0F); e8(j, 0xB6); mem(j, AL, OFF_V(x));
+                    e8(j, 0x66); e8(j, 0x01); mem(j, AL, OFF_I);   /* add [I], ax */
+                    return 1;
+                case 0x29:
+                    e8(j, 0x0F); e8(j, 0xB6); mem(j, AL, OFF_V(x));
+                    e8(j, 0x8D); e8(j, 0x04); e8(j, 0x80);   /* lea eax, [rax+rax*4] */
+                    e8(j, 0x66); e8(j, 0x89); mem(j, AL, OFF_I);   /* mov [I], ax */
+                    return 1;
+                case 0x65:
+                    /* 16-bit increments, so I+i wraps like MEM_SIZE does */
+                    e8(j, 0x0F); e8(j, 0xB7); mem(j, AL, OFF_I);   /* movzx eax, word [I] */
+                    for (int i = 0; i <= x; ++i) {
+                        if (i) { e8(j, 0x66); e8(j, 0xFF); e8(j, 0xC0); }   /* inc ax */
+                        e8(j, 0x8A); e8(j, 0x8C); e8(j, 0x07);     /* mov cl, [rdi+rax+d] */
+                        e32(j, (uint32_t)OFF_MEM);
+                        store8(j, CL, OFF_V(i));
+                    }
+                    return 1;
+            }
+            return 0;
+    }
+    /* 00E0/00EE, 2nnn, Bnnn, Cxkk, Dxyn, Fx0A, Fx33, Fx55 and the
+       SUPER-CHIP/XO-CHIP opcodes: interpreter */
+    return 0;
+}
+
+static bool translate(jit_t *j, const chip8_t *c, uint16_t start)
+{
+    if (j->used + JIT_OPCODE + JIT_TAIL > JIT_BUFSIZE) jit_flush(j);
+
+    uint8_t *code = j->buf + j->used;
+    uint32_t pc = start;
+    int      n  = 0;
+    j->p = code;
+
+    while (n < JIT_MAXOPS && pc < MEM_SIZE - 1) {
+        /* end the block early rather than run off the buffer */
+        if ((size_t)(j->p - j->buf) + JIT_OPCODE + JIT_TAIL > JIT_BUFSIZE) break;
+        uint16_t op = (c->memory.memory[pc] << 8) | c->memory.memory[pc + 1];
+        uint8_t *mark = j->p;
+        int r = emit_op(j, c, op, pc);
+        if (r == 0) { j->p = mark; break; }
+        ++n;
+        pc += 2;
+        if (r == 2) { pc += 2; goto done; }     /* skips read the next op */
+    }
+    if (n == 0) return false;
+    set_pc(j, pc);
+    ret(j);
+
+done:
+    j->blocks[start >> 1].code = code;
+    j->blocks[start >> 1].end  = pc;
+    j->blocks[start >> 1].len  = n;
+    j->used += j->p - code;
+    return true;
+}
+
+static void exec(const block_t *b, chip8_t *c)
+{
+    union { uint8_t *p; block_fn fn; } u = { .p = b->code };
+    u.fn(c);
+}
+
+/* Run the block and the interpreter on a copy, keep the interpreter's state */
+static void exec_verified(jit_t *j, const block_t *b, chip8_t *c)
+{
+    uint16_t pc = c->PC;
+    j->shadow = *c;
+    exec(b, c);
+    for (int i = 0; i < b->len; ++i)
+        chip8_cycle(&j->shadow);
+
+    if (memcmp(c, &j->shadow, sizeof *c) != 0) {
+        if (j->mismatches++ < 16)
+            fprintf(stderr, "jit: block %03X (%d ops) diverges from interpreter\n",
+                    pc, b->len);
+        *c = j->shadow;
+    }
+}
+
+static void interp(jit_t *j, chip8_t *c)
+{
+    uint16_t pc = c->PC & (MEM_SIZE - 1);
+    uint16_t op = (c->memory.memory[pc] << 8) | c->memory.memory[(pc + 1) & (MEM_SIZE - 1)];
+
+    chip8_cycle(c);
+    if ((op & 0xF0FF) == 0xF033) jit_invalidate(j, c->I, 3);
+    if ((op & 0xF0FF) == 0xF055) jit_invalidate(j, c->I, ((op >> 8) & 0xF) + 1);
+    if ((op & 0xF00F) == 0x5002) {
+        int x = (op >> 8) & 0xF, y = (op >> 4) & 0xF;
+        jit_invalidate(j, c->I, (x > y ? x - y : y - x) + 1);
+    }
+}
+
+void jit_run(jit_t *j, chip8_t *c, uint64_t cycles)
+{
+    while (cycles > 0) {
+        uint16_t pc = c->PC;
+
+        if (!(pc & 1) && pc < MEM_SIZE - 1) {
+            block_t *b = &j->blocks[pc >> 1];
+            uint8_t *h = &j->hot[pc >> 1];
+
+            if (b->code) {
+                /* only whole blocks, so callers' cycle budgets stay exact */
+                if (b->len <= cycles) {
+                    if (j->verify) exec_verified(j, b, c);
+                    else           exec(b, c);
+                    cycles -= b->len;
+                    continue;
+                }
+            } else if (*h < JIT_HOT) {
+                ++*h;
+            } else if (*h == JIT_HOT) {
+                if (translate(j, c, pc)) continue;
+                *h = JIT_COLD;
+            }
+        }
+        interp(j, c);
+        --cycles;
+    }
+}
+
+#else /* !__x86_64__ */
+
+jit_t* jit_init(bool verify)
+{
+    (void)verify;
+    fprintf(stderr, "jit: only available on x86-64\n");
+    return NULL;
+}
+
+void jit_destroy(jit_t *j) { (void)j; }
+void jit_invalidate(jit_t *j, uint16_t addr, uint32_t len) { (void)j; (void)addr; (void)len; }
+void jit_run(jit_t *j, chip8_t *c, uint64_t cycles) { (void)j; (void)c; (void)cycles; }
+
+#endif
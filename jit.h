@@ -0,0 +1,19 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdbool.h>
+#include "chip8.h"
+
+/*
+ * x86-64 basic-block recompiler.  Hot blocks are translated to native
+ * code operating on chip8_t in place; anything else runs through
+ * chip8_cycle.  jit_init returns NULL on other hosts.
+ */
+typedef struct jit jit_t;
+
+jit_t* jit_init(bool verify);
+void jit_destroy(jit_t *j);
+void jit_invalidate(jit_t *j, uint16_t addr, uint32_t len);
+void jit_run(jit_t *j, chip8_t *c, uint64_t cycles);
+
+#endif /* JIT_H */
@@ -0,0 +1,619 @@
+/* lanes.c — lockstep structure-of-arrays engine, see lanes.h */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lanes.h"
+
+struct lanes {
+    int        n;
+    int        cap;                 /* n rounded up to LANES_BLOCK */
+    uint16_t  *PC, *I;              /* [cap] */
+    uint8_t   *V;                   /* [16][cap] */
+    uint8_t   *SP, *DT, *ST;
+    uint32_t  *rng;
+    uint16_t  *budget;              /* instructions left in this run */
+    uint8_t   *ready;               /* 0xFF: budget left; never for the padding */
+    int        left;                /* ready lanes */
+    chip8_t  **c;                   /* everything else of a lane; its registers
+                                       are only current around chip8_cycle */
+
+    uint8_t   *mask;                /* 0xFF: lane in this step's group */
+    uint8_t   *busy;                /* per block: has group lanes */
+    int        count;               /* lanes in the group */
+    int        first;               /* lowest of them */
+
+    uint8_t    written[MEM_SIZE / 8];   /* code some lane may have changed */
+    lanes_stats_t stats;
+};
+
+
+static void *zalloc(size_t bytes)
+{
+    void *p;
+    if (posix_memalign(&p, 128, bytes) != 0) return NULL;
+    return memset(p, 0, bytes);
+}
+
+lanes_t* lanes_init(int n, const uint8_t *rom, size_t size)
+{
+    if (n < 1 || size > MEM_SIZE - 0x200) return NULL;
+
+    lanes_t *L = calloc(1, sizeof *L);
+    if (!L) return NULL;
+
+    int cap = (n + LANES_BLOCK - 1) / LANES_BLOCK * LANES_BLOCK;
+    L->n    = n;
+    L->cap  = cap;
+    L->PC   = zalloc(cap * sizeof *L->PC);
+    L->I    = zalloc(cap * sizeof *L->I);
+    L->V    = zalloc(16 * cap);
+    L->SP   = zalloc(cap);
+    L->DT   = zalloc(cap);
+    L->ST   = zalloc(cap);
+    L->rng  = zalloc(cap * sizeof *L->rng);
+    L->budget = zalloc(cap * sizeof *L->budget);
+    L->ready  = zalloc(cap);
+    L->mask = zalloc(cap);
+    L->busy = zalloc(cap / LANES_BLOCK);
+    L->c    = calloc(n, sizeof *L->c);
+    if (!L->PC || !L->I || !L->V || !L->SP || !L->DT || !L->ST || !L->rng ||
+        !L->budget || !L->ready || !L->mask || !L->busy || !L->c) {
+        lanes_destroy(L);
+        return NULL;
+    }
+
+    for (int l = 0; l < n; ++l) {
+        chip8_t *c = L->c[l] = chip8_init();
+        if (!c) { lanes_destroy(L); return NULL; }
+        memcpy(c->memory.memory + 0x200, rom, size);
+        chip8_seed(c, 1);
+        L->PC[l]   = c->PC;
+        L->rng[l]  = c->rng;
+    }
+    return L;
+}
+
+void lanes_destroy(lanes_t *L)
+{
+    if (!L) return;
+    for (int l = 0; L->c && l < L->n; ++l)
+        chip8_destroy(L->c[l]);
+    free(L->c);
+    free(L->PC);  free(L->I);  free(L->V);
+    free(L->SP);  free(L->DT); free(L->ST);
+    free(L->rng); free(L->budget); free(L->ready);
+    free(L->mask); free(L->busy);
+    free(L);
+}
+
+int lanes_count(const lanes_t *L)
+{
+    return L->n;
+}
+
+void lanes_seed(lanes_t *L, int lane, uint32_t seed)
+{
+    chip8_seed(L->c[lane], seed);
+    L->rng[lane] = L->c[lane]->rng;
+}
+
+uint8_t* lanes_keypad(lanes_t *L, int lane)
+{
+    return L->c[lane]->keypad;
+}
+
+
+static void sync_in(lanes_t *L, int l)
+{
+    chip8_t *c = L->c[l];
+    c->PC  = L->PC[l];
+    c->I   = L->I[l];
+    c->SP  = L->SP[l];
+    c->DT  = L->DT[l];
+    c->ST  = L->ST[l];
+    c->rng = L->rng[l];
+    for (int r = 0; r < 16; ++r)
+        c->regs[r] = L->V[r * L->cap + l];
+}
+
+static void sync_out(lanes_t *L, int l)
+{
+    const chip8_t *c = L->c[l];
+    L->PC[l]  = c->PC;
+    L->I[l]   = c->I;
+    L->SP[l]  = c->SP;
+    L->DT[l]  = c->DT;
+    L->ST[l]  = c->ST;
+    L->rng[l] = c->rng;
+    for (int r = 0; r < 16; ++r)
+        L->V[r * L->cap + l] = c->regs[r];
+}
+
+const chip8_t* lanes_get(lanes_t *L, int lane)
+{
+    sync_in(L, lane);
+    return L->c[lane];
+}
+
+
+/* Bytes no lane has written since the ROM was loaded are the same in all */
+static bool shared(const lanes_t *L, uint16_t addr, int len)
+{
+    for (uint16_t a = addr; len--; ++a)
+        if (L->written[a >> 3] & (1 << (a & 7))) return false;
+    return true;
+}
+
+static void mark(lanes_t *L, uint16_t addr, int len)
+{
+    for (uint16_t a = addr; len--; ++a)
+        L->written[a >> 3] |= 1 << (a & 7);
+}
+
+/* One instruction of one lane, through the reference interpreter */
+static void scalar(lanes_t *L, int l)
+{
+    chip8_t *c = L->c[l];
+
+    sync_in(L, l);
+    uint16_t op = (c->memory.memory[c->PC] << 8) | c->memory.memory[(uint16_t)(c->PC + 1)];
+    chip8_cycle(c);
+    sync_out(L, l);
+
+    if ((op & 0xF0FF) == 0xF033) mark(L, c->I, 3);
+    if ((op & 0xF0FF) == 0xF055) mark(L, c->I, ((op >> 8) & 0xF) + 1);
+    if ((op & 0xF00F) == 0x5002) {
+        int x = (op >> 8) & 0xF, y = (op >> 4) & 0xF;
+        mark(L, c->I, (x > y ? x - y : y - x) + 1);
+    }
+}
+
+
+#if defined(__GNUC__)
+#define LANES_VECTOR
+
+typedef uint8_t  vu8  __attribute__((vector_size(LANES_BLOCK)));
+typedef int8_t   vs8  __attribute__((vector_size(LANES_BLOCK)));
+typedef uint16_t vu16 __attribute__((vector_size(LANES_BLOCK * 2)));
+typedef int16_t  vs16 __attribute__((vector_size(LANES_BLOCK * 2)));
+typedef uint32_t vu32 __attribute__((vector_size(LANES_BLOCK * 4)));
+typedef int32_t  vs32 __attribute__((vector_size(LANES_BLOCK * 4)));
+
+/* every array is 128-byte aligned and blocks start at multiples of 16 */
+#define V8(p)    (*(vu8  *)(p))
+#define V16(p)   (*(vu16 *)(p))
+#define V32(p)   (*(vu32 *)(p))
+
+/* Masked store: lanes outside m keep their value */
+#define PUT(ref, v, m)  ((ref) = ((v) & (m)) | ((ref) & ~(m)))
+
+/* Comparison results are 0 / -1 masks of the same width */
+#define WIDEN16(m)  ((vu16)__builtin_convertvector((vs8)(m), vs16))
+#define WIDEN32(m)  ((vu32)__builtin_convertvector((vs8)(m), vs32))
+#define ZEXT16(v)   __builtin_convertvector((v), vu16)
+
+/* An AVX2 copy is picked at load time where the CPU has it, SSE2 otherwise */
+#if defined(__x86_64__) && defined(__linux__)
+#define KERNELS  __attribute__((target_clones("avx2", "default")))
+#else
+#define KERNELS
+#endif
+
+/* Lanes set in a 0 / 0xFF mask */
+static inline __attribute__((always_inline)) int lanes_in(const vu8 *m)
+{
+    uint64_t w[LANES_BLOCK / 8];
+    int      k = 0;
+
+    memcpy(w, m, sizeof w);
+    for (int i = 0; i < LANES_BLOCK / 8; ++i)
+        k += __builtin_popcountll(w[i]) / 8;
+    return k;
+}
+
+/* Marks the ready lanes at pc, returns how many there are */
+KERNELS static int group(lanes_t *L, uint16_t pc)
+{
+    vu16 at    = (vu16){0} + pc;
+    int  count = 0;
+
+    L->first = -1;
+    for (int o = 0; o < L->cap; o += LANES_BLOCK) {
+        vu8 m = (vu8)__builtin_convertvector((vs16)(V16(L->PC + o) == at), vs8) & V8(L->ready + o);
+        int k = lanes_in(&m);
+
+        V8(L->mask + o) = m;
+        L->busy[o / LANES_BLOCK] = k != 0;
+        if (k && L->first < 0)
+            for (L->first = o; !L->mask[L->first]; ++L->first) {}
+        count += k;
+    }
+    return count;
+}
+
+/* Lowest PC of a ready lane; there is at least one */
+KERNELS static uint16_t lowest(const lanes_t *L)
+{
+    vu16 low = (vu16){0} + 0xFFFF;
+
+    for (int o = 0; o < L->cap; o += LANES_BLOCK) {
+        vu16 pc = V16(L->PC + o) | ~WIDEN16(V8(L->ready + o));
+        vu16 lt = (vu16)(pc < low);
+        low = (pc & lt) | (low & ~lt);
+    }
+
+    uint16_t pc = 0xFFFF;
+    for (int i = 0; i < LANES_BLOCK; ++i)
+        if (low[i] < pc) pc = low[i];
+    return pc;
+}
+
+/* The group ran one instruction: charge it, lanes out of budget stop */
+KERNELS static void retire(lanes_t *L)
+{
+    for (int o = 0; o < L->cap; o += LANES_BLOCK) {
+        if (!L->busy[o / LANES_BLOCK]) continue;
+
+        vu16 *b = &V16(L->budget + o);
+        vu8   was = V8(L->ready + o);
+        *b -= WIDEN16(V8(L->mask + o)) & 1;
+
+        vu8 now  = (vu8)__builtin_convertvector((vs16)(*b != 0), vs8) & was;
+        vu8 done = was & ~now;
+        V8(L->ready + o) = now;
+        L->left -= lanes_in(&done);
+    }
+}
+
+#else
+
+static int group(lanes_t *L, uint16_t pc)
+{
+    int count = 0;
+
+    L->first = -1;
+    for (int l = 0; l < L->cap; ++l) {
+        L->mask[l] = L->ready[l] && L->PC[l] == pc ? 0xFF : 0;
+        if (L->mask[l] && L->first < 0) L->first = l;
+        count += L->mask[l] & 1;
+    }
+    return count;
+}
+
+static uint16_t lowest(const lanes_t *L)
+{
+    uint16_t pc = 0xFFFF;
+    for (int l = 0; l < L->n; ++l)
+        if (L->ready[l] && L->PC[l] < pc) pc = L->PC[l];
+    return pc;
+}
+
+static void retire(lanes_t *L)
+{
+    for (int l = 0; l < L->n; ++l) {
+        if (L->mask[l] && --L->budget[l] == 0) {
+            L->ready[l] = 0;
+            L->left--;
+        }
+    }
+}
+
+#endif
+
+/* Where some lane rewrote the instruction, only lanes with the first's bytes stay */
+static void refine(lanes_t *L, uint16_t pc, int len)
+{
+    const uint8_t *ref = L->c[L->first]->memory.memory;
+
+    for (int l = L->first + 1; l < L->n; ++l) {
+        if (!L->mask[l]) continue;
+        const uint8_t *mem = L->c[l]->memory.memory;
+        for (uint16_t a = pc, i = 0; i < len; ++a, ++i) {
+            if (mem[a] != ref[a]) {
+                L->mask[l] = 0;
+                L->count--;
+                break;
+            }
+        }
+    }
+}
+
+
+#ifdef LANES_VECTOR
+
+/* Taken skips step over the next instruction; len 0: it differs per lane */
+static inline __attribute__((always_inline))
+void branch(lanes_t *L, int o, const vu8 *taken, uint16_t next, int len)
+{
+    if (len) {
+        vu16 t  = WIDEN16(*taken);
+        vu16 to = (((vu16){0} + (uint16_t)(next + len)) & t) | (((vu16){0} + next) & ~t);
+        PUT(V16(L->PC + o), to, WIDEN16(V8(L->mask + o)));
+        return;
+    }
+    for (int l = o; l < o + LANES_BLOCK; ++l) {
+        if (!L->mask[l]) continue;
+        L->PC[l] = next + ((*taken)[l - o] ? chip8_oplen(L->c[l], next) : 0);
+    }
+}
+
+/*
+ * Runs op at pc on every group lane, false if it has no kernel.  ALU,
+ * skips, jumps, I and timer instructions are SIMD over whole blocks;
+ * stack, keypad and Fx33/Fx55/Fx65 touch per-lane memory and loop over
+ * the group.
+ */
+KERNELS static bool kernels(lanes_t *L, uint16_t pc, uint16_t op)
+{
+    int            k   = chip8_opclass(op);
+    int            x   = (op >> 8) & 0xF, y = (op >> 4) & 0xF;
+    uint8_t        kk  = op & 0xFF;
+    uint16_t       nnn = op & 0xFFF;
+    uint16_t       next = pc + 2;
+    const chip8_t *c0  = L->c[L->first];
+    int            cap = L->cap;
+    uint8_t       *VX  = L->V + x * cap, *VY = L->V + y * cap, *VF = L->V + 15 * cap;
+    int            skip = 0;
+
+    switch (k) {
+        case OPC_NOP:  case OPC_EXIT: case OPC_JP:   case OPC_JPV0:
+        case OPC_LD:   case OPC_ADD:  case OPC_MOV:  case OPC_OR:
+        case OPC_AND:  case OPC_XOR:  case OPC_ADDR: case OPC_SUB:
+        case OPC_SHR:  case OPC_SUBN: case OPC_SHL:  case OPC_LDI:
+        case OPC_RND:  case OPC_GDT:  case OPC_SDT:  case OPC_SST:
+        case OPC_ADDI: case OPC_FONT: case OPC_BFONT: case OPC_LDIL:
+            break;
+
+        case OPC_SE: case OPC_SNE: case OPC_SER: case OPC_SNER:
+            if (shared(L, next, 2)) skip = chip8_oplen(c0, next);
+            break;
+
+        case OPC_CALL:
+            for (int l = L->first; l < L->n; ++l) {
+                if (!L->mask[l]) continue;
+                if (L->SP[l] < 16) {
+                    L->c[l]->memory.stack[L->SP[l]++] = next;
+                    L->PC[l] = nnn;
+                } else {
+                    L->PC[l] = next;
+                }
+            }
+            return true;
+
+        case OPC_RET:
+            for (int l = L->first; l < L->n; ++l) {
+                if (!L->mask[l]) continue;
+                L->PC[l] = L->SP[l] > 0 ? L->c[l]->memory.stack[--L->SP[l]] : next;
+            }
+            return true;
+
+        case OPC_SKP: case OPC_SKNP:
+            for (int l = L->first; l < L->n; ++l) {
+                if (!L->mask[l]) continue;
+                uint8_t v = L->V[x * cap + l] & 0xF;
+                bool taken = (L->c[l]->keypad[v] != 0) == (k == OPC_SKP);
+                L->PC[l] = next + (taken ? chip8_oplen(L->c[l], next) : 0);
+            }
+            return true;
+
+        case OPC_BCD:
+            for (int l = L->first; l < L->n; ++l) {
+                if (!L->mask[l]) continue;
+                uint8_t *mem = L->c[l]->memory.memory, v = L->V[x * cap + l];
+                uint16_t i = L->I[l];
+                mem[i]                 = v / 100;
+                mem[(uint16_t)(i + 1)] = v / 10 % 10;
+                mem[(uint16_t)(i + 2)] = v % 10;
+                mark(L, i, 3);
+                L->PC[l] = next;
+            }
+            return true;
+
+        case OPC_STORE: {
+            int marked = -1;            /* lanes mostly share I */
+            for (int l = L->first; l < L->n; ++l) {
+                if (!L->mask[l]) continue;
+                uint8_t *mem = L->c[l]->memory.memory;
+                for (int i = 0; i <= x; ++i)
+                    mem[(uint16_t)(L->I[l] + i)] = L->V[i * cap + l];
+                if (L->I[l] != marked) mark(L, marked = L->I[l], x + 1);
+                L->PC[l] = next;
+            }
+            return true;
+        }
+
+        case OPC_LOAD:
+            for (int l = L->first; l < L->n; ++l) {
+                if (!L->mask[l]) continue;
+                const uint8_t *mem = L->c[l]->memory.memory;
+                for (int i = 0; i <= x; ++i)
+                    L->V[i * cap + l] = mem[(uint16_t)(L->I[l] + i)];
+                L->PC[l] = next;
+            }
+            return true;
+
+        case OPC_KEY:
+            for (int l = L->first; l < L->n; ++l) {
+                if (!L->mask[l]) continue;
+                const uint8_t *keys = L->c[l]->keypad;
+                int i = 0;
+                while (i < 16 && !keys[i]) ++i;
+                if (i < 16) L->V[x * cap + l] = i;
+                L->PC[l] = i < 16 ? next : pc;
+            }
+            return true;
+
+        default:
+            return false;
+    }
+
+    for (int o = 0; o < cap; o += LANES_BLOCK) {
+        if (!L->busy[o / LANES_BLOCK]) continue;
+
+        vu8   m   = V8(L->mask + o);
+        vu16  m16 = WIDEN16(m);
+        vu16 *pcv = &V16(L->PC + o), *iv = &V16(L->I + o);
+        vu16  to  = (vu16){0} + next;
+        vu8   a, b;
+
+        switch (k) {
+            case OPC_NOP:                                       break;
+            case OPC_EXIT: to = (vu16){0} + pc;                 break;
+            case OPC_JP:   to = (vu16){0} + nnn;                break;
+            case OPC_JPV0: to = nnn + ZEXT16(V8(L->V + o));     break;
+
+            case OPC_SE:   a = (vu8)(V8(VX + o) == kk);          branch(L, o, &a, next, skip); continue;
+            case OPC_SNE:  a = (vu8)(V8(VX + o) != kk);          branch(L, o, &a, next, skip); continue;
+            case OPC_SER:  a = (vu8)(V8(VX + o) == V8(VY + o));  branch(L, o, &a, next, skip); continue;
+            case OPC_SNER: a = (vu8)(V8(VX + o) != V8(VY + o));  branch(L, o, &a, next, skip); continue;
+
+            case OPC_LD:   PUT(V8(VX + o), (vu8){0} + kk, m);             break;
+            case OPC_ADD:  PUT(V8(VX + o), V8(VX + o) + kk, m);           break;
+            case OPC_MOV:  PUT(V8(VX + o), V8(VY + o), m);                break;
+            case OPC_OR:   PUT(V8(VX + o), V8(VX + o) | V8(VY + o), m);   break;
+            case OPC_AND:  PUT(V8(VX + o), V8(VX + o) & V8(VY + o), m);   break;
+            case OPC_XOR:  PUT(V8(VX + o), V8(VX + o) ^ V8(VY + o), m);   break;
+
+            /* VF is written first and Vx, Vy re-read, as chip8_cycle does */
+            case OPC_ADDR:
+                a = V8(VX + o) + V8(VY + o);
+                PUT(V8(VF + o), (vu8)(a < V8(VX + o)) & 1, m);
+                PUT(V8(VX + o), a, m);
+                break;
+            case OPC_SUB:
+                PUT(V8(VF + o), (vu8)(V8(VX + o) >= V8(VY + o)) & 1, m);
+                PUT(V8(VX + o), V8(VX + o) - V8(VY + o), m);
+                break;
+            case OPC_SHR:
+                PUT(V8(VF + o), V8(VX + o) & 1, m);
+                PUT(V8(VX + o), V8(VX + o) >> 1, m);
+                break;
+            case OPC_SUBN:
+                PUT(V8(VF + o), (vu8)(V8(VY + o) >= V8(VX + o)) & 1, m);
+                PUT(V8(VX + o), V8(VY + o) - V8(VX + o), m);
+                break;
+            case OPC_SHL:
+                PUT(V8(VF + o), V8(VX + o) >> 7, m);
+                PUT(V8(VX + o), V8(VX + o) << 1, m);
+                break;
+
+            case OPC_RND: {
+                vu32 r = V32(L->rng + o);
+                r ^= r << 13;
+                r ^= r >> 17;
+                r ^= r << 5;
+                PUT(V32(L->rng + o), r, WIDEN32(m));
+                b = __builtin_convertvector(r >> 24, vu8);
+                PUT(V8(VX + o), b & kk, m);
+                break;
+            }
+
+            case OPC_LDI:   PUT(*iv, (vu16){0} + nnn, m16);                       break;
+            case OPC_ADDI:  PUT(*iv, *iv + ZEXT16(V8(VX + o)), m16);              break;
+            case OPC_FONT:  PUT(*iv, ZEXT16(V8(VX + o)) * 5, m16);                break;
+            case OPC_BFONT: PUT(*iv, FONT_BIG + ZEXT16(V8(VX + o) & 0xF) * 10, m16); break;
+            case OPC_LDIL: {
+                const uint8_t *mem = c0->memory.memory;
+                uint16_t v = (mem[next] << 8) | mem[(uint16_t)(next + 1)];
+                PUT(*iv, (vu16){0} + v, m16);
+                to = (vu16){0} + (uint16_t)(pc + 4);
+                break;
+            }
+
+            case OPC_GDT:  PUT(V8(VX + o), V8(L->DT + o), m);  break;
+            case OPC_SDT:  PUT(V8(L->DT + o), V8(VX + o), m);  break;
+            case OPC_SST:  PUT(V8(L->ST + o), V8(VX + o), m);  break;
+        }
+        PUT(*pcv, to, m16);
+    }
+    return true;
+}
+
+#else
+
+static bool kernels(lanes_t *L, uint16_t pc, uint16_t op)
+{
+    (void)L; (void)pc; (void)op;
+    return false;                   /* no vector extensions: every lane scalar */
+}
+
+#endif
+
+
+/*
+ * The group is the ready lanes at the lowest PC; the others wait.  Lanes
+ * that branched apart mostly meet again at a join point or a loop head,
+ * so running the lowest first lets the ones behind catch up there.  Each
+ * step charges one instruction to every group lane, so each runs exactly
+ * its budget however the steps interleave.
+ */
+static void step(lanes_t *L)
+{
+    uint16_t pc = lowest(L);
+    L->count = group(L, pc);
+
+    const chip8_t *c0 = L->c[L->first];
+    uint16_t op  = (c0->memory.memory[pc] << 8) | c0->memory.memory[(uint16_t)(pc + 1)];
+    int      len = chip8_oplen(c0, pc);
+
+    if (!shared(L, pc, len)) refine(L, pc, len);
+    int grouped = L->count;
+
+    if (!kernels(L, pc, op)) {
+        for (int l = L->first; l < L->n; ++l)
+            if (L->mask[l]) scalar(L, l);
+        L->count = 0;
+    }
+
+    L->stats.steps++;
+    L->stats.vector += L->count;
+    L->stats.scalar += grouped - L->count;
+    L->stats.waited += L->left - grouped;
+
+    retire(L);
+}
+
+/* Lanes share nothing, so cutting the run into budgets of 16 bits changes nothing */
+void lanes_run(lanes_t *L, uint64_t cycles)
+{
+    while (cycles) {
+        uint16_t n = cycles < 0xFFFF ? cycles : 0xFFFF;
+
+        for (int l = 0; l < L->n; ++l) {
+            L->budget[l] = n;
+            L->ready[l]  = 0xFF;
+        }
+        L->left = L->n;
+        while (L->left) step(L);
+        cycles -= n;
+    }
+}
+
+void lanes_update(lanes_t *L)
+{
+    for (int l = 0; l < L->cap; ++l) {
+        L->DT[l] -= L->DT[l] > 0;
+        L->ST[l] -= L->ST[l] > 0;
+    }
+}
+
+
+const lanes_stats_t* lanes_stats(const lanes_t *L)
+{
+    return &L->stats;
+}
+
+void lanes_print(FILE *f, const lanes_t *L)
+{
+    const lanes_stats_t *s = &L->stats;
+    uint64_t slots = s->steps * L->n;
+
+    fprintf(f, "lanes: %d, steps %llu, occupancy %.1f%% "
+               "(vector %llu, scalar %llu, waited %llu)\n",
+            L->n, (unsigned long long)s->steps,
+            slots ? 100.0 * (s->vector + s->scalar) / slots : 0.0,
+            (unsigned long long)s->vector, (unsigned long long)s->scalar,
+            (unsigned long long)s->waited);
+}
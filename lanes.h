@@ -0,0 +1,47 @@
+#ifndef LANES_H
+#define LANES_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include "chip8.h"
+
+/*
+ * Lockstep engine: n instances of one ROM with their registers stored
+ * as structure of arrays (PC[n], I[n], V[16][n], ...).  Each step the
+ * lanes at the lowest PC that still have instructions left in the run
+ * form a group and run one instruction as SIMD kernels over LANES_BLOCK
+ * lanes at a time; the others wait.  Instructions without a kernel go
+ * through chip8_cycle one group lane at a time.  Each lane ends up
+ * exactly where chip8_run would leave it.  Memory, stack, display and
+ * keypad stay per lane.
+ */
+#define LANES_BLOCK  16             /* lanes per kernel iteration: 16-bit registers fill AVX2 */
+
+typedef struct lanes lanes_t;
+
+/* Occupancy is (vector + scalar) / (steps * n) */
+typedef struct {
+    uint64_t steps;                 /* groups run */
+    uint64_t vector;                /* lane-instructions run by the kernels */
+    uint64_t scalar;                /* lane-instructions run through chip8_cycle */
+    uint64_t waited;                /* lanes left out of a group while they had budget */
+} lanes_stats_t;
+
+/* Every lane starts with the ROM at 0x200 and seed 1 */
+lanes_t* lanes_init(int n, const uint8_t *rom, size_t size);
+void lanes_destroy(lanes_t *L);
+int  lanes_count(const lanes_t *L);
+void lanes_seed(lanes_t *L, int lane, uint32_t seed);
+/* The lane's keypad, to be changed between runs */
+uint8_t* lanes_keypad(lanes_t *L, int lane);
+
+void lanes_run(lanes_t *L, uint64_t cycles);
+/* chip8_update on every lane */
+void lanes_update(lanes_t *L);
+
+/* The lane as a chip8_t, registers brought up to date; read only */
+const chip8_t* lanes_get(lanes_t *L, int lane);
+const lanes_stats_t* lanes_stats(const lanes_t *L);
+void lanes_print(FILE *f, const lanes_t *L);
+
+#endif /* LANES_H */
@@ -1,35 +1,114 @@
 /* main.c */
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "brk.h"
+#include "capture.h"
 #include "chip8.h"
 #include "dbg.h"
+#include "engine.h"
+#include "movie.h"
+#include "pack.h"
+#include "pacer.h"
 #include "sdl.h"
+#include "state.h"
+#include "prof.h"
+#include "stats.h"
+#include "xchg.h"
 
 typedef struct {
     const char *rom_path;
-    int         palette_idx;   /* 0 – bw, 1 – amber */
+    int         palette_idx;   /* 0 – bw, 1 – amber, -1 – from the pack */
     int         scale;
-    int         hz;
+    int         hz;            /* 0 – from the pack */
+    int         profile;       /* chip8_profile_t, -1 – from the pack */
     int         volume;
     bool        nosound;
     int         debug;
+    int         trace_last;    /* flight recorder size, M instructions */
+    const char *points[BRK_MAX];   /* -break / -watch specs, in order */
+    bool        watch[BRK_MAX];
+    int         npoints;
+    engine_kind_t engine;
+    unsigned    flags;
+    bool        stats;
+    const char *prof;          /* profile output prefix */
+    int         rewind;        /* seconds of rewind history, 0 – off */
+    bool        deterministic; /* seeded PRNG, the seed is reported */
+    uint32_t    seed;
+    const char *record;        /* input movie to write */
+    bool        turbo;         /* start in fast-forward */
+    int         turbo_speed;   /* fast-forward multiplier, 0 – uncapped */
+    const char *capture;       /* Y4M file or PNG directory */
 } cfg_t;
 
+/*
+ * The emulation thread: everything it touches is here.  The main
+ * thread only polls input and presents; the two talk through xchg.
+ */
+typedef struct {
+    chip8_t  *c;
+    engine_t *eng;
+    rewind_t *rw;
+    brk_t    *brk;             /* breakpoints, NULL – none */
+    capture_t *cap;            /* frame capture, NULL – none */
+    movie_t  *movie;           /* input being recorded, NULL – none */
+    xchg_t   *x;
+    int       hz;
+    uint64_t  cycles;          /* total executed, movie timestamps */
+    uint64_t  frame_left;      /* cycles still due in this frame */
+    int       carry;
+
+    pacer_t     pacer;
+    const char *state_path;
+    bool        rewind;        /* Backspace held */
+    bool        turbo;         /* fast-forward */
+    int         turbo_speed;
+    uint64_t    ff_frames, ff_since;
+    char        osd[32];       /* goes out with every frame */
+} emu_t;
+
+/* The main thread's view of presenting, for -stats */
+typedef struct {
+    jitter_t  interval;        /* between presents */
+    jitter_t  age;             /* frame published to presented */
+    uint64_t  skipped;         /* frames never presented */
+    uint64_t  last;            /* previous present, 0 – none yet */
+} render_t;
+
 
 static void usage(const char *prog)
 {
     fprintf(stderr,
             "Usage: %s -f <*.ch8 / *.rom> [-p bw|amber]\n"
-            "  -f   ROM-file\n"
+            "  -f   ROM-file, or pack.c8p:name / pack.c8p#hash\n"
             "  -p   palette (bw or amber, default bw)\n"
             "  -s   pixel scale (default 20)\n"
             "  -hz  CPU frequency (default 500)\n"
+            "  -quirks   default | vip | chip48 | schip | xochip\n"
             "  -nosound  Disable sound\n"
+            "  -engine   switch | cache | jit (default switch)\n"
+            "  -verify   Check JIT blocks against the interpreter\n"
+            "  -stats    Print opcode counters and frame times on exit\n"
+            "  -prof P   Profile routines, write P.folded, P.pixels.folded,\n"
+            "            P.frames.folded and P.asm on exit\n"
+            "  -rewind N Seconds of rewind history (default 60, 0 - off)\n"
+            "  -seed N   Seed the PRNG for a repeatable run\n"
+            "  -record F Write the input movie to F\n"
+            "  -turbo N  Start in fast-forward at N x speed (0 - uncapped),\n"
+            "            Tab toggles it\n"
+            "  -capture F  Write every frame, window-sized, to F.y4m or\n"
+            "              to PNG files in directory F; frames the writer\n"
+            "              is behind on are dropped\n"
             "  -debug    Debug mode (0 - disable,\n"
             "                        1 - log to file,\n"
-            "                        2 - step-by-step)\n"
+            "                        2 - prompt before the first instruction)\n"
+            "  -break A[:COND]  Stop at A when COND holds, e.g. 2A4:V3==5&I>=300\n"
+            "  -watch A[-B|+N][:r|:w|:rw]  Stop at accesses to A..B (default :w)\n"
+            "  -trace-last N  Keep only the last N million instructions\n"
+            "                 of the mode 1 trace (flight recorder)\n"
             , prog);
 }
 
@@ -37,12 +116,14 @@ static cfg_t parse_args(int argc, char *argv[])
 {
     /* by default */
     cfg_t cfg = {0};
-    cfg.palette_idx = 0;
+    cfg.palette_idx = -1;
     cfg.scale = 20;
-    cfg.hz = 500;
+    cfg.hz = 0;
+    cfg.profile = -1;
     cfg.volume = 30;
     cfg.nosound = false;
     cfg.debug = 0;
+    cfg.rewind = 60;
 
     for (int i = 1; i < argc; ++i) {
         if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
@@ -68,6 +149,14 @@ static cfg_t parse_args(int argc, char *argv[])
                 exit(EXIT_FAILURE);
             }
         } 
+        else if (strcmp(argv[i], "-quirks") == 0 && i + 1 < argc) {
+            chip8_profile_t p;
+            if (!chip8_profile_parse(argv[++i], &p)) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            cfg.profile = p;
+        }
         else if (strcmp(argv[i], "-v") == 0 && i + 1 < argc) {
             cfg.volume = atoi(argv[++i]);
             if (cfg.volume < 0 || cfg.volume > 100) {
@@ -78,10 +167,54 @@ static cfg_t parse_args(int argc, char *argv[])
         else if (strcmp(argv[i], "-nosound") == 0) {
             cfg.nosound = true;
         }
+        else if (strcmp(argv[i], "-engine") == 0 && i + 1 < argc) {
+            if (!engine_parse(argv[++i], &cfg.engine)) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (strcmp(argv[i], "-verify") == 0) {
+            cfg.flags |= ENGINE_VERIFY;
+        }
+        else if (strcmp(argv[i], "-stats") == 0) {
+            cfg.stats = true;
+        }
+        else if (strcmp(argv[i], "-prof") == 0 && i + 1 < argc) {
+            cfg.prof = argv[++i];
+        }
+        else if (strcmp(argv[i], "-rewind") == 0 && i + 1 < argc) {
+            cfg.rewind = atoi(argv[++i]);
+            if (cfg.rewind < 0) cfg.rewind = 0;
+        }
+        else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc) {
+            cfg.seed = strtoul(argv[++i], NULL, 0);
+            cfg.deterministic = true;
+        }
+        else if (strcmp(argv[i], "-record") == 0 && i + 1 < argc) {
+            cfg.record = argv[++i];
+            cfg.deterministic = true;
+        }
+        else if (strcmp(argv[i], "-turbo") == 0 && i + 1 < argc) {
+            cfg.turbo_speed = atoi(argv[++i]);
+            if (cfg.turbo_speed < 0) cfg.turbo_speed = 0;
+            cfg.turbo = true;
+        }
+        else if (strcmp(argv[i], "-capture") == 0 && i + 1 < argc) {
+            cfg.capture = argv[++i];
+        }
         else if (strcmp(argv[i], "-debug") == 0 && i + 1 < argc) {
             cfg.debug = atoi(argv[++i]);
             if (cfg.debug < 0 || cfg.debug > 2) cfg.debug = 0;
         }
+        else if ((strcmp(argv[i], "-break") == 0 || strcmp(argv[i], "-watch") == 0) &&
+                 i + 1 < argc && cfg.npoints < BRK_MAX) {
+            cfg.watch[cfg.npoints]    = argv[i][1] == 'w';
+            cfg.points[cfg.npoints++] = argv[++i];
+        }
+        else if (strcmp(argv[i], "-trace-last") == 0 && i + 1 < argc) {
+            cfg.trace_last = atoi(argv[++i]);
+            if (cfg.trace_last < 0) cfg.trace_last = 0;
+        }
         else {
             usage(argv[0]);
             exit(EXIT_FAILURE);
@@ -96,45 +229,306 @@ static cfg_t parse_args(int argc, char *argv[])
 }
 
 
-static bool load_rom(chip8_t *c, const char *path)
+/* From a pack the image is copied straight out of the mapping */
+static size_t load_packed(chip8_t *c, cfg_t *cfg, const char *path, const char *sel)
+{
+    pack_t    *p = pack_open(path);
+    pack_rom_t r;
+
+    if (!p) return 0;
+    if (!pack_select(p, sel, &r)) {
+        fprintf(stderr, "%s: no ROM %s\n", path, sel);
+        pack_close(p);
+        return 0;
+    }
+    memcpy(c->memory.memory + 0x200, r.data, r.size);
+    if (!cfg->hz) cfg->hz = r.hz;
+    if (cfg->palette_idx < 0 && r.palette < 2) cfg->palette_idx = r.palette;
+    if (cfg->profile < 0) {
+        chip8_profile_t prof;
+        if (!chip8_profile_find(r.quirks, &prof)) {
+            fprintf(stderr, "%s: no profile has quirks 0x%x\n", sel, (unsigned)r.quirks);
+            pack_close(p);
+            return 0;
+        }
+        cfg->profile = prof;
+    }
+    pack_close(p);
+    return r.size;
+}
+
+/* Returns the ROM size, 0 on failure; settings not given default here */
+static size_t load_rom(chip8_t *c, cfg_t *cfg)
 {
-    FILE *f = fopen(path, "rb");
-    if (!f) { perror(path); return false; }
+    char        pack[4096];
+    const char *path = cfg->rom_path, *sel;
+    size_t      bytes;
 
-    size_t bytes = fread(c->memory.memory + 0x200, 1, MEM_SIZE - 0x200, f);
-    fclose(f);
+    if (pack_spec(path, pack, sizeof pack, &sel)) {
+        bytes = load_packed(c, cfg, pack, sel);
+    } else {
+        FILE *f = fopen(path, "rb");
+        if (!f) { perror(path); return 0; }
 
-    if (bytes == 0) { fprintf(stderr, "Empty ROM\n"); return false; }
-    return true;
+        bytes = fread(c->memory.memory + 0x200, 1, MEM_SIZE - 0x200, f);
+        fclose(f);
+        if (bytes == 0) fprintf(stderr, "Empty ROM\n");
+    }
+
+    if (!cfg->hz) cfg->hz = 500;
+    if (cfg->palette_idx < 0) cfg->palette_idx = 0;
+    if (cfg->profile < 0) cfg->profile = PROFILE_DEFAULT;
+    return bytes;
 }
 
 
-static void handle_events(chip8_t *c, window_t *w, bool *running)
+/* Main thread: keys go to the emulator stamped with their SDL time */
+static void handle_events(xchg_t *x, window_t *w)
 {
     SDL_Event ev;
     while (SDL_PollEvent(&ev)) {
         if (ev.type == SDL_EVENT_QUIT) {
-            *running = false;
-        } else if (ev.type == SDL_EVENT_KEY_DOWN) {
-            if (ev.key.key == SDLK_F1) sdl_palette(w, 0);
-            else if (ev.key.key == SDLK_F2) sdl_palette(w, 1);
-            else {
-                for (int i = 0; i < 16; ++i) {
-                    if (ev.key.key == keymap[i]) {
-                        c->keypad[i] = 1;
-                        break;
-                    }
-                }
+            xchg_stop(x);
+            continue;
+        }
+        if (ev.type != SDL_EVENT_KEY_DOWN && ev.type != SDL_EVENT_KEY_UP) continue;
+        if (ev.key.repeat) continue;
+
+        input_ev_t in = { .time = ev.key.timestamp, .down = ev.key.down };
+        SDL_Keycode k = ev.key.key;
+        if (k == SDLK_F1 || k == SDLK_F2) {
+            if (in.down) sdl_palette(w, k == SDLK_F2);
+            continue;
+        }
+        if      (k == SDLK_F5)        in.kind = IN_SAVE;
+        else if (k == SDLK_F9)        in.kind = IN_LOAD;
+        else if (k == SDLK_TAB)       in.kind = IN_TURBO;
+        else if (k == SDLK_BACKSPACE) in.kind = IN_REWIND;
+        else {
+            in.kind = IN_KEY;
+            in.key  = 16;
+            for (int i = 0; i < 16; ++i)
+                if (k == keymap[i]) in.key = i;
+            if (in.key == 16) continue;
+        }
+        /* the commands act on press only */
+        if (in.kind == IN_KEY || in.kind == IN_REWIND || in.down)
+            xchg_push(x, &in);
+    }
+}
+
+/* After a jump to another state: keys being held stay held, stale code goes */
+static void resync(chip8_t *c, engine_t *eng, const uint8_t keys[16])
+{
+    memcpy(c->keypad, keys, 16);
+    engine_invalidate(eng, 0, MEM_SIZE);
+}
+
+/*
+ * Runs at most n cycles of the current 60 Hz frame (hz/60 of them, the
+ * fraction carried); breakpoints may stop it short.  A complete frame ticks the timers and is recorded
+ * for rewind; its sound goes out only when the frame is also played in
+ * real time.
+ */
+static void emu_run(emu_t *e, uint64_t n, bool sound)
+{
+    chip8_t *c = e->c;
+
+    if (e->frame_left == 0)
+        e->frame_left = chip8_frame_cycles(e->hz, &e->carry);
+    if (n > e->frame_left) n = e->frame_left;
+    if (e->brk) n = brk_run(e->brk, c, n);
+    else        engine_run(e->eng, c, n);
+    e->cycles     += n;
+    e->frame_left -= n;
+    if (e->frame_left) return;
+
+    if (c->audio_dirty & AUDIO_PATTERN) sdl_audio_pattern(c->pattern);
+    if (c->audio_dirty & AUDIO_PITCH)   sdl_audio_pitch(c->pitch);
+    c->audio_dirty = 0;
+    if (sound) sdl_audio_frame(c->ST > 0);
+    chip8_update(c);
+    if (e->rw) rewind_push(e->rw, c);
+    if (e->cap) capture_frame(e->cap, c);
+}
+
+static void rewind_step(rewind_t *rw, chip8_t *c, engine_t *eng)
+{
+    uint64_t first, last;
+    uint8_t  keys[16];
+
+    if (!rewind_range(rw, &first, &last) || last == first) return;
+    memcpy(keys, c->keypad, sizeof keys);
+    if (rewind_seek(rw, last - 1, c)) {
+        rewind_truncate(rw, last - 1);
+        resync(c, eng, keys);
+    }
+}
+
+static void apply_input(emu_t *e, const input_ev_t *in)
+{
+    chip8_t *c = e->c;
+
+    switch (in->kind) {
+        case IN_KEY:
+            if (c->keypad[in->key] == in->down) break;
+            c->keypad[in->key] = in->down;
+            if (e->movie) movie_add(e->movie, e->cycles, in->key, in->down);
+            break;
+        case IN_REWIND:
+            e->rewind = in->down;
+            break;
+        case IN_SAVE:
+            if (state_write(c, e->state_path))
+                printf("State saved to %s\n", e->state_path);
+            break;
+        case IN_LOAD:
+            if (e->movie) {
+                fprintf(stderr, "Cannot load a state while recording\n");
+            } else {
+                uint8_t keys[16];
+                memcpy(keys, c->keypad, sizeof keys);
+                if (state_read(c, e->state_path)) resync(c, e->eng, keys);
             }
-        } else if (ev.type == SDL_EVENT_KEY_UP) {
-            for (int i = 0; i < 16; ++i) {
-                if (ev.key.key == keymap[i]) {
-                    c->keypad[i] = 0;
-                    break;
-                }
+            break;
+        case IN_TURBO:
+            if (e->brk) break;
+            e->turbo     = !e->turbo;
+            e->ff_frames = 0;
+            e->ff_since  = SDL_GetTicksNS();
+            snprintf(e->osd, sizeof e->osd, "%s", e->turbo ? "FF" : "");
+            break;
+    }
+}
+
+/* Everything that happened before `to`, applied now */
+static void drain_input(emu_t *e, uint64_t to)
+{
+    input_ev_t in;
+    while (xchg_peek(e->x, &in) && in.time < to) {
+        xchg_pop(e->x, &in);
+        apply_input(e, &in);
+    }
+}
+
+/*
+ * One frame of real-time play.  Input from the previous tick, [from,
+ * to), is replayed at the same place in this frame: a key pressed 40%
+ * into the tick lands 40% into the frame's cycles, so timing finer than
+ * a frame survives behind one frame of constant delay.  Under the
+ * debugger keys land at the frame start, as a stop may cut it short.
+ */
+static void emu_frame(emu_t *e, uint64_t from, uint64_t to)
+{
+    input_ev_t in;
+
+    if (e->frame_left == 0)
+        e->frame_left = chip8_frame_cycles(e->hz, &e->carry);
+    uint64_t span = e->frame_left;
+
+    while (xchg_peek(e->x, &in) && in.time < to) {
+        xchg_pop(e->x, &in);
+        if (!e->brk && in.kind == IN_KEY && in.time > from) {
+            uint64_t at  = (in.time - from) * span / (to - from);
+            uint64_t ran = span - e->frame_left;
+            if (at > ran) emu_run(e, at - ran, true);
+        }
+        apply_input(e, &in);
+    }
+    if (e->frame_left) emu_run(e, UINT64_MAX, true);
+}
+
+/* Hands the screen to the main thread, which may skip it */
+static void emu_publish(emu_t *e)
+{
+    frame_t *f = xchg_back(e->x);
+
+    memcpy(f->FB, e->c->FB, sizeof f->FB);
+    f->hires    = e->c->hires;
+    f->dirty    = e->c->dirty;
+    e->c->dirty = 0;
+    memcpy(f->osd, e->osd, sizeof f->osd);
+    f->time     = SDL_GetTicksNS();
+    xchg_publish(e->x);
+}
+
+static void *emu_thread(void *arg)
+{
+    emu_t   *e    = arg;
+    uint64_t from = SDL_GetTicksNS();
+
+    pacer_init(&e->pacer, 60);
+    while (xchg_running(e->x)) {
+        uint64_t to = SDL_GetTicksNS();
+
+        if (e->rewind && e->rw) {
+            /* emulation is paused, one frame back per tick */
+            drain_input(e, to);
+            rewind_step(e->rw, e->c, e->eng);
+            sdl_audio_frame(false);
+        } else if (e->turbo) {
+            /* fast-forward: whole frames, N per tick or as many as fit
+               before the next one; only the last is shown, audio keeps
+               to real time and stays silent */
+            uint64_t due = pacer_next(&e->pacer);
+            int      n   = 0;
+            drain_input(e, to);
+            do {
+                emu_run(e, UINT64_MAX, false);
+                ++n;
+            } while (e->turbo_speed ? n < e->turbo_speed : SDL_GetTicksNS() < due);
+            sdl_audio_frame(false);
+
+            uint64_t now = SDL_GetTicksNS();
+            e->ff_frames += n;
+            if (now - e->ff_since >= 500000000ULL) {
+                snprintf(e->osd, sizeof e->osd, "FF x%.1f",
+                         e->ff_frames * 1e9 / 60 / (now - e->ff_since));
+                e->ff_frames = 0;
+                e->ff_since  = now;
             }
+        } else {
+            /* one frame per tick, cut short by a breakpoint: the
+               screen goes out before the prompt */
+            emu_frame(e, from, to);
         }
+        from = to;
+        if (e->brk && brk_quit(e->brk)) xchg_stop(e->x);
+
+        emu_publish(e);
+        pacer_wait(&e->pacer);
+    }
+    return NULL;
+}
+
+/* Main thread: the newest frame, if there is one it has not shown */
+static void render(xchg_t *x, window_t *w, render_t *r)
+{
+    bool           fresh;
+    const frame_t *f = xchg_front(x, &fresh);
+
+    if (!fresh) {
+        SDL_DelayNS(1000000);       /* input is still polled every ms */
+        return;
     }
+    if (w->seq != UINT64_MAX) r->skipped += f->seq - w->seq - 1;
+    sdl_osd(w, f->osd);
+    if (!sdl_draw(f, w)) return;
+
+    uint64_t now = SDL_GetTicksNS();
+    if (r->last) jitter_add(&r->interval, now - r->last);
+    jitter_add(&r->age, now - f->time);
+    r->last = now;
+}
+
+static void render_print(FILE *f, const render_t *r, uint64_t dropped)
+{
+    if (!r->age.n) return;
+    fprintf(f, "render: presents %llu, skipped %llu, interval mean %.3f ms, sd %.3f ms, "
+               "max %.3f ms, frame age mean %.3f ms, max %.3f ms, input dropped %llu\n",
+            (unsigned long long)r->age.n, (unsigned long long)r->skipped,
+            r->interval.mean / 1e6, jitter_sd(&r->interval) / 1e6, r->interval.max / 1e6,
+            r->age.mean / 1e6, r->age.max / 1e6, (unsigned long long)dropped);
 }
 
 
@@ -143,61 +537,155 @@ int main(int argc, char *argv[])
     cfg_t cfg = parse_args(argc, argv);
 
     chip8_t *chip8 = chip8_init();
-    if (!chip8 || !load_rom(chip8, cfg.rom_path)) {
+    size_t   rom_size = chip8 ? load_rom(chip8, &cfg) : 0;
+    if (!rom_size) {
         fprintf(stderr, "Cannot load ROM\n");
         return EXIT_FAILURE;
     }
     chip8->PC = 0x200;
+    chip8_set_profile(chip8, cfg.profile);
+
+    movie_t *movie = NULL;
+    if (cfg.deterministic) {
+        if (!cfg.seed) cfg.seed = chip8->rng;   /* random, but recorded */
+        chip8_seed(chip8, cfg.seed);
+    }
+    if (cfg.record) {
+        movie = movie_init(cfg.hz, chip8_profile_quirks(chip8->profile), cfg.seed,
+                           pack_hash(chip8->memory.memory + 0x200, rom_size));
+        if (!movie) {
+            chip8_destroy(chip8);
+            return EXIT_FAILURE;
+        }
+    }
+
+    debug_init(cfg.debug, cfg.trace_last);
+    chip8->hooks = debug_hooks();
+
+    /* one hook set per instance: the debugger wins over the profiler,
+       the profiler over the counters */
+    prof_t *prof = NULL;
+    if (cfg.prof && !chip8->hooks) {
+        if (!(prof = prof_init())) {
+            chip8_destroy(chip8);
+            return EXIT_FAILURE;
+        }
+        chip8->hooks = prof_hooks(prof);
+    }
+    stats_t stats;
+    if (cfg.stats && !chip8->hooks) {
+        stats_init(&stats);
+        chip8->hooks = &stats.hooks;
+    }
 
-    debug_init(cfg.debug);
+    /* the prompt runs the machine on the interpreter, a bitmap test per
+       instruction; without any points the engine runs as usual */
+    brk_t *brk = NULL;
+    if (cfg.debug == 2 || cfg.npoints) {
+        bool ok = (brk = brk_init()) != NULL;
+        for (int i = 0; ok && i < cfg.npoints; ++i)
+            ok = cfg.watch[i] ? brk_watch(brk, cfg.points[i]) : brk_break(brk, cfg.points[i]);
+        if (!ok) {
+            brk_destroy(brk);
+            chip8_destroy(chip8);
+            return EXIT_FAILURE;
+        }
+        if (cfg.debug == 2) brk_stop(brk);
+    }
+
+    engine_t *eng = engine_init(cfg.engine, cfg.flags);
+    if (!eng) {
+        fprintf(stderr, "Cannot start %s engine\n", engine_name(cfg.engine));
+        chip8_destroy(chip8);
+        return EXIT_FAILURE;
+    }
 
     window_t *win = sdl_init(cfg.scale);
     if (!win) {
+        engine_destroy(eng);
         chip8_destroy(chip8);
         return EXIT_FAILURE;
     }
     sdl_palette(win, cfg.palette_idx);
 
+    /* the window is 64*scale wide, capture scales hires pixels */
+    capture_t *cap = NULL;
+    if (cfg.capture) {
+        int sc = cfg.scale / 2 < 1 ? 1 : cfg.scale / 2 > 16 ? 16 : cfg.scale / 2;
+        if (!(cap = capture_init(cfg.capture, sc, palettes[cfg.palette_idx & 1], 0))) {
+            sdl_destroy(win);
+            engine_destroy(eng);
+            chip8_destroy(chip8);
+            return EXIT_FAILURE;
+        }
+    }
+
 
     if (!cfg.nosound) {
         audio_volume = cfg.volume;
         sdl_audio_init();
     }
 
-    bool running = true;
-    uint64_t last_cycle = SDL_GetTicks();
-    uint64_t last_timer = last_cycle;
-    uint64_t cycles_accum = 0;
-
-    while (running) {
-        handle_events(chip8, win, &running);
-
-        if (!cfg.nosound)
-            sdl_audio_sound(chip8->ST > 0);
+    /* one state per 60 Hz tick, keyframe every second; a recording must
+       stay one continuous run, so it gets no rewind */
+    rewind_t *rw = cfg.rewind && !movie ? rewind_init((size_t)cfg.rewind * 60, 60) : NULL;
+    char state_path[1024];
+    snprintf(state_path, sizeof state_path, "%s.state", cfg.rom_path);
 
-        uint64_t now = SDL_GetTicks();
-        uint64_t delta = now - last_cycle;
-        last_cycle = now;
+    /* from here on a failure takes the same way out as a finished run */
+    xchg_t *x = xchg_init();
+    emu_t emu = { .c = chip8, .eng = eng, .rw = rw, .brk = brk, .cap = cap,
+                  .movie = movie, .x = x, .hz = cfg.hz, .state_path = state_path,
+                  .turbo = cfg.turbo && !brk, .turbo_speed = cfg.turbo_speed,
+                  .ff_since = SDL_GetTicksNS() };
+    if (emu.turbo) snprintf(emu.osd, sizeof emu.osd, "FF");
 
-        cycles_accum += delta * cfg.hz / 1000;
-        while (cycles_accum > 0) {
-            chip8_cycle(chip8);
-            if (cfg.debug == 2) break;
-            cycles_accum--;
+    /* the emulator paces itself; this thread blocks on vsync alone */
+    pthread_t emu_tid;
+    int  err = x ? pthread_create(&emu_tid, NULL, emu_thread, &emu) : 0;
+    bool ran = x && !err;
+    if (err) fprintf(stderr, "emulation thread: %s\n", strerror(err));
+    render_t rs;
+    jitter_init(&rs.interval);
+    jitter_init(&rs.age);
+    rs.skipped = rs.last = 0;
+    if (ran) {
+        while (xchg_running(x)) {
+            handle_events(x, win);
+            render(x, win, &rs);
         }
-
-        if (now - last_timer >= 1000 / 60) {
-            chip8_update(chip8);
-            sdl_audio_sound(chip8->ST > 0);
-            last_timer = now;
-        }
-
-        sdl_draw(chip8, win, cfg.scale);
+        pthread_join(emu_tid, NULL);
     }
 
     sdl_audio_destroy();
     sdl_destroy(win);
+    if (ran && chip8->hooks == &stats.hooks)
+        stats_print(stdout, &stats);
+    if (ran && prof) {
+        prof_print(stdout, prof);
+        if (prof_write(prof, chip8, cfg.prof))
+            printf("Profile written to %s.folded, %s.asm\n", cfg.prof, cfg.prof);
+    }
+    prof_destroy(prof);
+    if (cfg.stats && ran) {
+        pacer_print(stdout, &emu.pacer);
+        render_print(stdout, &rs, xchg_dropped(x));
+    }
+    if (cfg.stats && ran && !cfg.nosound)
+        sdl_audio_print(stdout);
+    if (ran && cap) capture_print(stdout, cap);
+    capture_destroy(cap);
+
+    if (movie && ran && movie_save(movie, cfg.record, emu.cycles, chip8_fb_hash(chip8)))
+        printf("Input movie written to %s (seed %u, %llu cycles)\n", cfg.record,
+               (unsigned)cfg.seed, (unsigned long long)emu.cycles);
+    movie_destroy(movie);
+    xchg_destroy(x);
+
+    rewind_destroy(rw);
+    brk_destroy(brk);
+    engine_destroy(eng);
     chip8_destroy(chip8);
     debug_destroy();
-    return 0;
+    return ran ? 0 : EXIT_FAILURE;
 }
@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "movie.h"
+
+#define END_MARK  0xFF
+
+movie_t* movie_init(int hz, unsigned quirks, uint32_t seed, uint64_t rom_hash)
+{
+    movie_t *m = calloc(1, sizeof *m);
+    if (!m) return NULL;
+    m->hz       = hz;
+    m->quirks   = quirks;
+    m->seed     = seed;
+    m->rom_hash = rom_hash;
+    return m;
+}
+
+void movie_destroy(movie_t *m)
+{
+    if (!m) return;
+    free(m->ev);
+    free(m);
+}
+
+bool movie_add(movie_t *m, uint64_t cycle, int key, bool down)
+{
+    if (m->count == m->cap) {
+        size_t      cap = m->cap ? m->cap * 2 : 256;
+        movie_ev_t *ev  = realloc(m->ev, cap * sizeof *ev);
+        if (!ev) return false;
+        m->ev  = ev;
+        m->cap = cap;
+    }
+    m->ev[m->count++] = (movie_ev_t){ cycle, key, down };
+    return true;
+}
+
+
+static void put_len(FILE *f, uint64_t v)
+{
+    while (v >= 0x80) { fputc((v & 0x7F) | 0x80, f); v >>= 7; }
+    fputc(v, f);
+}
+
+static bool get_len(FILE *f, uint64_t *v)
+{
+    int ch, shift = 0;
+    *v = 0;
+    do {
+        if ((ch = fgetc(f)) == EOF || shift > 63) return false;
+        *v |= (uint64_t)(ch & 0x7F) << shift;
+        shift += 7;
+    } while (ch & 0x80);
+    return true;
+}
+
+static void put_le(FILE *f, uint64_t v, int bytes)
+{
+    for (int i = 0; i < bytes; ++i)
+        fputc((v >> (8 * i)) & 0xFF, f);
+}
+
+static bool get_le(FILE *f, uint64_t *v, int bytes)
+{
+    *v = 0;
+    for (int i = 0; i < bytes; ++i) {
+        int ch = fgetc(f);
+        if (ch == EOF) return false;
+        *v |= (uint64_t)ch << (8 * i);
+    }
+    return true;
+}
+
+bool movie_save(movie_t *m, const char *path, uint64_t end, uint64_t fb_hash)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f) { perror(path); return false; }
+
+    m->end     = end;
+    m->fb_hash = fb_hash;
+
+    fwrite(MOVIE_MAGIC, 1, 4, f);
+    put_le(f, MOVIE_VERSION, 2);
+    put_le(f, m->hz, 2);
+    put_le(f, m->quirks, 2);
+    put_le(f, m->seed, 4);
+    put_le(f, m->rom_hash, 8);
+
+    uint64_t at = 0;
+    for (size_t i = 0; i < m->count; ++i) {
+        put_len(f, m->ev[i].cycle - at);
+        fputc(m->ev[i].key | (m->ev[i].down << 4), f);
+        at = m->ev[i].cycle;
+    }
+    put_len(f, end - at);
+    fputc(END_MARK, f);
+    put_le(f, fb_hash, 8);
+
+    bool ok = !ferror(f);
+    if (fclose(f) != 0) ok = false;
+    if (!ok) perror(path);
+    return ok;
+}
+
+movie_t* movie_load(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) { perror(path); return NULL; }
+
+    char     magic[4];
+    uint64_t ver, hz, quirks, seed, rom_hash;
+    if (fread(magic, 1, 4, f) != 4 || memcmp(magic, MOVIE_MAGIC, 4) != 0 ||
+        !get_le(f, &ver, 2) || ver != MOVIE_VERSION ||
+        !get_le(f, &hz, 2) || hz < 60 || !get_le(f, &quirks, 2) ||
+        !get_le(f, &seed, 4) || !get_le(f, &rom_hash, 8)) {
+        fprintf(stderr, "%s: not a version %d input movie\n", path, MOVIE_VERSION);
+        fclose(f);
+        return NULL;
+    }
+
+    movie_t *m = movie_init(hz, quirks, seed, rom_hash);
+    uint64_t at = 0, delta;
+    int      ch;
+    bool     ok = m != NULL;
+
+    while (ok) {
+        if (!get_len(f, &delta) || (ch = fgetc(f)) == EOF) { ok = false; break; }
+        at += delta;
+        if (ch == END_MARK) {
+            m->end = at;
+            ok = get_le(f, &m->fb_hash, 8);
+            break;
+        }
+        ok = movie_add(m, at, ch & 0xF, ch >> 4);
+    }
+    fclose(f);
+
+    if (!ok) {
+        fprintf(stderr, "%s: truncated input movie\n", path);
+        movie_destroy(m);
+        return NULL;
+    }
+    return m;
+}
+
+
+/* Same frame schedule as the recording: keys first, then cycles, then timers */
+void movie_play(const movie_t *m, engine_t *e, chip8_t *c)
+{
+    uint64_t done  = 0;
+    int      carry = 0;
+    size_t   i     = 0;
+
+    while (done < m->end) {
+        uint64_t n    = chip8_frame_cycles(m->hz, &carry);
+        bool     full = n <= m->end - done;
+        uint64_t stop = full ? done + n : m->end;
+
+        while (done < stop) {
+            for (; i < m->count && m->ev[i].cycle <= done; ++i)
+                c->keypad[m->ev[i].key] = m->ev[i].down;
+
+            uint64_t run = stop - done;
+            if (i < m->count && m->ev[i].cycle < stop) run = m->ev[i].cycle - done;
+            engine_run(e, c, run);
+            done += run;
+        }
+        if (full) chip8_update(c);
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include <stddef.h>
+#include "chip8.h"
+#include "engine.h"
+
+/*
+ * Input movie: the keypad changes of a deterministic run, stamped with
+ * the number of cycles executed before them.  Together with the seed,
+ * the frequency, the quirks and the ROM this replays a session bit for
+ * bit.
+ *
+ * File: "C8MV", u16 version, u16 hz, u16 QUIRK_* flags, u32 seed,
+ * u64 ROM hash, then one
+ * LEB128 cycle delta and one byte (key | down << 4) per event, closed
+ * by delta-to-end, 0xFF and the u64 framebuffer hash at the end.  The
+ * ROM hash is pack_hash, the one ROM packs are catalogued by.
+ */
+#define MOVIE_MAGIC     "C8MV"
+#define MOVIE_VERSION   3
+
+typedef struct {
+    uint64_t cycle;
+    uint8_t  key;
+    bool     down;
+} movie_ev_t;
+
+typedef struct {
+    int         hz;
+    unsigned    quirks;     /* of the profile recorded under */
+    uint32_t    seed;
+    uint64_t    rom_hash;
+    uint64_t    end;        /* cycles in the whole run      */
+    uint64_t    fb_hash;    /* chip8_fb_hash at the end     */
+    movie_ev_t *ev;
+    size_t      count;
+    size_t      cap;
+} movie_t;
+
+movie_t* movie_init(int hz, unsigned quirks, uint32_t seed, uint64_t rom_hash);
+void movie_destroy(movie_t *m);
+bool movie_add(movie_t *m, uint64_t cycle, int key, bool down);
+bool movie_save(movie_t *m, const char *path, uint64_t end, uint64_t fb_hash);
+movie_t* movie_load(const char *path);
+
+/* Headless replay at full speed; c must hold the ROM, already seeded
+   and set to the movie's profile */
+void movie_play(const movie_t *m, engine_t *e, chip8_t *c);
+
+#endif /* MOVIE_H */
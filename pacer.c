@@ -0,0 +1,79 @@
+#include <math.h>
+#include <SDL3/SDL.h>
+
+#include "pacer.h"
+
+/* OS sleeps overshoot by up to a scheduler tick; spin the rest */
+#define SPIN_NS   1500000ULL
+
+static uint64_t deadline(const pacer_t *p)
+{
+    return p->base + p->count * 1000000000ULL / p->hz;
+}
+
+void pacer_init(pacer_t *p, int hz)
+{
+    *p = (pacer_t){0};
+    p->hz   = hz;
+    p->base = p->last = SDL_GetTicksNS();
+    jitter_init(&p->frame);
+}
+
+void pacer_wait(pacer_t *p)
+{
+    p->count++;
+    uint64_t due = deadline(p);
+    uint64_t now = SDL_GetTicksNS();
+
+    if (now < due) {
+        if (due - now > SPIN_NS)
+            SDL_DelayNS(due - now - SPIN_NS);
+        while ((now = SDL_GetTicksNS()) < due)
+            ;
+    } else if (now - due > 1000000000ULL / p->hz) {
+        /* a frame or more behind (breakpoint, window drag): restart the
+           schedule instead of running the missed frames back to back */
+        p->late++;
+        p->base  = now;
+        p->count = 0;
+    }
+
+    jitter_add(&p->frame, now - p->last);
+    p->last = now;
+}
+
+uint64_t pacer_next(const pacer_t *p)
+{
+    return p->base + (p->count + 1) * 1000000000ULL / p->hz;
+}
+
+void pacer_print(FILE *f, const pacer_t *p)
+{
+    const jitter_t *j = &p->frame;
+    if (!j->n) return;
+    fprintf(f, "frames %llu, frame time mean %.3f ms, sd %.3f ms, "
+               "min %.3f ms, max %.3f ms, late %llu\n",
+            (unsigned long long)j->n, j->mean / 1e6, jitter_sd(j) / 1e6,
+            j->min / 1e6, j->max / 1e6, (unsigned long long)p->late);
+}
+
+
+void jitter_init(jitter_t *j)
+{
+    *j = (jitter_t){ .min = UINT64_MAX };
+}
+
+void jitter_add(jitter_t *j, uint64_t ns)
+{
+    j->n++;
+    if (ns < j->min) j->min = ns;
+    if (ns > j->max) j->max = ns;
+    double d = ns - j->mean;
+    j->mean += d / j->n;
+    j->m2   += d * (ns - j->mean);
+}
+
+double jitter_sd(const jitter_t *j)
+{
+    return j->n ? sqrt(j->m2 / j->n) : 0.0;
+}
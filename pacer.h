@@ -0,0 +1,41 @@
+#ifndef PACER_H
+#define PACER_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Frame pacer on SDL_GetTicksNS.  Deadlines are computed from the frame
+ * count rather than accumulated, so 60 Hz stays exact over any run.
+ * The wait sleeps through most of the gap and spins only the last bit.
+ */
+
+/* Interval statistics, ns */
+typedef struct {
+    uint64_t n;
+    uint64_t min, max;
+    double   mean, m2;      /* running mean and sum of squares (Welford) */
+} jitter_t;
+
+typedef struct {
+    uint64_t hz;
+    uint64_t base;          /* time of frame 0 of the current run     */
+    uint64_t count;         /* frames since base                      */
+    uint64_t last;          /* when the previous wait returned        */
+
+    jitter_t frame;         /* time between returns from the wait     */
+    uint64_t late;          /* deadlines missed by a whole frame      */
+} pacer_t;
+
+void pacer_init(pacer_t *p, int hz);
+/* Blocks until the next frame is due */
+void pacer_wait(pacer_t *p);
+/* When that will be, in SDL_GetTicksNS time */
+uint64_t pacer_next(const pacer_t *p);
+void pacer_print(FILE *f, const pacer_t *p);
+
+void jitter_init(jitter_t *j);
+void jitter_add(jitter_t *j, uint64_t ns);
+double jitter_sd(const jitter_t *j);
+
+#endif /* PACER_H */
@@ -0,0 +1,199 @@
+/* pack.c — read side of the ROM pack, see pack.h for the layout */
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "chip8.h"
+#include "pack.h"
+
+struct pack {
+    const uint8_t *map;
+    size_t         len;
+    uint32_t       count;
+    const uint8_t *entries;
+    const uint8_t *by_name;
+    const char    *names;
+    const uint8_t *data;
+};
+
+uint64_t pack_hash(const uint8_t *rom, size_t size)
+{
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for (size_t i = 0; i < size; ++i) {
+        h ^= rom[i];
+        h *= 0x100000001B3ULL;
+    }
+    return h;
+}
+
+
+static uint32_t get16(const uint8_t *p) { return p[0] | p[1] << 8; }
+static uint32_t get32(const uint8_t *p) { return get16(p) | (uint32_t)get16(p + 2) << 16; }
+static uint64_t get64(const uint8_t *p) { return get32(p) | (uint64_t)get32(p + 4) << 32; }
+
+static const uint8_t *entry(const pack_t *p, size_t i)
+{
+    return p->entries + i * PACK_ENTRY;
+}
+
+static const char *entry_name(const pack_t *p, size_t i)
+{
+    return p->names + get32(entry(p, i) + 16);
+}
+
+/* Everything lookups touch is checked once here, so they need no checks */
+static bool valid(pack_t *p, const char *path)
+{
+    const uint8_t *h = p->map;
+    const char    *why = NULL;
+
+    if (p->len < PACK_HEADER || memcmp(h, PACK_MAGIC, 4) != 0 ||
+        get16(h + 4) != PACK_VERSION) {
+        fprintf(stderr, "%s: not a version %d ROM pack\n", path, PACK_VERSION);
+        return false;
+    }
+
+    size_t count = get32(h + 8), names = get32(h + 12), data = get32(h + 16);
+    size_t index = PACK_HEADER + count * (PACK_ENTRY + 4);
+
+    if (index > names || names > data || data > p->len) why = "bad section offsets";
+    else if (names == data || p->map[data - 1] != 0)    why = "unterminated names";
+
+    for (size_t i = 0; !why && i < count; ++i) {
+        const uint8_t *e = h + PACK_HEADER + i * PACK_ENTRY;
+        size_t off = get32(e + 8), size = get32(e + 12);
+        if (off > p->len - data || size > p->len - data - off) why = "ROM outside the pack";
+        else if (size == 0 || size > MEM_SIZE - 0x200)    why = "bad ROM size";
+        else if (get32(e + 16) >= data - names)           why = "bad name offset";
+        else if (get32(h + PACK_HEADER + count * PACK_ENTRY + i * 4) >= count)
+            why = "bad name index";
+        else if (i && get64(e) < get64(e - PACK_ENTRY))   why = "entries not sorted";
+    }
+    if (why) {
+        fprintf(stderr, "%s: %s\n", path, why);
+        return false;
+    }
+
+    p->count     = count;
+    p->entries   = h + PACK_HEADER;
+    p->by_name   = p->entries + count * PACK_ENTRY;
+    p->names     = (const char *)h + names;
+    p->data      = h + data;
+    return true;
+}
+
+pack_t* pack_open(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) { perror(path); return NULL; }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror(path);
+        close(fd);
+        return NULL;
+    }
+
+    if (st.st_size == 0) {
+        fprintf(stderr, "%s: empty ROM pack\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);                  /* the mapping keeps the file */
+    if (map == MAP_FAILED) { perror(path); return NULL; }
+
+    pack_t *p = calloc(1, sizeof *p);
+    if (!p) { munmap(map, st.st_size); return NULL; }
+
+    p->map = map;
+    p->len = st.st_size;
+    if (!valid(p, path)) {
+        pack_close(p);
+        return NULL;
+    }
+    return p;
+}
+
+void pack_close(pack_t *p)
+{
+    if (!p) return;
+    munmap((void *)p->map, p->len);
+    free(p);
+}
+
+
+size_t pack_count(const pack_t *p)
+{
+    return p->count;
+}
+
+void pack_get(const pack_t *p, size_t i, pack_rom_t *r)
+{
+    const uint8_t *e = entry(p, i);
+    r->hash    = get64(e);
+    r->data    = p->data + get32(e + 8);
+    r->size    = get32(e + 12);
+    r->name    = p->names + get32(e + 16);
+    r->hz      = get16(e + 20);
+    r->palette = e[22] == PACK_NO_PALETTE ? -1 : e[22];
+    r->quirks  = get32(e + 24);
+}
+
+bool pack_find(const pack_t *p, const char *name, pack_rom_t *r)
+{
+    size_t lo = 0, hi = p->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        size_t i   = get32(p->by_name + mid * 4);
+        int    cmp = strcmp(name, entry_name(p, i));
+        if (cmp == 0) { pack_get(p, i, r); return true; }
+        if (cmp < 0) hi = mid;
+        else lo = mid + 1;
+    }
+    return false;
+}
+
+bool pack_find_hash(const pack_t *p, uint64_t hash, pack_rom_t *r)
+{
+    size_t lo = 0, hi = p->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (get64(entry(p, mid)) < hash) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == p->count || get64(entry(p, lo)) != hash) return false;
+    pack_get(p, lo, r);
+    return true;
+}
+
+
+bool pack_spec(const char *spec, char *path, size_t len, const char **sel)
+{
+    for (const char *s = strstr(spec, ".c8p"); s; s = strstr(s + 1, ".c8p")) {
+        if (s[4] != ':' && s[4] != '#') continue;
+        size_t n = s + 4 - spec;
+        if (n >= len) return false;
+        memcpy(path, spec, n);
+        path[n] = 0;
+        *sel = s + 4;
+        return true;
+    }
+    return false;
+}
+
+bool pack_select(const pack_t *p, const char *sel, pack_rom_t *r)
+{
+    if (*sel == ':') return pack_find(p, sel + 1, r);
+
+    char    *end;
+    uint64_t hash = strtoull(sel + 1, &end, 16);
+    return *sel == '#' && sel[1] && !*end && pack_find_hash(p, hash, r);
+}
@@ -0,0 +1,62 @@
+#ifndef PACK_H
+#define PACK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * ROM pack: many ROMs in one file, mapped read-only and never copied
+ * except into the machine.  Little endian throughout:
+ *
+ *   header   "C8PK", u16 version, u16 0, u32 count,
+ *            u32 offset of the names, u32 offset of the data
+ *   entries  count x PACK_ENTRY bytes, sorted by hash:
+ *            u64 hash, u32 data offset, u32 size, u32 name offset,
+ *            u16 hz, u8 palette, u8 0, u32 quirks, u32 0
+ *   by name  count x u32 entry index, sorted by name
+ *   names    NUL-terminated strings
+ *   data     ROM images, identical ones stored once
+ *
+ * The hash is pack_hash of the ROM bytes, the same one input movies
+ * record.  hz 0 and palette 0xFF mean "not set".
+ */
+#define PACK_MAGIC      "C8PK"
+#define PACK_VERSION    1
+#define PACK_HEADER     20
+#define PACK_ENTRY      32
+#define PACK_NO_PALETTE 0xFF
+
+typedef struct pack pack_t;
+
+typedef struct {
+    const char    *name;
+    const uint8_t *data;        /* points into the mapping */
+    size_t         size;
+    uint64_t       hash;
+    int            hz;          /* 0 – not set  */
+    int            palette;     /* -1 – not set */
+    uint32_t       quirks;      /* QUIRK_* flags of the ROM's profile */
+} pack_rom_t;
+
+/* FNV-1a of the ROM image */
+uint64_t pack_hash(const uint8_t *rom, size_t size);
+
+/* Maps and validates the whole pack, NULL (with a message) on failure */
+pack_t* pack_open(const char *path);
+void pack_close(pack_t *p);
+
+size_t pack_count(const pack_t *p);
+void pack_get(const pack_t *p, size_t i, pack_rom_t *r);
+bool pack_find(const pack_t *p, const char *name, pack_rom_t *r);
+bool pack_find_hash(const pack_t *p, uint64_t hash, pack_rom_t *r);
+
+/*
+ * "pack.c8p:name" or "pack.c8p#hash" (hex): copies the pack path out of
+ * spec, sel points at the ':' or '#'.  False for a plain ROM path.
+ */
+bool pack_spec(const char *spec, char *path, size_t len, const char **sel);
+/* Looks the selector up, by hash after '#' and by name after ':' */
+bool pack_select(const pack_t *p, const char *sel, pack_rom_t *r);
+
+#endif /* PACK_H */
@@ -0,0 +1,303 @@
+/* packer.c — builds and lists ROM packs, see pack.h for the layout */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "pack.h"
+
+typedef struct {
+    char     *name;
+    uint8_t  *data;
+    size_t    size;
+    uint64_t  hash;
+    uint32_t  offset;       /* in the data section */
+    int       hz;
+    int       palette;
+    uint32_t  quirks;
+} item_t;
+
+typedef struct {
+    item_t *items;
+    size_t  count;
+    int     hz;             /* metadata for the ROMs that follow */
+    int     palette;
+    uint32_t quirks;
+} packer_t;
+
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s -o <out.c8p> [options] <rom.ch8...>\n"
+            "       %s -t <pack.c8p>\n"
+            "  -o <file>    pack to write\n"
+            "  -l <file>    read ROMs from file, one per line:\n"
+            "               path [hz=N] [palette=bw|amber] [quirks=P]\n"
+            "  -hz <n>      recommended frequency of the ROMs that follow\n"
+            "  -p <p>       palette of the ROMs that follow (bw, amber, - unset)\n"
+            "  -quirks <p>  quirk profile of the ROMs that follow: default, vip,\n"
+            "               chip48, schip, xochip or its QUIRK_* flags\n"
+            "  -t <file>    list the contents of a pack\n"
+            , prog, prog);
+}
+
+static bool parse_palette(const char *s, int *palette)
+{
+    if      (!strcmp(s, "bw"))    *palette = 0;
+    else if (!strcmp(s, "amber")) *palette = 1;
+    else if (!strcmp(s, "-"))     *palette = -1;
+    else return false;
+    return true;
+}
+
+/* Stored as the profile's flags, so readers need not share the numbering */
+static bool parse_quirks(const char *s, uint32_t *quirks)
+{
+    chip8_profile_t p;
+    if (!chip8_profile_parse(s, &p)) return false;
+    *quirks = chip8_profile_quirks(p);
+    return true;
+}
+
+/* The catalog name is the file name without its directory */
+static bool add_rom(packer_t *pk, const char *path, int hz, int palette, uint32_t quirks)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) { perror(path); return false; }
+
+    uint8_t *data = malloc(MEM_SIZE - 0x200 + 1);
+    size_t   size = data ? fread(data, 1, MEM_SIZE - 0x200 + 1, f) : 0;
+    fclose(f);
+
+    if (size == 0 || size > MEM_SIZE - 0x200) {
+        fprintf(stderr, "%s: %s\n", path, size ? "ROM too big" : "empty ROM");
+        free(data);
+        return false;
+    }
+
+    if (hz < 0 || hz > 0xFFFF) hz = 0;
+
+    const char *base = strrchr(path, '/');
+    item_t     *items = realloc(pk->items, (pk->count + 1) * sizeof *items);
+    if (!items) { free(data); return false; }
+    pk->items = items;
+    pk->items[pk->count++] = (item_t){
+        .name = strdup(base ? base + 1 : path), .data = data, .size = size,
+        .hash = pack_hash(data, size), .hz = hz, .palette = palette, .quirks = quirks,
+    };
+    return true;
+}
+
+static bool add_list(packer_t *pk, const char *list)
+{
+    FILE *f = fopen(list, "r");
+    if (!f) { perror(list); return false; }
+
+    char line[4096];
+    bool ok = true;
+    for (int n = 1; ok && fgets(line, sizeof line, f); ++n) {
+        line[strcspn(line, "\r\n")] = 0;
+        if (!line[0] || line[0] == '#') continue;
+
+        char    *path = strtok(line, " \t"), *tok;
+        int      hz = pk->hz, palette = pk->palette;
+        uint32_t quirks = pk->quirks;
+        while (ok && (tok = strtok(NULL, " \t"))) {
+            if      (!strncmp(tok, "hz=", 3))      hz = atoi(tok + 3);
+            else if (!strncmp(tok, "palette=", 8)) ok = parse_palette(tok + 8, &palette);
+            else if (!strncmp(tok, "quirks=", 7))  ok = parse_quirks(tok + 7, &quirks);
+            else ok = false;
+        }
+        if (!ok) fprintf(stderr, "%s:%d: bad field '%s'\n", list, n, tok);
+        else ok = add_rom(pk, path, hz, palette, quirks);
+    }
+    fclose(f);
+    return ok;
+}
+
+
+static int by_hash(const void *a, const void *b)
+{
+    const item_t *x = a, *y = b;
+    return x->hash < y->hash ? -1 : x->hash > y->hash;
+}
+
+static const item_t *sorted_items;
+
+static int by_name(const void *a, const void *b)
+{
+    return strcmp(sorted_items[*(const uint32_t *)a].name,
+                  sorted_items[*(const uint32_t *)b].name);
+}
+
+static void put_le(FILE *f, uint64_t v, int bytes)
+{
+    for (int i = 0; i < bytes; ++i)
+        fputc((v >> (8 * i)) & 0xFF, f);
+}
+
+static bool write_pack(packer_t *pk, const char *path)
+{
+    item_t *it = pk->items;
+    size_t  n  = pk->count;
+
+    qsort(it, n, sizeof *it, by_hash);
+
+    /* one copy of every distinct image; equal hashes must be equal ROMs */
+    size_t data_len = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (i && it[i].hash == it[i - 1].hash) {
+            if (it[i].size != it[i - 1].size || memcmp(it[i].data, it[i - 1].data, it[i].size)) {
+                fprintf(stderr, "%s and %s: hash collision\n", it[i - 1].name, it[i].name);
+                return false;
+            }
+            it[i].offset = it[i - 1].offset;
+            continue;
+        }
+        it[i].offset = data_len;
+        data_len += it[i].size;
+    }
+
+    uint32_t *order = malloc(n * sizeof *order);
+    if (n && !order) return false;
+    for (size_t i = 0; i < n; ++i) order[i] = i;
+    sorted_items = it;
+    qsort(order, n, sizeof *order, by_name);
+
+    size_t names_len = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (i && !strcmp(it[order[i]].name, it[order[i - 1]].name)) {
+            fprintf(stderr, "%s: name used twice\n", it[order[i]].name);
+            free(order);
+            return false;
+        }
+        names_len += strlen(it[i].name) + 1;
+    }
+    if (!names_len) names_len = 1;     /* keeps the section terminated */
+
+    size_t names = PACK_HEADER + n * (PACK_ENTRY + 4), data = names + names_len;
+    if (data + data_len > UINT32_MAX) {
+        fprintf(stderr, "%s: pack too big\n", path);
+        free(order);
+        return false;
+    }
+
+    FILE *f = fopen(path, "wb");
+    if (!f) { perror(path); free(order); return false; }
+
+    fwrite(PACK_MAGIC, 1, 4, f);
+    put_le(f, PACK_VERSION, 2);
+    put_le(f, 0, 2);
+    put_le(f, n, 4);
+    put_le(f, names, 4);
+    put_le(f, data, 4);
+
+    size_t name_off = 0;
+    for (size_t i = 0; i < n; ++i) {
+        put_le(f, it[i].hash, 8);
+        put_le(f, it[i].offset, 4);
+        put_le(f, it[i].size, 4);
+        put_le(f, name_off, 4);
+        put_le(f, it[i].hz, 2);
+        put_le(f, it[i].palette < 0 ? PACK_NO_PALETTE : it[i].palette, 1);
+        put_le(f, 0, 1);
+        put_le(f, it[i].quirks, 4);
+        put_le(f, 0, 4);
+        name_off += strlen(it[i].name) + 1;
+    }
+    for (size_t i = 0; i < n; ++i)
+        put_le(f, order[i], 4);
+    for (size_t i = 0; i < n; ++i)
+        fwrite(it[i].name, 1, strlen(it[i].name) + 1, f);
+    if (!n) fputc(0, f);
+    for (size_t i = 0; i < n; ++i)
+        if (!i || it[i].hash != it[i - 1].hash)
+            fwrite(it[i].data, 1, it[i].size, f);
+    free(order);
+
+    bool ok = !ferror(f);
+    if (fclose(f) != 0) ok = false;
+    if (!ok) perror(path);
+    else printf("%s: %zu ROMs, %zu bytes of images\n", path, n, data_len);
+    return ok;
+}
+
+static int list_pack(const char *path)
+{
+    static const char *palettes[] = { "bw", "amber" };
+
+    pack_t *p = pack_open(path);
+    if (!p) return EXIT_FAILURE;
+
+    for (size_t i = 0; i < pack_count(p); ++i) {
+        pack_rom_t r;
+        pack_get(p, i, &r);
+        printf("%016llx\t%5zu\t", (unsigned long long)r.hash, r.size);
+        if (r.hz) printf("hz=%d ", r.hz);
+        if (r.palette >= 0 && r.palette < 2) printf("palette=%s ", palettes[r.palette]);
+        chip8_profile_t prof;
+        if (!chip8_profile_find(r.quirks, &prof)) printf("quirks=0x%x ", (unsigned)r.quirks);
+        else if (prof)                            printf("quirks=%s ", chip8_profile_name(prof));
+        printf("\t%s\n", r.name);
+    }
+    pack_close(p);
+    return EXIT_SUCCESS;
+}
+
+
+int main(int argc, char *argv[])
+{
+    packer_t    pk  = { .palette = -1 };
+    const char *out = NULL;
+    bool        ok  = true;
+
+    for (int i = 1; ok && i < argc; ++i) {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            return list_pack(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out = argv[++i];
+        }
+        else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            ok = add_list(&pk, argv[++i]);
+        }
+        else if (strcmp(argv[i], "-hz") == 0 && i + 1 < argc) {
+            pk.hz = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            if (!parse_palette(argv[++i], &pk.palette)) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "-quirks") == 0 && i + 1 < argc) {
+            if (!parse_quirks(argv[++i], &pk.quirks)) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (argv[i][0] != '-') {
+            ok = add_rom(&pk, argv[i], pk.hz, pk.palette, pk.quirks);
+        }
+        else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (ok && !out) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (ok) ok = write_pack(&pk, out);
+
+    for (size_t i = 0; i < pk.count; ++i) {
+        free(pk.items[i].name);
+        free(pk.items[i].data);
+    }
+    free(pk.items);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,12 @@
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include <stdint.h>
+
+/* ARGB colours by plane bits: off, plane 1, plane 2, both */
+static const uint32_t palettes[2][4] = {
+    {0x00000000, 0xFFFFFFFF, 0xFF808080, 0xFFC0C0C0},  /* 0 : black & white          */
+    {0xFF2A1C00, 0xFFFFB000, 0xFFA05A00, 0xFFFFE0A0}   /* 1 : amber / dark-chocolate */
+};
+
+#endif /* PALETTE_H */
@@ -0,0 +1,228 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "pool.h"
+
+/*
+ * Every worker owns a range of job indices packed into one 64-bit word
+ * (lo << 32 | hi).  The owner pops from the top end, idle workers steal
+ * the lower half of a victim's range.  Both sides use CAS, no locks.
+ */
+typedef struct {
+    uint64_t range;
+    char     pad[56];        /* keep ranges on separate cache lines */
+} deque_t;
+
+struct pool {
+    deque_t  *dq;
+    int       n;
+    pool_fn   fn;
+    void     *ctx;
+
+    /* persistent threads 1..n-1 wait here between batches */
+    pthread_t      *tid;
+    struct worker  *w;
+    pthread_mutex_t lock;
+    pthread_cond_t  start, done;
+    uint64_t        batch;       /* batches started */
+    int             finished;    /* threads done with the current one */
+    bool            stop;
+};
+
+typedef struct worker {
+    pool_t   *p;
+    int       id;
+} worker_t;
+
+#define LO(r)  ((uint32_t)((r) >> 32))
+#define HI(r)  ((uint32_t)(r))
+#define RANGE(lo, hi) (((uint64_t)(lo) << 32) | (uint32_t)(hi))
+
+
+int pool_cpus(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+/* Owner side: take the last job of our own range */
+static bool pool_pop(deque_t *d, uint32_t *job)
+{
+    uint64_t r = __atomic_load_n(&d->range, __ATOMIC_ACQUIRE);
+    while (LO(r) < HI(r)) {
+        uint64_t want = RANGE(LO(r), HI(r) - 1);
+        if (__atomic_compare_exchange_n(&d->range, &r, want, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            *job = HI(r) - 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Thief side: move the lower half of victim's range into our own deque */
+static bool pool_steal(deque_t *victim, deque_t *self)
+{
+    uint64_t r = __atomic_load_n(&victim->range, __ATOMIC_ACQUIRE);
+    while (LO(r) < HI(r)) {
+        uint32_t take = (HI(r) - LO(r) + 1) / 2;
+        uint64_t want = RANGE(LO(r) + take, HI(r));
+        if (__atomic_compare_exchange_n(&victim->range, &r, want, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            __atomic_store_n(&self->range, RANGE(LO(r), LO(r) + take),
+                             __ATOMIC_RELEASE);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void pool_work(worker_t *w)
+{
+    pool_t   *p = w->p;
+    deque_t  *self = &p->dq[w->id];
+    uint32_t  seed = 2463534242u ^ (uint32_t)w->id;
+
+    for (;;) {
+        uint32_t job;
+        while (pool_pop(self, &job))
+            p->fn(p->ctx, job, w->id);
+
+        /* Own range is empty: scan victims starting at a random one */
+        bool stolen = false;
+        seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+        for (int k = 0; k < p->n && !stolen; ++k) {
+            int v = (int)((seed + (uint32_t)k) % (uint32_t)p->n);
+            if (v != w->id)
+                stolen = pool_steal(&p->dq[v], self);
+        }
+        /* Jobs are never added after start, so empty everywhere means done */
+        if (!stolen) break;
+    }
+}
+
+/* Threads 1..n-1: one pool_work per batch until pool_destroy */
+static void *pool_thread(void *arg)
+{
+    worker_t *w = arg;
+    pool_t   *p = w->p;
+    uint64_t  seen = 0;
+
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        while (p->batch == seen && !p->stop)
+            pthread_cond_wait(&p->start, &p->lock);
+        if (p->stop) break;
+        seen = p->batch;
+        pthread_mutex_unlock(&p->lock);
+
+        pool_work(w);
+
+        pthread_mutex_lock(&p->lock);
+        if (++p->finished == p->n - 1) pthread_cond_signal(&p->done);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+pool_t* pool_init(int threads)
+{
+    if (threads < 1) threads = pool_cpus();
+
+    pool_t *p = calloc(1, sizeof *p);
+    if (!p) { perror("pool"); return NULL; }
+    p->dq  = calloc(threads, sizeof *p->dq);
+    p->w   = calloc(threads, sizeof *p->w);
+    p->tid = calloc(threads, sizeof *p->tid);
+    if (!p->dq || !p->w || !p->tid) {
+        perror("pool");
+        free(p->tid); free(p->w); free(p->dq); free(p);
+        return NULL;
+    }
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->start, NULL);
+    pthread_cond_init(&p->done, NULL);
+
+    /* the caller is worker 0; a thread that cannot start shrinks the pool */
+    p->n = 1;
+    for (int i = 0; i < threads; ++i) {
+        p->w[i].p  = p;
+        p->w[i].id = i;
+        if (i == 0) continue;
+        int err = pthread_create(&p->tid[i], NULL, pool_thread, &p->w[i]);
+        if (err) {
+            fprintf(stderr, "pool: %d of %d threads started: %s\n", i, threads, strerror(err));
+            break;
+        }
+        p->n = i + 1;
+    }
+    return p;
+}
+
+void pool_destroy(pool_t *p)
+{
+    if (!p) return;
+    pthread_mutex_lock(&p->lock);
+    p->stop = true;
+    pthread_cond_broadcast(&p->start);
+    pthread_mutex_unlock(&p->lock);
+    for (int i = 1; i < p->n; ++i)
+        pthread_join(p->tid[i], NULL);
+
+    pthread_cond_destroy(&p->done);
+    pthread_cond_destroy(&p->start);
+    pthread_mutex_destroy(&p->lock);
+    free(p->tid);
+    free(p->w);
+    free(p->dq);
+    free(p);
+}
+
+void pool_exec(pool_t *p, size_t count, pool_fn fn, void *ctx)
+{
+    /* Initial split: contiguous equal ranges, stealing balances the rest */
+    for (int i = 0; i < p->n; ++i)
+        p->dq[i].range = RANGE(count * i / p->n, count * (i + 1) / p->n);
+    p->fn  = fn;
+    p->ctx = ctx;
+    if (p->n == 1) {
+        pool_work(&p->w[0]);
+        return;
+    }
+
+    pthread_mutex_lock(&p->lock);
+    p->finished = 0;
+    p->batch++;
+    pthread_cond_broadcast(&p->start);
+    pthread_mutex_unlock(&p->lock);
+
+    pool_work(&p->w[0]);
+
+    pthread_mutex_lock(&p->lock);
+    while (p->finished < p->n - 1)
+        pthread_cond_wait(&p->done, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+}
+
+void pool_run(size_t count, int threads, pool_fn fn, void *ctx)
+{
+    if (threads < 1) threads = pool_cpus();
+    if ((size_t)threads > count) threads = count ? (int)count : 1;
+
+    pool_t *p = pool_init(threads);
+    if (!p) {
+        /* no pool: the jobs still run, on this thread */
+        for (size_t i = 0; i < count; ++i)
+            fn(ctx, i, 0);
+        return;
+    }
+    pool_exec(p, count, fn, ctx);
+    pool_destroy(p);
+}
@@ -0,0 +1,21 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+/* Job callback: idx is the job index, worker the executing thread (0..n-1) */
+typedef void (*pool_fn)(void *ctx, size_t idx, int worker);
+
+typedef struct pool pool_t;
+
+int  pool_cpus(void);
+/* count jobs on threads started for this call alone (threads < 1 – all cores) */
+void pool_run(size_t count, int threads, pool_fn fn, void *ctx);
+
+/* The same on threads kept between calls, for callers with many small batches */
+pool_t* pool_init(int threads);
+void pool_destroy(pool_t *p);
+/* Returns when all count jobs are done; the caller works as worker 0 */
+void pool_exec(pool_t *p, size_t count, pool_fn fn, void *ctx);
+
+#endif /* POOL_H */
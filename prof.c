@@ -0,0 +1,334 @@
+/* prof.c — per-address and per-call-stack profile, see prof.h */
+#include <stdlib.h>
+#include <string.h>
+
+#include "prof.h"
+#include "dbg.h"
+
+#define NO_ENTRY  0xFFFFFFFFu       /* a stack level pushed while not watched */
+
+/* One call stack: a path from the root through routine entries */
+typedef struct {
+    uint32_t entry;
+    int32_t  parent, child, next;   /* first child, next sibling, -1: none */
+    uint64_t self;                  /* instructions run with this stack on top */
+    uint64_t pixels;
+    uint64_t frames;
+    uint64_t calls;
+} node_t;
+
+enum { M_SELF, M_PIXELS, M_FRAMES, M_COUNT };
+
+struct prof {
+    chip8_hooks_t hooks;
+
+    uint64_t count[MEM_SIZE];       /* instructions at each address */
+    uint64_t pixels[MEM_SIZE];      /* DRW pixels at each address */
+
+    node_t  *node;
+    int32_t  nodes, cap;
+
+    /* the stack as last seen: node and return address per level */
+    int      depth;
+    int32_t  at[17];
+    uint16_t ret[16];
+};
+
+
+static int32_t child(prof_t *p, int32_t parent, uint32_t entry)
+{
+    for (int32_t i = p->node[parent].child; i >= 0; i = p->node[i].next)
+        if (p->node[i].entry == entry) return i;
+
+    if (p->nodes == PROF_NODES) return parent;
+    if (p->nodes == p->cap) {
+        int32_t cap = p->cap * 2;
+        node_t *n   = realloc(p->node, cap * sizeof *n);
+        if (!n) return parent;
+        p->node = n;
+        p->cap  = cap;
+    }
+    int32_t i = p->nodes++;
+    p->node[i] = (node_t){ .entry = entry, .parent = parent, .child = -1,
+                           .next = p->node[parent].child };
+    p->node[parent].child = i;
+    return i;
+}
+
+/*
+ * Follows c's stack: levels whose return address changed are dropped,
+ * new ones are entered.  Only a call seen as it happened names its
+ * routine, by where it went; anything else (a state load) is unnamed.
+ */
+static void follow(prof_t *p, const chip8_t *c, uint16_t pc)
+{
+    int sp = c->SP < 16 ? c->SP : 16;
+    int keep = 0;
+
+    while (keep < p->depth && keep < sp && c->memory.stack[keep] == p->ret[keep])
+        ++keep;
+    p->depth = keep;
+    for (; p->depth < sp; ++p->depth) {
+        bool    named = p->depth == sp - 1 && p->depth == keep;
+        int32_t n     = child(p, p->at[p->depth], named ? pc : NO_ENTRY);
+        p->ret[p->depth]    = c->memory.stack[p->depth];
+        p->at[p->depth + 1] = n;
+        p->node[n].calls++;
+    }
+}
+
+static void prof_exec(void *ud, chip8_t *c, uint16_t op)
+{
+    prof_t  *p  = ud;
+    uint16_t pc = c->PC - 2;
+    (void)op;
+
+    if (c->SP != p->depth) follow(p, c, pc);
+    p->count[pc]++;
+    p->node[p->at[p->depth]].self++;
+}
+
+static void prof_draw(void *ud, chip8_t *c, int drawn, int erased)
+{
+    prof_t *p = ud;
+    (void)erased;
+
+    p->pixels[(uint16_t)(c->PC - 2)] += drawn;
+    p->node[p->at[p->depth]].pixels  += drawn;
+}
+
+static void prof_frame(void *ud, chip8_t *c)
+{
+    prof_t *p = ud;
+
+    if (c->SP != p->depth) follow(p, c, c->PC);
+    p->node[p->at[p->depth]].frames++;
+}
+
+
+void prof_sample(prof_t *p, const chip8_t *c, uint64_t weight)
+{
+    int     sp = c->SP < 16 ? c->SP : 16;
+    int32_t n  = 0;
+
+    for (int i = 0; i < sp; ++i) {
+        uint16_t call = c->memory.stack[i] - 2;
+        uint16_t op   = c->memory.memory[call] << 8 | c->memory.memory[(call + 1) & (MEM_SIZE - 1)];
+        n = child(p, n, (op & 0xF000) == 0x2000 ? op & 0xFFFu : NO_ENTRY);
+    }
+    p->count[c->PC] += weight;
+    p->node[n].self += weight;
+}
+
+
+prof_t* prof_init(void)
+{
+    prof_t *p = calloc(1, sizeof *p);
+    if (!p) return NULL;
+
+    p->cap  = 256;
+    p->node = malloc(p->cap * sizeof *p->node);
+    if (!p->node) { free(p); return NULL; }
+    p->nodes   = 1;
+    p->node[0] = (node_t){ .entry = 0x200, .parent = -1, .child = -1, .next = -1 };
+
+    p->hooks.ud    = p;
+    p->hooks.exec  = prof_exec;
+    p->hooks.draw  = prof_draw;
+    p->hooks.frame = prof_frame;
+    return p;
+}
+
+void prof_destroy(prof_t *p)
+{
+    if (!p) return;
+    free(p->node);
+    free(p);
+}
+
+const chip8_hooks_t* prof_hooks(prof_t *p)
+{
+    return &p->hooks;
+}
+
+/* Children are always created after their parent, so one pass in order maps every node */
+void prof_merge(prof_t *dst, const prof_t *src)
+{
+    int32_t *map = malloc(src->nodes * sizeof *map);
+    if (!map) return;
+
+    for (uint32_t a = 0; a < MEM_SIZE; ++a) {
+        dst->count[a]  += src->count[a];
+        dst->pixels[a] += src->pixels[a];
+    }
+    map[0] = 0;
+    for (int32_t i = 0; i < src->nodes; ++i) {
+        const node_t *s = &src->node[i];
+        if (i) map[i] = child(dst, map[s->parent], s->entry);
+
+        node_t *d = &dst->node[map[i]];
+        d->self   += s->self;
+        d->pixels += s->pixels;
+        d->frames += s->frames;
+        d->calls  += s->calls;
+    }
+    free(map);
+}
+
+
+static const char *name(char *buf, size_t len, uint32_t entry)
+{
+    if (entry == NO_ENTRY) return "?";
+    snprintf(buf, len, entry == 0x200 ? "main" : "sub_%03X", entry);
+    return buf;
+}
+
+static uint64_t metric(const node_t *n, int m)
+{
+    return m == M_SELF ? n->self : m == M_PIXELS ? n->pixels : n->frames;
+}
+
+/* One line per stack that has any of the metric itself */
+static void folded(FILE *f, const prof_t *p, int m)
+{
+    for (int32_t i = 0; i < p->nodes; ++i) {
+        uint64_t v = metric(&p->node[i], m);
+        if (!v) continue;
+
+        int32_t path[17];           /* the root and 16 stack levels */
+        int     n = 0;
+        for (int32_t k = i; k >= 0; k = p->node[k].parent)
+            path[n++] = k;
+        while (n--) {
+            char buf[16];
+            fprintf(f, "%s%c", name(buf, sizeof buf, p->node[path[n]].entry), n ? ';' : ' ');
+        }
+        fprintf(f, "%llu\n", (unsigned long long)v);
+    }
+}
+
+/* Per routine, over all the stacks it appears in */
+typedef struct {
+    uint32_t entry;
+    uint64_t self, incl, pixels, frames, calls;
+} routine_t;
+
+/* Entered again below itself: the outer call's inclusive count has it already */
+static bool recursive(const prof_t *p, int32_t i)
+{
+    for (int32_t k = p->node[i].parent; k >= 0; k = p->node[k].parent)
+        if (p->node[k].entry == p->node[i].entry) return true;
+    return false;
+}
+
+static int by_incl(const void *a, const void *b)
+{
+    const routine_t *x = a, *y = b;
+    return x->incl < y->incl ? 1 : x->incl > y->incl ? -1 : (x->entry > y->entry) - (x->entry < y->entry);
+}
+
+static routine_t* routines(const prof_t *p, int *count, uint64_t *total)
+{
+    uint64_t  *incl = calloc(p->nodes, sizeof *incl);
+    routine_t *r    = calloc(p->nodes, sizeof *r);
+    int        n    = 0;
+
+    *total = 0;
+    if (!incl || !r) { free(incl); free(r); return NULL; }
+
+    /* children come after parents: sum inclusive counts backwards */
+    for (int32_t i = p->nodes - 1; i >= 0; --i) {
+        incl[i] += p->node[i].self;
+        if (p->node[i].parent >= 0) incl[p->node[i].parent] += incl[i];
+        *total += p->node[i].self;
+    }
+    for (int32_t i = 0; i < p->nodes; ++i) {
+        const node_t *s = &p->node[i];
+        int k = 0;
+        while (k < n && r[k].entry != s->entry) ++k;
+        if (k == n) r[n++].entry = s->entry;
+        r[k].self   += s->self;
+        r[k].pixels += s->pixels;
+        r[k].frames += s->frames;
+        r[k].calls  += s->calls;
+        if (!recursive(p, i)) r[k].incl += incl[i];     /* recursion counted once */
+    }
+    free(incl);
+    qsort(r, n, sizeof *r, by_incl);
+    *count = n;
+    return r;
+}
+
+void prof_print(FILE *f, const prof_t *p)
+{
+    uint64_t   total;
+    int        n;
+    routine_t *r = routines(p, &n, &total);
+    if (!r) return;
+
+    fprintf(f, "%-10s %14s %7s %14s %7s %12s %10s %12s\n",
+            "routine", "inclusive", "share", "self", "share", "calls", "frames", "pixels");
+    for (int i = 0; i < n && i < 20; ++i) {
+        char buf[16];
+        fprintf(f, "%-10s %14llu %6.2f%% %14llu %6.2f%% %12llu %10llu %12llu\n",
+                name(buf, sizeof buf, r[i].entry),
+                (unsigned long long)r[i].incl, total ? 100.0 * r[i].incl / total : 0.0,
+                (unsigned long long)r[i].self, total ? 100.0 * r[i].self / total : 0.0,
+                (unsigned long long)r[i].calls, (unsigned long long)r[i].frames,
+                (unsigned long long)r[i].pixels);
+    }
+    if (n > 20) fprintf(f, "... %d more routines\n", n - 20);
+    free(r);
+}
+
+/* Executed addresses in order, routine entries labelled; code not run splits it */
+static void annotate(FILE *f, const prof_t *p, const chip8_t *c)
+{
+    uint64_t   total;
+    int        n;
+    routine_t *r = routines(p, &n, &total);
+    if (!r) return;
+
+    fprintf(f, "; %llu instructions; count, share, DRW pixels, address, opcode\n",
+            (unsigned long long)total);
+    for (uint32_t a = 0, expect = MEM_SIZE; a < MEM_SIZE; ++a) {
+        if (!p->count[a]) continue;
+        bool gap = a != expect;
+
+        for (int k = 0; k < n; ++k) {
+            if (r[k].entry != a) continue;
+            char buf[16];
+            fprintf(f, "\n%s:  ; %llu inclusive (%.2f%%), %llu calls\n",
+                    name(buf, sizeof buf, a), (unsigned long long)r[k].incl,
+                    total ? 100.0 * r[k].incl / total : 0.0, (unsigned long long)r[k].calls);
+            gap = false;
+        }
+        if (gap) fprintf(f, "\n");
+
+        uint16_t op = c->memory.memory[a] << 8 | c->memory.memory[(a + 1) & (MEM_SIZE - 1)];
+        expect = a + chip8_oplen(c, a);
+        char     mnem[32], pix[24] = "";
+        if (p->pixels[a]) snprintf(pix, sizeof pix, "%llu", (unsigned long long)p->pixels[a]);
+        fprintf(f, "%14llu %6.2f%% %10s  %03X: %04X  %s\n",
+                (unsigned long long)p->count[a], total ? 100.0 * p->count[a] / total : 0.0,
+                pix, a, op, opcode(mnem, sizeof mnem, op));
+    }
+    free(r);
+}
+
+bool prof_write(const prof_t *p, const chip8_t *c, const char *prefix)
+{
+    static const char *ext[M_COUNT] = { ".folded", ".pixels.folded", ".frames.folded" };
+    char path[4096];
+    bool ok = true;
+
+    for (int m = 0; m <= M_COUNT; ++m) {
+        snprintf(path, sizeof path, "%s%s", prefix, m < M_COUNT ? ext[m] : ".asm");
+        FILE *f = fopen(path, "w");
+        if (!f) { perror(path); ok = false; continue; }
+        if (m < M_COUNT) folded(f, p, m);
+        else             annotate(f, p, c);
+        if (fclose(f) != 0) { perror(path); ok = false; }
+    }
+    return ok;
+}
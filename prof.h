@@ -0,0 +1,40 @@
+#ifndef PROF_H
+#define PROF_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "chip8.h"
+
+/*
+ * Profiler, fed through chip8_hooks_t like the counters.  Every
+ * instruction is counted at its address and charged to the call stack
+ * it ran in; the stack is followed through SP and memory.stack[] as
+ * 2nnn/00EE change them.  DRW pixels and frames (the routine a frame
+ * ended in) are charged the same way.
+ */
+#define PROF_NODES  65536           /* distinct call stacks kept, later ones fold into their caller */
+
+typedef struct prof prof_t;
+
+prof_t* prof_init(void);
+void prof_destroy(prof_t *p);
+const chip8_hooks_t* prof_hooks(prof_t *p);
+/*
+ * Sampling instead of the hooks: charges `weight` instructions to c's
+ * current PC and stack, rebuilt from memory.stack[] alone (the 2nnn
+ * before each return address names the routine).  No pixels or frames.
+ */
+void prof_sample(prof_t *p, const chip8_t *c, uint64_t weight);
+/* Profiles of one ROM from several instances */
+void prof_merge(prof_t *dst, const prof_t *src);
+
+/* Top routines by inclusive instructions */
+void prof_print(FILE *f, const prof_t *p);
+/*
+ * <prefix>.folded, <prefix>.pixels.folded, <prefix>.frames.folded:
+ * collapsed stacks ("main;sub_2A4;sub_31C 1234") for flamegraph tools;
+ * <prefix>.asm: executed code with per-line counts, decoded from c
+ */
+bool prof_write(const prof_t *p, const chip8_t *c, const char *prefix);
+
+#endif /* PROF_H */
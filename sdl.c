@@ -1,3 +1,5 @@
+#include <string.h>
+
 #include "sdl.h"
 
 /* Init / Destroy */
@@ -11,56 +13,102 @@ window_t* sdl_init(int scale)
     window_t *w = SDL_malloc(sizeof(*w));
     w->win  = SDL_CreateWindow("MyChip8", 64 * scale, 32 * scale, 0);
     w->ren  = SDL_CreateRenderer(w->win, NULL);
-    SDL_SetRenderVSync(w->ren, 1);
-    w->on   = palettes[0][0];
-    w->off  = palettes[0][1];
+    SDL_SetRenderVSync(w->ren, 1);      /* blocks this thread only */
+    w->tex  = SDL_CreateTexture(w->ren, SDL_PIXELFORMAT_ARGB8888,
+                                SDL_TEXTUREACCESS_STREAMING, FB_W, FB_H);
+    if (!w->tex) {
+        SDL_Log("SDL texture failed: %s", SDL_GetError());
+        sdl_destroy(w);
+        return NULL;
+    }
+    SDL_SetTextureScaleMode(w->tex, SDL_SCALEMODE_NEAREST);
+    memcpy(w->colors, palettes[0], sizeof w->colors);
+    w->hires  = false;
+    w->seq    = UINT64_MAX;
+    w->redraw = true;
+    w->present = false;
+    w->osd[0] = '\0';
     return w;
 }
 
 void sdl_destroy(window_t *w)
 {
     if (!w) return;
+    if (w->tex) SDL_DestroyTexture(w->tex);
     SDL_DestroyRenderer(w->ren);
     SDL_DestroyWindow(w->win);
     SDL_free(w);
     SDL_Quit();
 }
 
-void sdl_draw(chip8_t *c, window_t *w, int scale)
+/*
+ * Only rows marked dirty by the display opcodes are converted and
+ * uploaded, runs of adjacent rows in one call.  The marks only cover
+ * the step from the previous frame, so after frames the renderer never
+ * took everything is converted.  The texture is always 128x64; a lores
+ * row fills two texture rows with doubled pixels.  Returns false (and
+ * presents nothing) when the frame is unchanged.
+ */
+bool sdl_draw(const frame_t *f, window_t *w)
 {
-    SDL_FRect r = {0, 0, scale, scale};
+    if (f->hires != w->hires || f->seq != w->seq + 1) {
+        w->hires  = f->hires;
+        w->redraw = true;
+    }
+    w->seq = f->seq;
 
-    /* Fill render */
-    SDL_SetRenderDrawColor(w->ren,
-                           (w->off >> 16) & 0xFF,
-                           (w->off >>  8) & 0xFF,
-                           (w->off >>  0) & 0xFF,
-                           0xFF);
-    SDL_RenderClear(w->ren);
+    uint64_t dirty = w->redraw ? ~0ULL : f->dirty;
+    int      h     = f->hires ? FB_H : FB_H / 2;
+    int      sc    = f->hires ? 1 : 2;      /* texture pixels per FB pixel */
+    if (!dirty && !w->present) return false;
 
-    /* on pixels */
-    SDL_SetRenderDrawColor(w->ren,
-                           (w->on  >> 16) & 0xFF,
-                           (w->on  >>  8) & 0xFF,
-                           (w->on  >>  0) & 0xFF,
-                           0xFF);
+    for (int y = 0; y < h; ) {
+        if (!((dirty >> y) & 1)) { ++y; continue; }
 
-    for (int y = 0; y < 32; ++y) {
-        for (int x = 0; x < 64; ++x) {
-            if (c->FB[y * 64 + x]) {
-                r.x = x * scale;
-                r.y = y * scale;
-                SDL_RenderFillRect(w->ren, &r);
+        int first = y;
+        for (; y < h && ((dirty >> y) & 1); ++y) {
+            uint32_t *row = &w->pixels[y * sc * FB_W];
+            for (int x = 0; x < FB_W; ++x) {
+                int      px  = x / sc;
+                unsigned bit = 63 - (px & 63);
+                row[x] = w->colors[((f->FB[0][y][px >> 6] >> bit) & 1) |
+                                   ((f->FB[1][y][px >> 6] >> bit) & 1) << 1];
             }
+            if (sc == 2) memcpy(row + FB_W, row, FB_W * sizeof *row);
         }
+
+        SDL_Rect r = {0, first * sc, FB_W, (y - first) * sc};
+        SDL_UpdateTexture(w->tex, &r, &w->pixels[first * sc * FB_W],
+                          FB_W * sizeof(uint32_t));
+    }
+    w->redraw  = false;
+    w->present = false;
+
+    SDL_RenderTexture(w->ren, w->tex, NULL, NULL);
+    if (w->osd[0]) {
+        uint32_t fg = w->colors[1];
+        SDL_SetRenderScale(w->ren, 2.0f, 2.0f);
+        SDL_SetRenderDrawColor(w->ren, fg >> 16 & 0xFF, fg >> 8 & 0xFF, fg & 0xFF, 0xFF);
+        SDL_RenderDebugText(w->ren, 4, 4, w->osd);
+        SDL_SetRenderScale(w->ren, 1.0f, 1.0f);
     }
     SDL_RenderPresent(w->ren);
+    return true;
 }
 
 
 void sdl_palette(window_t *w, int idx)
 {
     idx &= 1;
-    w->on  = palettes[idx][0];
-    w->off = palettes[idx][1];
+    memcpy(w->colors, palettes[idx], sizeof w->colors);
+    w->redraw = true;
+}
+
+/* Text drawn over the picture, NULL removes it */
+void sdl_osd(window_t *w, const char *text)
+{
+    if (!text) text = "";
+    if (!strcmp(w->osd, text)) return;
+    snprintf(w->osd, sizeof w->osd, "%s", text);
+    w->present = true;
 }
@@ -10,24 +10,27 @@
 #include <SDL3/SDL_video.h>
 #include <SDL3/SDL_audio.h>
 #include <stdint.h>
+#include <stdio.h>
 
 #include "chip8.h"
+#include "palette.h"
+#include "xchg.h"
 
 
 typedef struct {
     SDL_Window   *win;
     SDL_Renderer *ren;
-    SDL_Texture  *tex;
-    uint32_t on;
-    uint32_t off;
+    SDL_Texture  *tex;        /* FB_W x FB_H streaming texture, lores doubled */
+    uint32_t colors[4];       /* by plane bits: off, plane 1, plane 2, both */
+    bool     hires;           /* mode the texture holds */
+    uint64_t seq;             /* frame the texture holds, see frame_t */
+    bool     redraw;          /* palette or mode changed, convert all rows */
+    bool     present;         /* overlay changed, present even if FB is clean */
+    char     osd[32];         /* overlay text, empty for none */
+    uint32_t pixels[FB_W * FB_H];
 } window_t;
 
 
-static const uint32_t palettes[2][2] = {
-    {0xFFFFFFFF, 0x00000000},  /* 0 : black & white          */
-    {0xFFFFB000, 0xFF2A1C00}   /* 1 : amber / dark-chocolate */
-};
-
 static const SDL_Keycode keymap[16] = {
     SDLK_0,  // 0
     SDLK_1,  // 1
@@ -49,15 +52,29 @@ static const SDL_Keycode keymap[16] = {
 
 
 window_t* sdl_init(int scale);
-void sdl_draw(chip8_t *c, window_t *w, int scale);
+bool sdl_draw(const frame_t *f, window_t *w);
 void sdl_destroy(window_t *w);
 void sdl_palette(window_t *w, int idx);
+void sdl_osd(window_t *w, const char *text);
 
 
 extern int audio_volume;
 
+typedef struct {
+    uint64_t underruns;       /* emulation behind, silence inserted   */
+    uint64_t overruns;        /* audio behind, backlog skipped        */
+    uint64_t dropped;         /* events lost to a full queue          */
+    uint64_t callbacks;
+    uint64_t lag_sum;         /* queued emulated samples, summed      */
+    uint64_t lag_max;
+} audio_stats_t;
+
 void sdl_audio_init(void);
-void sdl_audio_sound(bool active);
+void sdl_audio_frame(bool active);
+void sdl_audio_pattern(const uint8_t pattern[16]);
+void sdl_audio_pitch(uint8_t pitch);
 void sdl_audio_destroy(void);
+void sdl_audio_stats(audio_stats_t *s);
+void sdl_audio_print(FILE *f);
 
 #endif /* SDL_H */
@@ -1,72 +1,244 @@
 #include "sdl.h"
 #include <math.h>
+#include <string.h>
 
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
 
-static SDL_AudioDeviceID audio_dev = 0;
+/*
+ * The emulation thread posts tone/pattern/pitch changes stamped with
+ * emulated time (in samples, SAMPLES_PER_FRAME per 60 Hz frame) into a
+ * single-producer/single-consumer ring and publishes how far emulated
+ * time has got.  The stream callback renders that timeline TARGET
+ * samples behind, applying each event at its sample.
+ */
+
+#define FREQ               48000
+#define SAMPLES_PER_FRAME  (FREQ / 60)
+#define TARGET             (2 * SAMPLES_PER_FRAME)   /* latency we aim for     */
+#define MAX_LAG            (8 * SAMPLES_PER_FRAME)   /* beyond this, skip ahead */
+
+#define TABLE_BITS  10
+#define TABLE_SIZE  (1 << TABLE_BITS)
+#define TONE_HZ     440.0
+#define QUEUE_SIZE  256                              /* power of two */
+
+enum { EV_TONE_ON, EV_TONE_OFF, EV_PATTERN, EV_PITCH };
+
+typedef struct {
+    uint64_t at;
+    uint8_t  kind;
+    uint8_t  pitch;
+    uint8_t  pattern[16];
+} event_t;
+
 static SDL_AudioStream  *audio_stream = NULL;
 int                      audio_volume = 30;
 
-static const int FREQ   = 48000;
-static const int TARGET_MS = 200;
-static const int SAMPLES_PER_FRAME = FREQ / 60;
+/* emulation side */
+static event_t  queue[QUEUE_SIZE];
+static uint32_t q_head, q_tail;             /* written by producer / consumer */
+static uint64_t emu_time;                   /* published with release        */
+static bool     last_tone;
+
+/* callback side */
+static int16_t  table[TABLE_SIZE];          /* one band-limited square period */
+static uint64_t cursor;                     /* emulated sample being rendered */
+static bool     buffering = true;
+static bool     tone;
+static bool     has_pattern;
+static uint8_t  pattern[16];
+static uint32_t phase, tone_step, pattern_step;
+static audio_stats_t stats;
+
+
+/* Sum of odd harmonics below Nyquist, computed once */
+static void build_table(void)
+{
+    int    harmonics = (int)(FREQ / 2 / TONE_HZ);
+    double peak = 0, wave[TABLE_SIZE];
+
+    for (int i = 0; i < TABLE_SIZE; ++i) {
+        double t = 2.0 * M_PI * i / TABLE_SIZE, v = 0;
+        for (int k = 1; k <= harmonics; k += 2)
+            v += sin(k * t) / k;
+        wave[i] = v;
+        if (fabs(v) > peak) peak = fabs(v);
+    }
+
+    double level = 2500.0 * audio_volume / 100.0;
+    for (int i = 0; i < TABLE_SIZE; ++i)
+        table[i] = (int16_t)lrint(wave[i] / peak * level);
+}
+
+/* XO-CHIP: 4000 * 2^((pitch - 64) / 48) pattern bits per second */
+static void set_pitch(uint8_t pitch)
+{
+    double bits = 4000.0 * pow(2.0, (pitch - 64) / 48.0);
+    pattern_step = (uint32_t)(bits / FREQ * (1u << 25));   /* 128 bits = 2^32 */
+}
+
+static void apply(const event_t *e)
+{
+    switch (e->kind) {
+        case EV_TONE_ON:  tone = true;  break;
+        case EV_TONE_OFF: tone = false; break;
+        case EV_PATTERN:
+            memcpy(pattern, e->pattern, sizeof pattern);
+            has_pattern = true;
+            break;
+        case EV_PITCH:    set_pitch(e->pitch); break;
+    }
+}
+
+static int16_t sample(void)
+{
+    if (!tone) return 0;
+    if (!has_pattern) {
+        phase += tone_step;
+        return table[phase >> (32 - TABLE_BITS)];
+    }
+    phase += pattern_step;
+    unsigned bit = phase >> 25;
+    int16_t  level = (int16_t)(2500 * audio_volume / 100);
+    return (pattern[bit >> 3] >> (7 - (bit & 7))) & 1 ? level : -level;
+}
+
+static void render(int16_t *dst, int count)
+{
+    uint64_t head = __atomic_load_n(&emu_time, __ATOMIC_ACQUIRE);
+    uint32_t tail = q_tail;
+    uint32_t qh   = __atomic_load_n(&q_head, __ATOMIC_ACQUIRE);
+
+    if (buffering && head - cursor >= TARGET) buffering = false;
+
+    if (!buffering && head - cursor > MAX_LAG) {
+        /* audio fell behind (device stall): drop the backlog */
+        cursor = head - TARGET;
+        stats.overruns++;
+    }
+
+    if (!buffering) {
+        uint64_t lag = head - cursor;
+        stats.callbacks++;
+        stats.lag_sum += lag;
+        if (lag > stats.lag_max) stats.lag_max = lag;
+    }
 
+    int i = 0;
+    for (; i < count && !buffering; ++i) {
+        if (cursor == head) {
+            /* emulation fell behind: silence until TARGET is queued again */
+            buffering = true;
+            stats.underruns++;
+            break;
+        }
+        while (tail != qh && queue[tail & (QUEUE_SIZE - 1)].at <= cursor)
+            apply(&queue[tail++ & (QUEUE_SIZE - 1)]);
+        dst[i] = sample();
+        cursor++;
+    }
+    if (i < count) memset(dst + i, 0, (count - i) * sizeof *dst);
+
+    __atomic_store_n(&q_tail, tail, __ATOMIC_RELEASE);
+}
+
+static void feed(void *ud, SDL_AudioStream *s, int additional, int total)
+{
+    int16_t buf[1024];
+    (void)ud; (void)total;
+
+    for (int left = additional / (int)sizeof *buf; left > 0; ) {
+        int n = left < 1024 ? left : 1024;
+        render(buf, n);
+        SDL_PutAudioStreamData(s, buf, n * sizeof *buf);
+        left -= n;
+    }
+}
 
 
 void sdl_audio_init(void)
 {
-    SDL_AudioSpec want = {0};
-    want.freq   = FREQ;
-    want.format = SDL_AUDIO_S16;
-    want.channels = 1;
-
-    audio_dev = SDL_OpenAudioDevice(SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK, &want);
-    if (audio_dev) {
-        audio_stream = SDL_CreateAudioStream(&want, &want);
-        SDL_BindAudioStream(audio_dev, audio_stream);
+    SDL_AudioSpec spec = {0};
+    spec.freq     = FREQ;
+    spec.format   = SDL_AUDIO_S16;
+    spec.channels = 1;
+
+    build_table();
+    tone_step = (uint32_t)(TONE_HZ / FREQ * 4294967296.0);
+    set_pitch(64);
+
+    audio_stream = SDL_OpenAudioDeviceStream(SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK,
+                                             &spec, feed, NULL);
+    if (!audio_stream) {
+        SDL_Log("Audio disabled: %s", SDL_GetError());
+        return;
     }
+    SDL_ResumeAudioStreamDevice(audio_stream);
 }
 
 void sdl_audio_destroy(void)
 {
     if (audio_stream) SDL_DestroyAudioStream(audio_stream);
-    if (audio_dev)    SDL_CloseAudioDevice(audio_dev);
     audio_stream = NULL;
-    audio_dev = 0;
 }
 
 
-static void generate_square(int16_t *dst, int count)
+static void post(uint8_t kind, uint8_t pitch, const uint8_t *pat)
 {
-    static double phase = 0.0;
-    const double step = 440.0 / FREQ * 2.0 * M_PI;
-    int16_t level = (int16_t)(2500 * audio_volume / 100.0);
-
-    for (int i = 0; i < count; ++i) {
-        dst[i] = (sin(phase) >= 0.0) ? level : -level; /* volume */
-        phase += step;
-        if (phase >= 2.0 * M_PI) phase -= 2.0 * M_PI;
+    uint32_t head = q_head;
+    if (head - __atomic_load_n(&q_tail, __ATOMIC_ACQUIRE) == QUEUE_SIZE) {
+        stats.dropped++;
+        return;
     }
+
+    event_t *e = &queue[head & (QUEUE_SIZE - 1)];
+    e->at    = emu_time;
+    e->kind  = kind;
+    e->pitch = pitch;
+    if (pat) memcpy(e->pattern, pat, sizeof e->pattern);
+    __atomic_store_n(&q_head, head + 1, __ATOMIC_RELEASE);
 }
 
-void sdl_audio_sound(bool active)
+/*
+ * Once per emulated frame, before chip8_update.  ST only drops at frame
+ * ends, so tone-off lands on its exact sample; tone-on is placed at the
+ * start of the frame whose Fx18 started it.
+ */
+void sdl_audio_frame(bool active)
 {
-    if (!audio_dev || !audio_stream) return;
+    if (!audio_stream) return;
+    if (active != last_tone) {
+        post(active ? EV_TONE_ON : EV_TONE_OFF, 0, NULL);
+        last_tone = active;
+    }
+    __atomic_store_n(&emu_time, emu_time + SAMPLES_PER_FRAME, __ATOMIC_RELEASE);
+}
 
-    Uint64 queued_bytes = SDL_GetAudioStreamQueued(audio_stream);
-    Uint64 queued_ms    = queued_bytes * 1000 / 48000;
+void sdl_audio_pattern(const uint8_t pat[16])
+{
+    if (audio_stream) post(EV_PATTERN, 0, pat);
+}
 
-    if (queued_ms < (Uint64)TARGET_MS) {
-        int16_t buf[SAMPLES_PER_FRAME];
-        generate_square(buf, SAMPLES_PER_FRAME);
-        SDL_PutAudioStreamData(audio_stream, buf, sizeof(buf));
-    }
+void sdl_audio_pitch(uint8_t pitch)
+{
+    if (audio_stream) post(EV_PITCH, pitch, NULL);
+}
 
-    if (active)
-        SDL_ResumeAudioDevice(audio_dev);
-    else
-        SDL_PauseAudioDevice(audio_dev);
+/* Read after sdl_audio_destroy, when the callback no longer runs */
+void sdl_audio_stats(audio_stats_t *s)
+{
+    *s = stats;
+}
+
+void sdl_audio_print(FILE *f)
+{
+    fprintf(f, "audio: underruns %llu, overruns %llu, dropped events %llu, "
+               "latency avg %.1f ms, max %.1f ms\n",
+            (unsigned long long)stats.underruns, (unsigned long long)stats.overruns,
+            (unsigned long long)stats.dropped,
+            stats.callbacks ? stats.lag_sum * 1000.0 / stats.callbacks / FREQ : 0.0,
+            stats.lag_max * 1000.0 / FREQ);
 }
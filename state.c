@@ -0,0 +1,370 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "state.h"
+
+/* Save/restore */
+
+static uint8_t *put16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+    return p + 2;
+}
+
+static const uint8_t *get16(const uint8_t *p, uint16_t *v)
+{
+    *v = p[0] | (p[1] << 8);
+    return p + 2;
+}
+
+size_t chip8_save(const chip8_t *c, uint8_t *buf, size_t len)
+{
+    if (len < STATE_SIZE) return 0;
+
+    uint8_t *p = buf;
+    memcpy(p, STATE_MAGIC, 4);  p += 4;
+    p = put16(p, STATE_VERSION);
+
+    /* registers first, the bulky and mostly static memory last */
+    p = put16(p, c->PC);
+    p = put16(p, c->I);
+    *p++ = c->SP;
+    *p++ = c->DT;
+    *p++ = c->ST;
+    p = put16(p, c->rng & 0xFFFF);
+    p = put16(p, c->rng >> 16);
+    memcpy(p, c->regs, 16);     p += 16;
+    for (int i = 0; i < 16; ++i)
+        p = put16(p, c->memory.stack[i]);
+    memcpy(p, c->keypad, 16);   p += 16;
+    *p++ = c->hires;
+    *p++ = c->planes;
+    memcpy(p, c->rpl, 16);      p += 16;
+    *p++ = c->pitch;
+    memcpy(p, c->pattern, 16);  p += 16;
+    for (int i = 0; i < 2; ++i)
+        for (int y = 0; y < FB_H; ++y)
+            for (int w = 0; w < FB_WORDS; ++w)
+                for (int b = 56; b >= 0; b -= 8)
+                    *p++ = (c->FB[i][y][w] >> b) & 0xFF;
+    memcpy(p, c->memory.memory, MEM_SIZE);
+
+    return STATE_SIZE;
+}
+
+bool chip8_restore(chip8_t *c, const uint8_t *buf, size_t len)
+{
+    uint16_t ver, lo, hi;
+
+    if (len < STATE_SIZE || memcmp(buf, STATE_MAGIC, 4) != 0) return false;
+    const uint8_t *p = get16(buf + 4, &ver);
+    if (ver != STATE_VERSION) return false;
+
+    p = get16(p, &c->PC);
+    p = get16(p, &c->I);
+    c->SP = *p++;
+    c->DT = *p++;
+    c->ST = *p++;
+    p = get16(p, &lo);
+    p = get16(p, &hi);
+    c->rng = lo | (uint32_t)hi << 16;
+    memcpy(c->regs, p, 16);     p += 16;
+    for (int i = 0; i < 16; ++i)
+        p = get16(p, &c->memory.stack[i]);
+    memcpy(c->keypad, p, 16);   p += 16;
+    c->hires  = *p++ != 0;
+    c->planes = *p++ & 3;
+    memcpy(c->rpl, p, 16);      p += 16;
+    c->pitch  = *p++;
+    memcpy(c->pattern, p, 16);  p += 16;
+    for (int i = 0; i < 2; ++i)
+        for (int y = 0; y < FB_H; ++y)
+            for (int w = 0; w < FB_WORDS; ++w) {
+                c->FB[i][y][w] = 0;
+                for (int b = 56; b >= 0; b -= 8)
+                    c->FB[i][y][w] |= (uint64_t)*p++ << b;
+            }
+    memcpy(c->memory.memory, p, MEM_SIZE);
+
+    /* an all-zero pattern is what a ROM that never ran F002 has */
+    c->audio_dirty = AUDIO_PITCH;
+    for (int i = 0; i < 16; ++i)
+        if (c->pattern[i]) c->audio_dirty |= AUDIO_PATTERN;
+    c->dirty = ~0ULL;
+    return true;
+}
+
+bool state_write(const chip8_t *c, const char *path)
+{
+    uint8_t buf[STATE_SIZE];
+    size_t  n = chip8_save(c, buf, sizeof buf);
+
+    FILE *f = fopen(path, "wb");
+    if (!f) { perror(path); return false; }
+    bool ok = fwrite(buf, 1, n, f) == n;
+    if (fclose(f) != 0) ok = false;
+    if (!ok) perror(path);
+    return ok;
+}
+
+bool state_read(chip8_t *c, const char *path)
+{
+    uint8_t buf[STATE_SIZE];
+
+    FILE *f = fopen(path, "rb");
+    if (!f) { perror(path); return false; }
+    size_t n = fread(buf, 1, sizeof buf, f);
+    fclose(f);
+
+    if (!chip8_restore(c, buf, n)) {
+        fprintf(stderr, "%s: not a version %d save state\n", path, STATE_VERSION);
+        return false;
+    }
+    return true;
+}
+
+
+/*
+ * Delta packing.  A XOR delta is mostly zero bytes, so it is stored as
+ * (zero run, literal run, literals) triples with LEB128 lengths.  Short
+ * zero gaps inside a literal run are cheaper to keep as literals.
+ */
+
+#define MIN_GAP     4
+#define PACK_MAX    (STATE_SIZE + STATE_SIZE / 64 + 16)   /* worst case */
+
+static uint8_t *put_len(uint8_t *p, size_t v)
+{
+    while (v >= 0x80) { *p++ = (v & 0x7F) | 0x80; v >>= 7; }
+    *p++ = v;
+    return p;
+}
+
+static const uint8_t *get_len(const uint8_t *p, size_t *v)
+{
+    int shift = 0;
+    *v = 0;
+    do {
+        *v |= (size_t)(*p & 0x7F) << shift;
+        shift += 7;
+    } while (*p++ & 0x80);
+    return p;
+}
+
+/* Packs cur ^ key, returns the packed size */
+static size_t pack(uint8_t *out, const uint8_t *cur, const uint8_t *key)
+{
+    uint8_t *p = out;
+    size_t   i = 0;
+
+    while (i < STATE_SIZE) {
+        size_t z = i;
+        while (z + 8 <= STATE_SIZE && !memcmp(cur + z, key + z, 8)) z += 8;
+        while (z < STATE_SIZE && cur[z] == key[z]) ++z;
+        if (z == STATE_SIZE) break;     /* trailing zeros are implied */
+
+        size_t lit = z, gap = 0;
+        for (size_t j = z; j < STATE_SIZE && gap < MIN_GAP; ++j) {
+            if (cur[j] == key[j]) ++gap;
+            else { gap = 0; lit = j + 1; }
+        }
+
+        p = put_len(p, z - i);
+        p = put_len(p, lit - z);
+        for (size_t j = z; j < lit; ++j)
+            *p++ = cur[j] ^ key[j];
+        i = lit;
+    }
+    return p - out;
+}
+
+/* Applies a packed delta to img, which holds the keyframe */
+static void unpack(uint8_t *img, const uint8_t *p, const uint8_t *end)
+{
+    size_t i = 0, z, n;
+
+    while (p < end) {
+        p = get_len(p, &z);
+        p = get_len(p, &n);
+        i += z;
+        for (size_t j = 0; j < n; ++j)
+            img[i++] ^= *p++;
+    }
+}
+
+
+/* Rewind buffer */
+
+typedef struct {
+    uint8_t  *data;     /* packed keyframe, then packed deltas */
+    size_t    used;
+    size_t    cap;
+    uint32_t *off;      /* [k] = start of frame k, [count] = used */
+    int       count;    /* frames held, the keyframe included */
+    uint64_t  first;    /* frame number of the keyframe */
+} segment_t;
+
+struct rewind {
+    segment_t *seg;
+    int        nseg;
+    int        head;    /* oldest segment */
+    int        live;    /* segments in use */
+    int        every;   /* frames per segment */
+    uint64_t   next;    /* number the next push gets */
+    uint8_t    img[STATE_SIZE];
+    uint8_t    key[STATE_SIZE];     /* the newest segment's keyframe, unpacked */
+    uint8_t    zero[STATE_SIZE];    /* what keyframes are packed against */
+    uint8_t    packed[PACK_MAX];    /* a delta before it is appended */
+};
+
+rewind_t* rewind_init(size_t frames, int keyframe_every)
+{
+    if (keyframe_every < 1) keyframe_every = 1;
+
+    rewind_t *r = calloc(1, sizeof *r);
+    if (!r) return NULL;
+
+    r->every = keyframe_every;
+    r->nseg  = (frames + keyframe_every - 1) / keyframe_every + 1;
+    r->seg   = calloc(r->nseg, sizeof *r->seg);
+    if (!r->seg) { free(r); return NULL; }
+
+    for (int i = 0; i < r->nseg; ++i) {
+        r->seg[i].off = malloc((keyframe_every + 1) * sizeof *r->seg[i].off);
+        if (!r->seg[i].off) { rewind_destroy(r); return NULL; }
+    }
+    return r;
+}
+
+void rewind_destroy(rewind_t *r)
+{
+    if (!r) return;
+    for (int i = 0; i < r->nseg; ++i) {
+        free(r->seg[i].data);
+        free(r->seg[i].off);
+    }
+    free(r->seg);
+    free(r);
+}
+
+static segment_t *newest(const rewind_t *r)
+{
+    return &r->seg[(r->head + r->live - 1) % r->nseg];
+}
+
+/* Keyframes are mostly zero memory, so they are packed against nothing */
+static void keyframe(const segment_t *s, uint8_t *img)
+{
+    memset(img, 0, STATE_SIZE);
+    unpack(img, s->data, s->data + s->off[1]);
+}
+
+static bool reserve(segment_t *s, size_t need)
+{
+    if (s->used + need <= s->cap) return true;
+
+    /* slow growth, the buffers are kept when a segment is recycled */
+    size_t   cap  = s->cap + s->cap / 4;
+    if (cap < s->used + need) cap = s->used + need;
+    uint8_t *data = realloc(s->data, cap);
+    if (!data) return false;
+    s->data = data;
+    s->cap  = cap;
+    return true;
+}
+
+uint64_t rewind_push(rewind_t *r, const chip8_t *c)
+{
+    segment_t *s = r->live ? newest(r) : NULL;
+
+    if (!s || s->count == r->every) {
+        if (r->live == r->nseg) {
+            r->head = (r->head + 1) % r->nseg;
+            r->live--;
+        }
+        r->live++;
+        s = newest(r);
+        s->used  = 0;
+        s->count = 0;
+        s->first = r->next;
+        chip8_save(c, r->key, STATE_SIZE);
+        size_t n = pack(r->packed, r->key, r->zero);
+        if (!reserve(s, n)) {
+            r->live = 0;
+            return r->next++;
+        }
+        memcpy(s->data, r->packed, n);
+        s->used   = n;
+        s->off[0] = 0;
+        s->off[1] = n;
+        s->count  = 1;
+        return r->next++;
+    }
+
+    /* packed aside first, so segments only grow by what deltas take */
+    chip8_save(c, r->img, STATE_SIZE);
+    size_t n = pack(r->packed, r->img, r->key);
+
+    /* out of memory: drop the history rather than leave a hole in it */
+    if (!reserve(s, n)) {
+        r->live = 0;
+        return r->next++;
+    }
+    memcpy(s->data + s->used, r->packed, n);
+    s->used += n;
+    s->off[++s->count] = s->used;
+    return r->next++;
+}
+
+bool rewind_range(const rewind_t *r, uint64_t *first, uint64_t *last)
+{
+    if (!r->live) return false;
+    *first = r->seg[r->head].first;
+    *last  = newest(r)->first + newest(r)->count - 1;
+    return true;
+}
+
+bool rewind_seek(const rewind_t *r, uint64_t frame, chip8_t *c)
+{
+    uint64_t first, last;
+    uint8_t  img[STATE_SIZE];
+
+    if (!rewind_range(r, &first, &last) || frame < first || frame > last)
+        return false;
+
+    /* every segment but the newest holds exactly r->every frames */
+    const segment_t *s = &r->seg[(r->head + (frame - first) / r->every) % r->nseg];
+    int k = frame - s->first;
+
+    keyframe(s, img);
+    if (k > 0) unpack(img, s->data + s->off[k], s->data + s->off[k + 1]);
+    return chip8_restore(c, img, STATE_SIZE);
+}
+
+void rewind_truncate(rewind_t *r, uint64_t frame)
+{
+    while (r->live) {
+        segment_t *s = newest(r);
+        if (frame >= s->first) {
+            if (frame - s->first + 1 < (uint64_t)s->count) {
+                s->count = frame - s->first + 1;
+                s->used  = s->off[s->count];
+            }
+            break;
+        }
+        r->live--;
+    }
+    /* deltas pushed from here on go against the keyframe now newest */
+    if (r->live) keyframe(newest(r), r->key);
+    r->next = frame + 1;
+}
+
+size_t rewind_bytes(const rewind_t *r)
+{
+    size_t n = sizeof *r;
+    for (int i = 0; i < r->nseg; ++i)
+        n += r->seg[i].cap + (r->every + 1) * sizeof *r->seg[i].off;
+    return n;
+}
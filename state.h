@@ -0,0 +1,45 @@
+#ifndef STATE_H
+#define STATE_H
+
+#include <stddef.h>
+#include "chip8.h"
+
+/*
+ * Save-state image: magic, version, then every field of chip8_t in a
+ * fixed order, little endian.  The layout is the same for every state
+ * of one version, which is what the rewind deltas rely on.
+ */
+#define STATE_MAGIC     "C8ST"
+#define STATE_VERSION   3
+#define STATE_SIZE      (4 + 2 + 2 + 2 + 3 + 4 + 16 + 16 * 2 + 16 + \
+                         2 + 16 + 1 + 16 + 2 * FB_H * FB_WORDS * 8 + MEM_SIZE)
+
+/* Returns the image size, 0 if buf is shorter than STATE_SIZE */
+size_t chip8_save(const chip8_t *c, uint8_t *buf, size_t len);
+/* Rejects foreign or other-version images; c->hooks is left as is */
+bool chip8_restore(chip8_t *c, const uint8_t *buf, size_t len);
+
+bool state_write(const chip8_t *c, const char *path);
+bool state_read(chip8_t *c, const char *path);
+
+
+/*
+ * Rewind buffer: one state per frame.  Frames are grouped in segments of
+ * a keyframe followed by XOR deltas against it, all RLE-packed (the
+ * keyframe against a zero image), so any frame is two decodes away.  The oldest segment is dropped
+ * when the buffer is full.
+ */
+typedef struct rewind rewind_t;
+
+rewind_t* rewind_init(size_t frames, int keyframe_every);
+void rewind_destroy(rewind_t *r);
+/* Returns the number of the recorded frame, counting from 0 */
+uint64_t rewind_push(rewind_t *r, const chip8_t *c);
+/* Oldest and newest frame still held, false when empty */
+bool rewind_range(const rewind_t *r, uint64_t *first, uint64_t *last);
+bool rewind_seek(const rewind_t *r, uint64_t frame, chip8_t *c);
+/* Forget everything after frame, the next push records frame + 1 */
+void rewind_truncate(rewind_t *r, uint64_t frame);
+size_t rewind_bytes(const rewind_t *r);
+
+#endif /* STATE_H */
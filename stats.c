@@ -0,0 +1,110 @@
+#include <string.h>
+
+#include "stats.h"
+
+static const char *names[OPC_COUNT] = {
+    "SYS/???",
+    "CLS",        "RET",        "JP",         "CALL",
+    "SE Vx,kk",   "SNE Vx,kk",  "SE Vx,Vy",   "LD Vx,kk",   "ADD Vx,kk",
+    "LD Vx,Vy",   "OR",         "AND",        "XOR",        "ADD Vx,Vy",
+    "SUB",        "SHR",        "SUBN",       "SHL",        "SNE Vx,Vy",
+    "LD I",       "JP V0",      "RND",        "DRW",        "SKP",        "SKNP",
+    "LD Vx,DT",   "LD Vx,K",    "LD DT",      "LD ST",      "ADD I",
+    "LD F",       "LD B",       "LD [I]",     "LD Vx,[I]",
+    "SCD",        "SCU",        "SCR",        "SCL",        "EXIT",
+    "LOW",        "HIGH",       "LD [I],Vx-Vy", "LD Vx-Vy,[I]", "LD I,long",
+    "PLANE",      "AUDIO",      "LD HF",      "PITCH",      "LD R",       "LD Vx,R",
+};
+
+static const char *skip_names[SKIP_COUNT] = {
+    "SE Vx,kk", "SNE Vx,kk", "SE Vx,Vy", "SNE Vx,Vy", "SKP", "SKNP"
+};
+
+
+static void stats_exec(void *ud, chip8_t *c, uint16_t op)
+{
+    stats_t *s = ud;
+    s->ops[chip8_opclass(op)]++;
+    /* SP seen before each instruction, so a CALL shows up one op later */
+    if (c->SP > s->sp_max) s->sp_max = c->SP;
+}
+
+static void stats_draw(void *ud, chip8_t *c, int drawn, int erased)
+{
+    stats_t *s = ud;
+    (void)c;
+    s->draws++;
+    s->draw_hits += erased > 0;
+    s->pixels += drawn;
+    s->erased += erased;
+}
+
+static void stats_skip(void *ud, chip8_t *c, uint16_t op, bool taken)
+{
+    stats_t *s = ud;
+    int k;
+    (void)c;
+
+    switch (op & 0xF000) {
+        case 0x3000: k = SKIP_SE;   break;
+        case 0x4000: k = SKIP_SNE;  break;
+        case 0x5000: k = SKIP_SER;  break;
+        case 0x9000: k = SKIP_SNER; break;
+        default:     k = (op & 0xFF) == 0x9E ? SKIP_SKP : SKIP_SKNP; break;
+    }
+    s->skips[k]++;
+    s->taken[k] += taken;
+}
+
+void stats_init(stats_t *s)
+{
+    memset(s, 0, sizeof *s);
+    s->hooks.ud   = s;
+    s->hooks.exec = stats_exec;
+    s->hooks.draw = stats_draw;
+    s->hooks.skip = stats_skip;
+}
+
+void stats_merge(stats_t *dst, const stats_t *src)
+{
+    for (int i = 0; i < OPC_COUNT; ++i)
+        dst->ops[i] += src->ops[i];
+    for (int i = 0; i < SKIP_COUNT; ++i) {
+        dst->skips[i] += src->skips[i];
+        dst->taken[i] += src->taken[i];
+    }
+    dst->draws     += src->draws;
+    dst->draw_hits += src->draw_hits;
+    dst->pixels    += src->pixels;
+    dst->erased    += src->erased;
+    if (src->sp_max > dst->sp_max) dst->sp_max = src->sp_max;
+}
+
+void stats_print(FILE *f, const stats_t *s)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < OPC_COUNT; ++i)
+        total += s->ops[i];
+
+    fprintf(f, "%-12s %14s %7s\n", "class", "count", "share");
+    for (int i = 0; i < OPC_COUNT; ++i) {
+        if (!s->ops[i]) continue;
+        fprintf(f, "%-12s %14llu %6.2f%%\n", names[i],
+                (unsigned long long)s->ops[i],
+                total ? 100.0 * s->ops[i] / total : 0.0);
+    }
+    fprintf(f, "%-12s %14llu\n\n", "total", (unsigned long long)total);
+
+    fprintf(f, "skips        %14s %14s %7s\n", "executed", "taken", "ratio");
+    for (int i = 0; i < SKIP_COUNT; ++i) {
+        if (!s->skips[i]) continue;
+        fprintf(f, "%-12s %14llu %14llu %6.2f%%\n", skip_names[i],
+                (unsigned long long)s->skips[i], (unsigned long long)s->taken[i],
+                100.0 * s->taken[i] / s->skips[i]);
+    }
+
+    fprintf(f, "\nDRW %llu, with collision %llu, pixels drawn %llu, erased %llu\n",
+            (unsigned long long)s->draws, (unsigned long long)s->draw_hits,
+            (unsigned long long)s->pixels, (unsigned long long)s->erased);
+    fprintf(f, "stack depth high-water mark %u\n", s->sp_max);
+}
@@ -0,0 +1,28 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include "chip8.h"
+
+/* Skip kinds counted separately */
+enum { SKIP_SE, SKIP_SNE, SKIP_SER, SKIP_SNER, SKIP_SKP, SKIP_SKNP, SKIP_COUNT };
+
+/* Execution counters, fed through chip8_hooks_t */
+typedef struct {
+    chip8_hooks_t hooks;
+
+    uint64_t ops[OPC_COUNT];      /* executions per instruction class */
+    uint64_t draws;               /* Dxyn executed                    */
+    uint64_t draw_hits;           /* Dxyn that set VF                 */
+    uint64_t pixels;              /* sprite pixels drawn              */
+    uint64_t erased;              /* pixels erased by collisions      */
+    uint64_t skips[SKIP_COUNT];
+    uint64_t taken[SKIP_COUNT];
+    uint8_t  sp_max;              /* stack depth high-water mark      */
+} stats_t;
+
+void stats_init(stats_t *s);
+void stats_merge(stats_t *dst, const stats_t *src);
+void stats_print(FILE *f, const stats_t *s);
+
+#endif /* STATS_H */
@@ -0,0 +1,53 @@
+/* trace.c — renders a binary dbg.trace back into the dbg.log text format */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dbg.h"
+
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "Usage: %s <dbg.trace> [out.log]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    FILE *in = fopen(argv[1], "rb");
+    if (!in) { perror(argv[1]); return EXIT_FAILURE; }
+
+    FILE *out = argc == 3 ? fopen(argv[2], "w") : stdout;
+    if (!out) { perror(argv[2]); fclose(in); return EXIT_FAILURE; }
+
+    char hdr[8];
+    if (fread(hdr, 1, 8, in) != 8 || memcmp(hdr, TRACE_MAGIC, 4) != 0 ||
+        hdr[4] != TRACE_VERSION) {
+        fprintf(stderr, "%s: not a version %d trace\n", argv[1], TRACE_VERSION);
+        return EXIT_FAILURE;
+    }
+
+    uint8_t    *buf = NULL;
+    trace_rec_t r   = {0};
+    uint32_t    recs, bytes;
+
+    while (fread(&recs, 4, 1, in) == 1 && fread(&bytes, 4, 1, in) == 1) {
+        buf = realloc(buf, bytes);
+        if (fread(buf, 1, bytes, in) != bytes) {
+            fprintf(stderr, "%s: truncated block\n", argv[1]);
+            break;
+        }
+
+        size_t off = 0;
+        for (uint32_t i = 0; i < recs; ++i) {
+            size_t n = trace_decode(buf + off, bytes - off, &r);
+            if (!n) { fprintf(stderr, "%s: corrupt record\n", argv[1]); break; }
+            off += n;
+            trace_print(out, &r);
+        }
+    }
+
+    free(buf);
+    fclose(in);
+    if (out != stdout) fclose(out);
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "xchg.h"
+
+/*
+ * The triple buffer is three frames and three indices.  The emulator
+ * owns `back`, the renderer owns `front`, and `middle` is swapped
+ * atomically by either side; its FRESH bit says the frame in it was
+ * published and not yet taken.  The input queue is the same
+ * head/tail ring as the audio event queue in sdl_audio.c.
+ */
+#define FRESH  4u
+
+struct xchg {
+    frame_t    frame[3];
+    uint32_t   back;            /* emulator side */
+    uint64_t   seq;
+    uint32_t   front;           /* renderer side */
+    uint32_t   middle;          /* index | FRESH, shared */
+
+    input_ev_t queue[XCHG_QUEUE];
+    uint32_t   q_head;          /* written by the renderer */
+    uint32_t   q_tail;          /* written by the emulator */
+    uint64_t   dropped;
+    bool       stop;
+};
+
+
+xchg_t* xchg_init(void)
+{
+    xchg_t *x = calloc(1, sizeof *x);
+    if (!x) { perror("xchg"); return NULL; }
+    x->back   = 0;
+    x->middle = 1;
+    x->front  = 2;
+    return x;
+}
+
+void xchg_destroy(xchg_t *x)
+{
+    free(x);
+}
+
+frame_t* xchg_back(xchg_t *x)
+{
+    return &x->frame[x->back];
+}
+
+void xchg_publish(xchg_t *x)
+{
+    x->frame[x->back].seq = x->seq++;
+    uint32_t old = __atomic_exchange_n(&x->middle, x->back | FRESH, __ATOMIC_ACQ_REL);
+    x->back = old & ~FRESH;
+}
+
+const frame_t* xchg_front(xchg_t *x, bool *fresh)
+{
+    *fresh = __atomic_load_n(&x->middle, __ATOMIC_ACQUIRE) & FRESH;
+    if (*fresh) {
+        uint32_t old = __atomic_exchange_n(&x->middle, x->front, __ATOMIC_ACQ_REL);
+        x->front = old & ~FRESH;
+    }
+    return &x->frame[x->front];
+}
+
+bool xchg_push(xchg_t *x, const input_ev_t *ev)
+{
+    uint32_t head = x->q_head;
+    if (head - __atomic_load_n(&x->q_tail, __ATOMIC_ACQUIRE) == XCHG_QUEUE) {
+        x->dropped++;
+        return false;
+    }
+    x->queue[head & (XCHG_QUEUE - 1)] = *ev;
+    __atomic_store_n(&x->q_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool xchg_peek(xchg_t *x, input_ev_t *ev)
+{
+    uint32_t tail = x->q_tail;
+    if (tail == __atomic_load_n(&x->q_head, __ATOMIC_ACQUIRE)) return false;
+    *ev = x->queue[tail & (XCHG_QUEUE - 1)];
+    return true;
+}
+
+bool xchg_pop(xchg_t *x, input_ev_t *ev)
+{
+    if (!xchg_peek(x, ev)) return false;
+    __atomic_store_n(&x->q_tail, x->q_tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+void xchg_stop(xchg_t *x)
+{
+    __atomic_store_n(&x->stop, true, __ATOMIC_RELEASE);
+}
+
+bool xchg_running(xchg_t *x)
+{
+    return !__atomic_load_n(&x->stop, __ATOMIC_ACQUIRE);
+}
+
+uint64_t xchg_dropped(const xchg_t *x)
+{
+    return x->dropped;
+}
@@ -0,0 +1,69 @@
+#ifndef XCHG_H
+#define XCHG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "chip8.h"
+
+/*
+ * What the emulation thread and the render thread pass each other.
+ * Finished frames go through a triple buffer: the emulator always has a
+ * back buffer to fill, the renderer always takes the newest published
+ * frame, and neither waits for the other.  Input goes the other way
+ * through a single-producer single-consumer queue, every event stamped
+ * with the time it happened so the emulator can place it inside the
+ * frame instead of at its start.
+ */
+#define XCHG_QUEUE  256         /* input events, power of two */
+
+/* A finished frame as the renderer sees it */
+typedef struct {
+    uint64_t FB[2][FB_H][FB_WORDS];
+    uint64_t dirty;             /* rows changed since the previous frame */
+    bool     hires;
+    uint64_t seq;               /* frames published before this one */
+    uint64_t time;              /* when it was published, ns */
+    char     osd[32];           /* overlay text, empty for none */
+} frame_t;
+
+typedef enum {
+    IN_KEY,                     /* keypad key, down or up */
+    IN_REWIND,                  /* Backspace, down or up */
+    IN_SAVE,                    /* F5 */
+    IN_LOAD,                    /* F9 */
+    IN_TURBO                    /* Tab, toggles fast-forward */
+} input_kind_t;
+
+typedef struct {
+    uint64_t time;              /* ns, same clock as frame_t.time */
+    uint8_t  kind;
+    uint8_t  key;
+    bool     down;
+} input_ev_t;
+
+typedef struct xchg xchg_t;
+
+xchg_t* xchg_init(void);
+void xchg_destroy(xchg_t *x);
+
+/* Emulator side: the buffer to fill, then hand it over */
+frame_t* xchg_back(xchg_t *x);
+void xchg_publish(xchg_t *x);
+/* Renderer side: the newest frame, *fresh – not taken before */
+const frame_t* xchg_front(xchg_t *x, bool *fresh);
+
+/* Renderer side; false when the queue is full and the event is lost */
+bool xchg_push(xchg_t *x, const input_ev_t *ev);
+/* Emulator side; false when empty */
+bool xchg_pop(xchg_t *x, input_ev_t *ev);
+/* The oldest queued event, without taking it */
+bool xchg_peek(xchg_t *x, input_ev_t *ev);
+
+/* Either side asks both to finish */
+void xchg_stop(xchg_t *x);
+bool xchg_running(xchg_t *x);
+/* Renderer side: events lost to a full queue */
+uint64_t xchg_dropped(const xchg_t *x);
+
+#endif /* XCHG_H */